@@ -0,0 +1,182 @@
+#include <cstdint>
+#include "context.h"
+
+/*
+typedef struct ucontext_t {
+    struct ucontext_t *uc_link;
+
+    sigset_t uc_sigmask;
+
+    stack_t uc_stack;
+
+    mcontext_t uc_mcontext;
+} ucontext_t;
+*/
+
+//获取协程的上下文信息
+int getcontext(ucontext_t *ucp); 
+
+
+// 恢复ucp指向的上下文信息
+int setcontext(const ucontext_t *ucp);
+
+
+void makecontext(ucontext_t *ucp, void (*func)(), int argc, ...);
+// 执行完makecontext以后，ucp和func就绑定在一起了，调用setcontext或者swapcontext激活ucp时，func就会被运行
+
+// 恢复ucp指向的上下文，同时将当前的上下文存储到oucp中（切换协程）
+// 不会返回，而是调到ucp上下文对应的函数中执行，相当于调用了函数
+int swapcontext(ucontext_t *oucp, const ucontext_t *ucp);
+
+// 汇编切换
+    // 只保存ABI规定的被调用者保存寄存器，调用者保存寄存器在调用fiber_asm_swap前已经由编译器处理
+    // 返回地址由call指令压栈（x86-64）或者保存在x30中（AArch64），ret后回到目标上下文中上次调用fiber_asm_swap的位置
+#if defined(__x86_64__)
+// 栈布局（从高到低）：rbp rbx r12 r13 r14 r15 [mxcsr|x87控制字]
+asm(R"(
+    .pushsection .text
+    .globl fiber_asm_swap
+    .type fiber_asm_swap, %function
+    .p2align 4
+fiber_asm_swap:
+    pushq %rbp
+    pushq %rbx
+    pushq %r12
+    pushq %r13
+    pushq %r14
+    pushq %r15
+    subq $8, %rsp
+    stmxcsr (%rsp)
+    fnstcw 4(%rsp)
+    movq %rsp, (%rdi)
+    movq %rsi, %rsp
+    ldmxcsr (%rsp)
+    fldcw 4(%rsp)
+    addq $8, %rsp
+    popq %r15
+    popq %r14
+    popq %r13
+    popq %r12
+    popq %rbx
+    popq %rbp
+    ret
+    .size fiber_asm_swap, .-fiber_asm_swap
+    .popsection
+)");
+#elif defined(__aarch64__)
+// 栈布局（从低到高）：x19-x28 x29(fp) x30(lr) d8-d15，共160字节
+asm(R"(
+    .pushsection .text
+    .globl fiber_asm_swap
+    .type fiber_asm_swap, %function
+    .p2align 4
+fiber_asm_swap:
+    sub sp, sp, #160
+    stp x19, x20, [sp, #0]
+    stp x21, x22, [sp, #16]
+    stp x23, x24, [sp, #32]
+    stp x25, x26, [sp, #48]
+    stp x27, x28, [sp, #64]
+    stp x29, x30, [sp, #80]
+    stp d8, d9, [sp, #96]
+    stp d10, d11, [sp, #112]
+    stp d12, d13, [sp, #128]
+    stp d14, d15, [sp, #144]
+    mov x2, sp
+    str x2, [x0]
+    mov sp, x1
+    ldp x19, x20, [sp, #0]
+    ldp x21, x22, [sp, #16]
+    ldp x23, x24, [sp, #32]
+    ldp x25, x26, [sp, #48]
+    ldp x27, x28, [sp, #64]
+    ldp x29, x30, [sp, #80]
+    ldp d8, d9, [sp, #96]
+    ldp d10, d11, [sp, #112]
+    ldp d12, d13, [sp, #128]
+    ldp d14, d15, [sp, #144]
+    add sp, sp, #160
+    ret
+    .size fiber_asm_swap, .-fiber_asm_swap
+    .popsection
+)");
+#endif
+
+#ifdef FIBER_CONTEXT_ASM
+
+int context_init(FiberContext* ctx) {
+    // 主协程运行在线程自己的栈上，第一次被切出时由fiber_asm_swap填充sp
+    ctx->sp = nullptr;
+    return 0;
+}
+
+int context_make(FiberContext* ctx, void* stack, size_t stacksize, void (*entry)()) {
+    // 栈顶按16字节对齐
+    uintptr_t top = (reinterpret_cast<uintptr_t>(stack) + stacksize) & ~static_cast<uintptr_t>(15);
+    void** sp = reinterpret_cast<void**>(top);
+
+#if defined(__x86_64__)
+    // 伪造一帧fiber_asm_swap保存的现场，ret弹出entry后rsp % 16 == 8，和正常call进入函数时一致
+    *--sp = nullptr;                           // entry的返回地址，entry不会返回
+    *--sp = reinterpret_cast<void*>(entry);    // fiber_asm_swap的返回地址
+    for (int i = 0; i < 6; i++) {
+        *--sp = nullptr;                       // rbp rbx r12 r13 r14 r15
+    }
+    --sp;
+    uint32_t* fpu = reinterpret_cast<uint32_t*>(sp);
+    fpu[0] = 0x1F80;                           // mxcsr默认值
+    fpu[1] = 0x037F;                           // x87控制字默认值
+#elif defined(__aarch64__)
+    // 160字节的寄存器保存区，x30(lr)即fiber_asm_swap的返回地址，ret后sp回到16字节对齐的栈顶
+    sp -= 20;
+    for (int i = 0; i < 20; i++) {
+        sp[i] = nullptr;
+    }
+    sp[11] = reinterpret_cast<void*>(entry);
+#endif
+
+    ctx->sp = sp;
+    return 0;
+}
+
+int context_swap(FiberContext* from, FiberContext* to) {
+    fiber_asm_swap(&from->sp, to->sp);
+    return 0;
+}
+
+const char* context_backend() {
+#if defined(__x86_64__)
+    return "asm-x86_64";
+#else
+    return "asm-aarch64";
+#endif
+}
+
+#else
+
+int context_init(FiberContext* ctx) {
+    return getcontext(&ctx->uc);
+}
+
+int context_make(FiberContext* ctx, void* stack, size_t stacksize, void (*entry)()) {
+    if (getcontext(&ctx->uc)) {
+        return -1;
+    }
+
+    ctx->uc.uc_link = nullptr;
+    ctx->uc.uc_stack.ss_sp = stack;
+    ctx->uc.uc_stack.ss_size = stacksize;
+
+    makecontext(&ctx->uc, entry, 0);
+    return 0;
+}
+
+int context_swap(FiberContext* from, FiberContext* to) {
+    return swapcontext(&from->uc, &to->uc);
+}
+
+const char* context_backend() {
+    return "ucontext";
+}
+
+#endif
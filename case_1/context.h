@@ -0,0 +1,43 @@
+#ifndef _CONTEXT_H_
+#define _CONTEXT_H_
+
+#include <cstddef>
+#include <ucontext.h>
+
+// 协程上下文后端
+    // swapcontext每次切换都会调用rt_sigprocmask保存/恢复信号掩码，是一次系统调用
+    // x86-64和AArch64下默认使用手写汇编切换：只保存被调用者保存寄存器和栈指针，不处理信号掩码
+    // 编译时定义FIBER_USE_UCONTEXT，或者在其他平台上，回退到ucontext
+#if !defined(FIBER_USE_UCONTEXT) && (defined(__x86_64__) || defined(__aarch64__))
+#define FIBER_CONTEXT_ASM 1
+#endif
+
+// 汇编切换函数：把当前寄存器压入当前栈，栈指针存入*from_sp，再从to_sp恢复寄存器并返回到目标上下文
+    // 只要平台支持就会编译进来，基准测试可以直接和swapcontext比较
+#if defined(__x86_64__) || defined(__aarch64__)
+extern "C" void fiber_asm_swap(void** from_sp, void* to_sp);
+#endif
+
+struct FiberContext {
+#ifdef FIBER_CONTEXT_ASM
+    // 挂起时的栈指针，寄存器都保存在栈上
+    void* sp = nullptr;
+#else
+    ucontext_t uc;
+#endif
+};
+
+// 初始化线程主协程的上下文（对应getcontext），失败返回非0
+int context_init(FiberContext* ctx);
+
+// 在stack上构造一个新的上下文，第一次切换进来时从entry开始执行（对应getcontext + makecontext）
+    // entry不能返回
+int context_make(FiberContext* ctx, void* stack, size_t stacksize, void (*entry)());
+
+// 保存当前上下文到from，切换到to（对应swapcontext），失败返回非0
+int context_swap(FiberContext* from, FiberContext* to);
+
+// 当前使用的后端名称
+const char* context_backend();
+
+#endif
@@ -1,33 +1,6 @@
 #include "coroutine.h"
 #include <iostream> 
 
-/*
-typedef struct ucontext_t {
-    struct ucontext_t *uc_link;
-
-    sigset_t uc_sigmask;
-
-    stack_t uc_stack;
-
-    mcontext_t uc_mcontext;
-} ucontext_t;
-*/
-
-//获取协程的上下文信息
-int getcontext(ucontext_t *ucp); 
-
-
-// 恢复ucp指向的上下文信息
-int setcontext(const ucontext_t *ucp);
-
-
-void makecontext(ucontext_t *ucp, void (*func)(), int argc, ...);
-// 执行完makecontext以后，ucp和func就绑定在一起了，调用setcontext或者swapcontext激活ucp时，func就会被运行
-
-// 恢复ucp指向的上下文，同时将当前的上下文存储到oucp中（切换协程）
-// 不会返回，而是调到ucp上下文对应的函数中执行，相当于调用了函数
-int swapcontext(ucontext_t *oucp, const ucontext_t *ucp);
-
 // 当前线程正在运行的协程
 static thread_local Fiber* t_fiber = nullptr;
 
@@ -71,7 +44,7 @@ Fiber::Fiber() {
     m_state = RUNNING;
 
     //获取当前协程的上下文
-    if (getcontext(&m_ctx)) {
+    if (context_init(&m_ctx)) {
         std::cerr << "Fiber() failed\n";
         exit(0);
     }
@@ -92,19 +65,12 @@ m_cb(cb) {
     m_stacksize = stacksize ? stacksize : 128000;
     m_stack = malloc(m_stacksize);
 
-    if (getcontext(&m_ctx)) {
+    // 在子协程栈上构造上下文，并和入口函数绑定
+    if (context_make(&m_ctx, m_stack, m_stacksize, &Fiber::MainFunc)) {
         std::cerr << "Fiber(std::function<void()>cb, size_t stacksize, bool run_in_scheduler) failed\n";
         exit(0);
     }
 
-    // 修改为子协程上下文
-    m_ctx.uc_link = nullptr;
-    m_ctx.uc_stack.ss_sp = m_stack;
-    m_ctx.uc_stack.ss_size = m_stacksize;
-
-    // 将子协程上下文和函数入口函数绑定
-    makecontext(&m_ctx, &Fiber::MainFunc, 0);
-
     // 更新当前线程的协程控制信息
     m_id =  s_fiber_id++;
     s_fiber_count++;
@@ -126,16 +92,10 @@ void Fiber::reset(std::function<void()> cb) {
     m_cb = cb;
     m_state = READY;
 
-    if (getcontext(&m_ctx)) {
+    if (context_make(&m_ctx, m_stack, m_stacksize, &Fiber::MainFunc)) {
         std::cerr << "reset() failed\n";
         exit(0);
     }
-
-    m_ctx.uc_link = nullptr;
-    m_ctx.uc_stack.ss_sp = m_stack;
-    m_ctx.uc_stack.ss_size = m_stacksize;
-
-    makecontext(&m_ctx, &Fiber::MainFunc, 0);
 }
 
 // 在非对称协程中，执行resume时当前执行的协程一定是主协程
@@ -146,7 +106,7 @@ void Fiber::resume() {
     SetThis(this);
     m_state = RUNNING;
 
-    if (swapcontext(&(t_thread_fiber->m_ctx), &m_ctx)) {
+    if (context_swap(&(t_thread_fiber->m_ctx), &m_ctx)) {
         std::cerr << "resume() failed\n";
         exit(0);
     }
@@ -162,7 +122,7 @@ void Fiber::yield() {
         m_state = READY;
     }
 
-    if (swapcontext(&m_ctx, &(t_thread_fiber->m_ctx))) {
+    if (context_swap(&m_ctx, &(t_thread_fiber->m_ctx))) {
         std::cerr << "yield() failed\n";
         exit(0);
     }
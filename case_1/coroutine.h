@@ -6,7 +6,8 @@
 #include <atomic>       // std::atomic
 #include <functional>   // std::function
 #include <cassert>      // assert
-#include <ucontext.h>   // ucontext_t, getcontext, setcontext, swapcontext, makecontext
+
+#include "context.h"    // FiberContext, context_init, context_make, context_swap
 
 	// 公有继承 -> 继承自这个类的对象可以安全地生成一个指向自身的std::shared_ptr 
 	// 通过shared_from_this()方法获取指向调用对象的的shared_ptr <-> 对比this指针 
@@ -87,8 +88,8 @@ private:
 	uint32_t m_stacksize = 0;
 	// 协程状态
 	State m_state = READY;
-	// 协程上下文 -> 需要c++的<ucontext.h>标准库的支持
-	ucontext_t m_ctx;
+	// 协程上下文 -> 默认使用汇编切换，FIBER_USE_UCONTEXT时回退到<ucontext.h>
+	FiberContext m_ctx;
 	// 协程栈地址
 	void* m_stack = nullptr;
 	// 协程入口函数
@@ -0,0 +1,60 @@
+// 批量发布基准：外部线程以不同的批大小发布空任务，测量从开始发布到全部执行完的吞吐量
+// g++ -std=c++17 -O2 bench_batch.cpp context.cpp stack_allocator.cpp coroutine.cpp fiber_pool.cpp numa_topology.cpp log.cpp metrics.cpp scheduler.cpp fiber_thread.cpp fiber_sync.cpp future.cpp -pthread -o bench_batch
+// 调度器日志打印在标准输出，结果打印在标准错误：./bench_batch > /dev/null
+
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "scheduler.h"
+
+static const int kTasks = 200000;
+
+static double now_sec() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// batch为0时逐个调用scheduleLock
+static void bench(Scheduler& scheduler, int batch) {
+    std::atomic<int> done{0};
+    auto cb = [&done]() {
+        done.fetch_add(1, std::memory_order_relaxed);
+    };
+
+    double start = now_sec();
+    if (batch == 0) {
+        for (int i = 0; i < kTasks; i++) {
+            scheduler.scheduleLock(cb);
+        }
+    } else {
+        std::vector<std::function<void()>> cbs(batch, cb);
+        for (int i = 0; i < kTasks; i += batch) {
+            scheduler.scheduleBatch(cbs.begin(), cbs.end());
+        }
+    }
+    double posted = now_sec();
+
+    int total = batch == 0 ? kTasks : (kTasks + batch - 1) / batch * batch;
+    while (done.load() < total) {
+        std::this_thread::yield();
+    }
+    double end = now_sec();
+
+    std::cerr << (batch == 0 ? std::string("scheduleLock") : "batch " + std::to_string(batch)) << ": "
+              << "post " << (posted - start) * 1e9 / total << " ns/task, "
+              << "throughput " << total / (end - start) / 1e6 << " M tasks/s" << std::endl;
+}
+
+int main() {
+    // 主线程只发布任务，不参与调度
+    Scheduler scheduler(4, false, "bench");
+    scheduler.start();
+
+    for (int batch : {0, 1, 16, 256}) {
+        bench(scheduler, batch);
+    }
+
+    scheduler.stop();
+    return 0;
+}
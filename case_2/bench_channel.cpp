@@ -0,0 +1,98 @@
+// 通道交接基准：两级流水线之间传递整数，对比协程之间的Channel和线程之间的std::mutex + std::condition_variable队列
+// g++ -std=c++17 -O2 bench_channel.cpp context.cpp stack_allocator.cpp coroutine.cpp fiber_pool.cpp numa_topology.cpp log.cpp metrics.cpp scheduler.cpp fiber_thread.cpp fiber_sync.cpp future.cpp channel.cpp -pthread -o bench_channel
+// 调度器日志打印在标准输出，结果打印在标准错误：./bench_channel > /dev/null
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+#include "scheduler.h"
+#include "channel.h"
+
+static const int kItems = 200000;
+
+static uint64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void report(const char* name, uint64_t ns, long sum) {
+    std::cerr << name << ": " << (double)ns / kItems << " ns/item (sum " << sum << ")" << std::endl;
+}
+
+// 生产者协程 -> 消费者协程
+static void bench_channel(Scheduler& scheduler, size_t capacity, const char* name) {
+    Channel<int> channel(capacity);
+    FiberLatch done(1);
+    long sum = 0;
+
+    uint64_t start = now_ns();
+    scheduler.scheduleLock([&]() {
+        for (int i = 0; i < kItems; i++) {
+            channel.send(i);
+        }
+        channel.close();
+    });
+    scheduler.scheduleLock([&]() {
+        int v;
+        while (channel.recv(v)) {
+            sum += v;
+        }
+        done.count_down();
+    });
+    done.wait();
+    report(name, now_ns() - start, sum);
+}
+
+// 生产者线程 -> 消费者线程
+static void bench_thread_queue(size_t capacity) {
+    std::mutex mutex;
+    std::condition_variable not_empty, not_full;
+    std::deque<int> queue;
+    bool closed = false;
+    long sum = 0;
+
+    uint64_t start = now_ns();
+    std::thread producer([&]() {
+        for (int i = 0; i < kItems; i++) {
+            std::unique_lock<std::mutex> lock(mutex);
+            not_full.wait(lock, [&]() {return queue.size() < capacity;});
+            queue.push_back(i);
+            not_empty.notify_one();
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+        not_empty.notify_one();
+    });
+    std::thread consumer([&]() {
+        while (true) {
+            std::unique_lock<std::mutex> lock(mutex);
+            not_empty.wait(lock, [&]() {return !queue.empty() || closed;});
+            if (queue.empty()) {
+                break;
+            }
+            sum += queue.front();
+            queue.pop_front();
+            not_full.notify_one();
+        }
+    });
+    producer.join();
+    consumer.join();
+    report(capacity == 1 ? "thread queue(1)" : "thread queue(64)", now_ns() - start, sum);
+}
+
+int main() {
+    Scheduler scheduler(2, false, "bench");
+    scheduler.start();
+
+    bench_channel(scheduler, 0, "channel(unbuffered)");
+    bench_channel(scheduler, 64, "channel(64)");
+    bench_thread_queue(1);
+    bench_thread_queue(64);
+
+    scheduler.stop();
+    return 0;
+}
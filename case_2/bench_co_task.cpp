@@ -0,0 +1,146 @@
+// 无栈协程基准：对比Task<T>和Fiber挂起时占用的内存，以及让出再恢复一次的开销
+// g++ -std=c++20 -O2 bench_co_task.cpp context.cpp stack_allocator.cpp coroutine.cpp fiber_pool.cpp numa_topology.cpp log.cpp metrics.cpp scheduler.cpp fiber_thread.cpp fiber_sync.cpp future.cpp channel.cpp timer.cpp hook.cpp fd_manager.cpp iomanager.cpp -pthread -o bench_co_task
+// 调度器日志打印在标准输出，结果打印在标准错误：./bench_co_task > /dev/null
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <malloc.h>
+#include <unistd.h>
+
+#include "co_task.h"
+
+static const int kParked = 10000;
+static const int kYields = 200000;
+
+// 统计经过operator new分配的堆内存（协程帧、Fiber对象都从这里分配，Fiber的栈由StackAllocator直接mmap）
+static std::atomic<int64_t> s_heap_bytes{0};
+
+void* operator new(size_t size) {
+    void* p = malloc(size);
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    s_heap_bytes.fetch_add(malloc_usable_size(p), std::memory_order_relaxed);
+    return p;
+}
+
+void operator delete(void* p) noexcept {
+    if (p) {
+        s_heap_bytes.fetch_sub(malloc_usable_size(p), std::memory_order_relaxed);
+        free(p);
+    }
+}
+
+void operator delete(void* p, size_t) noexcept {
+    operator delete(p);
+}
+
+static uint64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// 虚拟内存和常驻内存，单位字节
+static void vm_bytes(int64_t& size, int64_t& rss) {
+    long pages = 0, resident = 0;
+    FILE* f = fopen("/proc/self/statm", "r");
+    if (f) {
+        if (fscanf(f, "%ld %ld", &pages, &resident) != 2) {
+            pages = resident = 0;
+        }
+        fclose(f);
+    }
+    size = (int64_t)pages * sysconf(_SC_PAGESIZE);
+    rss = (int64_t)resident * sysconf(_SC_PAGESIZE);
+}
+
+// 已经开始运行、即将挂起的协程数
+static std::atomic<int> s_started{0};
+
+static Task<void> parked_task(Channel<int>& channel) {
+    int v;
+    s_started++;
+    co_await task_recv(channel, v);
+}
+
+static Task<void> yield_task() {
+    for (int i = 0; i < kYields; i++) {
+        co_await task_yield();
+    }
+}
+
+// kParked个协程挂起在同一个通道上，统计每个协程的内存
+static void bench_memory(Scheduler& scheduler, bool stackless) {
+    Channel<int> channel(0);
+    std::vector<Future<void>> futures;
+
+    s_started = 0;
+    int64_t heap_before = s_heap_bytes.load();
+    int64_t vm_before, rss_before;
+    vm_bytes(vm_before, rss_before);
+    for (int i = 0; i < kParked; i++) {
+        if (stackless) {
+            futures.push_back(task_spawn(scheduler, parked_task(channel)));
+        } else {
+            futures.push_back(scheduler.submit([&channel]() {
+                int v;
+                s_started++;
+                channel.recv(v);
+            }));
+        }
+    }
+    // 等到所有协程都挂起
+    while (s_started.load() < kParked) {
+        usleep(1000);
+    }
+    usleep(10000);
+    int64_t heap = s_heap_bytes.load() - heap_before;
+    int64_t vm, rss;
+    vm_bytes(vm, rss);
+    vm -= vm_before;
+    rss -= rss_before;
+
+    channel.close();
+    for (Future<void>& future : futures) {
+        future.get();
+    }
+
+    std::cerr << (stackless ? "Task " : "Fiber") << " parked: heap " << heap / kParked << " B/each, vm "
+              << vm / kParked << " B/each, rss " << rss / kParked << " B/each" << std::endl;
+}
+
+static void bench_switch(Scheduler& scheduler, bool stackless) {
+    uint64_t start = now_ns();
+    if (stackless) {
+        task_spawn(scheduler, yield_task()).get();
+    } else {
+        scheduler.submit([]() {
+            for (int i = 0; i < kYields; i++) {
+                Scheduler::GetThis()->scheduleLock(Fiber::GetThis());
+                Fiber::GetThis()->yield();
+            }
+        }).get();
+    }
+    std::cerr << (stackless ? "Task " : "Fiber") << " yield+resume: "
+              << (double)(now_ns() - start) / kYields << " ns" << std::endl;
+}
+
+int main() {
+    // 每次取新的调度器，避免前一轮的对象池影响内存统计
+    for (bool stackless : {true, false}) {
+        Scheduler scheduler(1, false, "bench");
+        scheduler.start();
+        bench_memory(scheduler, stackless);
+        scheduler.stop();
+    }
+
+    for (bool stackless : {true, false}) {
+        Scheduler scheduler(1, false, "bench");
+        scheduler.start();
+        bench_switch(scheduler, stackless);
+        scheduler.stop();
+    }
+    return 0;
+}
@@ -0,0 +1,96 @@
+// 上下文切换微基准：比较swapcontext和汇编切换每次切换的耗时（ns）
+// g++ -std=c++17 -O2 bench_context.cpp context.cpp stack_allocator.cpp coroutine.cpp fiber_pool.cpp numa_topology.cpp log.cpp metrics.cpp scheduler.cpp fiber_thread.cpp fiber_sync.cpp future.cpp -pthread -o bench_context
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <ucontext.h>
+
+#include "coroutine.h"
+
+static const int kRounds = 1000000;
+static const size_t kStackSize = 64 * 1024;
+
+static ucontext_t s_uc_main, s_uc_child;
+
+static void uc_child() {
+    while (true) {
+        swapcontext(&s_uc_child, &s_uc_main);
+    }
+}
+
+// 一来一回算两次切换
+static double bench_ucontext() {
+    void* stack = malloc(kStackSize);
+    getcontext(&s_uc_child);
+    s_uc_child.uc_link = nullptr;
+    s_uc_child.uc_stack.ss_sp = stack;
+    s_uc_child.uc_stack.ss_size = kStackSize;
+    makecontext(&s_uc_child, uc_child, 0);
+
+    auto begin = std::chrono::steady_clock::now();
+    for (int i = 0; i < kRounds; i++) {
+        swapcontext(&s_uc_main, &s_uc_child);
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    free(stack);
+    return std::chrono::duration<double, std::nano>(end - begin).count() / (kRounds * 2.0);
+}
+
+#ifdef FIBER_CONTEXT_ASM
+static void* s_asm_main = nullptr;
+static void* s_asm_child = nullptr;
+
+static void asm_child() {
+    while (true) {
+        fiber_asm_swap(&s_asm_child, s_asm_main);
+    }
+}
+
+static double bench_asm() {
+    void* stack = malloc(kStackSize);
+    FiberContext child;
+    context_make(&child, stack, kStackSize, asm_child);
+    s_asm_child = child.sp;
+
+    auto begin = std::chrono::steady_clock::now();
+    for (int i = 0; i < kRounds; i++) {
+        fiber_asm_swap(&s_asm_main, s_asm_child);
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    free(stack);
+    return std::chrono::duration<double, std::nano>(end - begin).count() / (kRounds * 2.0);
+}
+#endif
+
+// 通过Fiber::resume()/yield()切换，使用当前编译选择的后端
+static double bench_fiber() {
+    Fiber::GetThis();
+    Fiber::ptr fiber(new Fiber([]() {
+        Fiber* self = Fiber::GetThis().get();
+        while (true) {
+            self->yield();
+        }
+    }, kStackSize, false));
+
+    auto begin = std::chrono::steady_clock::now();
+    for (int i = 0; i < kRounds; i++) {
+        fiber->resume();
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    return std::chrono::duration<double, std::nano>(end - begin).count() / (kRounds * 2.0);
+}
+
+int main() {
+    std::cout << "rounds: " << kRounds << "\n";
+    std::cout << "swapcontext:        " << bench_ucontext() << " ns/switch\n";
+#ifdef FIBER_CONTEXT_ASM
+    std::cout << "fiber_asm_swap:     " << bench_asm() << " ns/switch\n";
+#endif
+    double fiber_ns = bench_fiber();
+    std::cout << "Fiber(" << context_backend() << "): " << fiber_ns << " ns/switch\n";
+    return 0;
+}
@@ -0,0 +1,54 @@
+// 动态线程池基准：任务阻塞在没有hook的系统调用里时，对比固定线程数和动态线程池完成一批任务的时间，以及负载消失后线程数的回落
+// g++ -std=c++17 -O2 bench_dynamic_pool.cpp context.cpp stack_allocator.cpp coroutine.cpp fiber_pool.cpp numa_topology.cpp log.cpp metrics.cpp scheduler.cpp fiber_thread.cpp fiber_sync.cpp future.cpp -pthread -o bench_dynamic_pool
+// 调度器日志打印在标准输出，结果打印在标准错误：./bench_dynamic_pool > /dev/null
+
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "scheduler.h"
+
+static const int kTasks = 64;
+static const int kBlockMs = 20;
+
+static uint64_t now_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// 每个任务阻塞kBlockMs毫秒，调度器没有hook系统调用，阻塞期间整个工作线程被占住
+static void bench(size_t max_threads) {
+    Scheduler::Options options(2, false, "bench");
+    options.maxThreads = max_threads;
+    options.spawnWaitMs = 5;
+    options.idleRetireMs = 200;
+    Scheduler scheduler(options);
+    scheduler.start();
+
+    uint64_t start = now_ms();
+    std::vector<Future<void>> futures;
+    for (int i = 0; i < kTasks; i++) {
+        futures.push_back(scheduler.submit([]() {
+            std::this_thread::sleep_for(std::chrono::milliseconds(kBlockMs));
+        }));
+    }
+    when_all(std::move(futures)).get();
+    uint64_t elapsed = now_ms() - start;
+    SchedulerMetrics busy = scheduler.getMetrics();
+
+    // 等空闲的线程退出
+    std::this_thread::sleep_for(std::chrono::milliseconds(options.idleRetireMs * 3));
+    SchedulerMetrics idle = scheduler.getMetrics();
+
+    std::cerr << "threads 2, max " << (max_threads ? max_threads : 2) << ": " << elapsed << " ms, peak threads "
+              << busy.liveThreads << ", threads after idle " << idle.liveThreads << std::endl;
+    scheduler.stop();
+}
+
+int main() {
+    bench(0);
+    bench(8);
+    bench(16);
+    return 0;
+}
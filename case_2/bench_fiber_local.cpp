@@ -0,0 +1,80 @@
+// 协程局部存储基准：FiberLocal<T>::get()、thread_local、以协程id为键的哈希表（加锁）三种方式读取请求上下文的开销
+// g++ -std=c++17 -O2 bench_fiber_local.cpp context.cpp stack_allocator.cpp coroutine.cpp fiber_pool.cpp numa_topology.cpp log.cpp metrics.cpp scheduler.cpp fiber_thread.cpp fiber_sync.cpp future.cpp -pthread -o bench_fiber_local
+// 调度器日志打印在标准输出，结果打印在标准错误：./bench_fiber_local > /dev/null
+
+#include <chrono>
+#include <iostream>
+#include <mutex>
+#include <unordered_map>
+
+#include "scheduler.h"
+#include "fiber_local.h"
+
+static const int kTasks = 1000;
+static const int kReads = 10000;
+
+struct RequestContext {
+    uint64_t traceId = 0;
+};
+
+static FiberLocal<RequestContext> s_context;
+
+static thread_local RequestContext t_context;
+
+static std::mutex s_map_mutex;
+static std::unordered_map<uint64_t, RequestContext> s_map;
+
+static uint64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// 每个任务设置一次上下文，然后读kReads次
+static void bench(const char* name, int mode) {
+    Scheduler scheduler(4, false, "bench");
+    scheduler.start();
+    std::atomic<uint64_t> sum{0};
+    uint64_t start = now_ns();
+    for (int i = 0; i < kTasks; i++) {
+        scheduler.scheduleLock([mode, i, &sum]() {
+            uint64_t local = 0;
+            if (mode == 0) {
+                s_context.reset(new RequestContext());
+                s_context->traceId = i;
+                for (int j = 0; j < kReads; j++) {
+                    local += s_context.get()->traceId;
+                    asm volatile("" : : : "memory");
+                }
+            } else if (mode == 1) {
+                t_context.traceId = i;
+                for (int j = 0; j < kReads; j++) {
+                    local += t_context.traceId;
+                    asm volatile("" : : : "memory");
+                }
+            } else {
+                uint64_t id = Fiber::GetFiberId();
+                {
+                    std::lock_guard<std::mutex> lock(s_map_mutex);
+                    s_map[id].traceId = i;
+                }
+                for (int j = 0; j < kReads; j++) {
+                    std::lock_guard<std::mutex> lock(s_map_mutex);
+                    local += s_map[id].traceId;
+                }
+                std::lock_guard<std::mutex> lock(s_map_mutex);
+                s_map.erase(id);
+            }
+            sum += local;
+        });
+    }
+    scheduler.stop();
+    std::cerr << name << ": " << (double)(now_ns() - start) / ((uint64_t)kTasks * kReads) << " ns/read (sum "
+              << sum.load() << ")" << std::endl;
+}
+
+int main() {
+    bench("FiberLocal", 0);
+    bench("thread_local", 1);
+    bench("map by fiber id", 2);
+    return 0;
+}
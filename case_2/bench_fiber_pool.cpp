@@ -0,0 +1,77 @@
+// 协程池基准：工作线程的协程中创建协程并投递，比较new Fiber和FiberPool::Acquire的创建耗时
+// g++ -std=c++17 -O2 bench_fiber_pool.cpp context.cpp stack_allocator.cpp coroutine.cpp fiber_pool.cpp numa_topology.cpp log.cpp metrics.cpp scheduler.cpp fiber_thread.cpp fiber_sync.cpp future.cpp -pthread -o bench_fiber_pool
+// 调度器日志打印在标准输出，结果打印在标准错误：./bench_fiber_pool > /dev/null
+
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "scheduler.h"
+#include "fiber_pool.h"
+
+static const int kFibers = 100000;
+// 每批创建的协程数，不超过线程缓存上限，执行完的协程都能留在本线程的缓存中
+static const int kWave = 32;
+
+static double now_ns() {
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// 分批创建并投递kFibers个协程，每批执行完再创建下一批，返回每个协程的创建耗时
+static double create_all(Scheduler& scheduler, bool pooled) {
+    // 每批的最后一个协程把创建协程重新投递回去
+        // 本地队列后进先出，创建协程不能自己反复投递自己等待
+    Fiber::ptr self = Fiber::GetThis();
+    std::atomic<int> done{0};
+    auto cb = [&]() {
+        if ((done.fetch_add(1, std::memory_order_relaxed) + 1) % kWave == 0) {
+            scheduler.scheduleLock(self);
+        }
+    };
+
+    double elapsed = 0;
+    std::vector<Fiber::ptr> fibers;
+    for (int created = 0; created < kFibers; created += kWave) {
+        double begin = now_ns();
+        for (int i = 0; i < kWave; i++) {
+            fibers.push_back(pooled ? FiberPool::Acquire(cb) : Fiber::ptr(new Fiber(cb)));
+        }
+        elapsed += now_ns() - begin;
+
+        scheduler.scheduleBatch(fibers.begin(), fibers.end());
+        fibers.clear();
+
+        // 让出本线程，等这一批执行完
+        self->yield();
+    }
+    return elapsed / kFibers;
+}
+
+int main() {
+    Scheduler scheduler(1, false, "bench");
+    scheduler.start();
+
+    std::atomic<bool> finished{false};
+    scheduler.scheduleLock([&]() {
+        // 先跑一轮，让栈缓存和协程池都准备好
+        create_all(scheduler, true);
+
+        double fresh = create_all(scheduler, false);
+        double pooled = create_all(scheduler, true);
+        std::cerr << "new Fiber: " << fresh << " ns/fiber" << std::endl;
+        std::cerr << "FiberPool::Acquire: " << pooled << " ns/fiber" << std::endl;
+
+        FiberPool::Stats stats = FiberPool::GetStats();
+        std::cerr << "fiber pool: local hits " << stats.localHits << ", global hits " << stats.globalHits
+                  << ", misses " << stats.misses << ", recycles " << stats.recycles
+                  << ", frees " << stats.frees << std::endl;
+        finished = true;
+    });
+    while (!finished) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    scheduler.stop();
+    return 0;
+}
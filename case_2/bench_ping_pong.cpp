@@ -0,0 +1,107 @@
+// 乒乓基准：两个协程轮流唤醒对方，对比经过调度协程的切换和Fiber::transferTo()直接切换，输出每次交接的耗时和切换次数
+// g++ -std=c++17 -O2 bench_ping_pong.cpp context.cpp stack_allocator.cpp coroutine.cpp fiber_pool.cpp numa_topology.cpp log.cpp metrics.cpp scheduler.cpp fiber_thread.cpp fiber_sync.cpp future.cpp channel.cpp -pthread -o bench_ping_pong
+// 调度器日志打印在标准输出，结果打印在标准错误：./bench_ping_pong > /dev/null
+
+#include <chrono>
+#include <iostream>
+
+#include "scheduler.h"
+#include "channel.h"
+
+static const int kRounds = 200000;
+
+static uint64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// 经过调度协程的任务一进一出两次上下文切换，直接切换只有一次
+static void report(const char* name, uint64_t ns, const SchedulerMetrics& before, const SchedulerMetrics& after) {
+    uint64_t switches = after.switches - before.switches;
+    uint64_t transfers = after.transfers - before.transfers;
+    // 每轮两次交接
+    std::cerr << name << ": " << (double)ns / (2 * kRounds) << " ns/handoff, "
+              << (double)(2 * switches + transfers) / (2 * kRounds) << " context switches/handoff" << std::endl;
+}
+
+// 协程自己投递对方再切出：direct为false时scheduleLock + yield，为true时scheduleNext + YieldToNext
+static void bench_fibers(bool direct) {
+    Scheduler scheduler(1, false, "bench");
+    scheduler.start();
+
+    Fiber* peers[2] = {nullptr, nullptr};
+    FiberLatch done(2);
+    auto handoff = [&scheduler, direct](Fiber* to) {
+        if (direct) {
+            scheduler.scheduleNext(Fiber::ptr(to));
+            Scheduler::YieldToNext();
+        } else {
+            scheduler.scheduleLock(Fiber::ptr(to));
+            Fiber::GetThis()->yield();
+        }
+    };
+
+    // a交接kRounds次以后再投递b一次，让停在最后一次交接上的b结束
+    Fiber::ptr a(new Fiber([&]() {
+        for (int i = 0; i < kRounds; i++) {
+            handoff(peers[1]);
+        }
+        scheduler.scheduleLock(Fiber::ptr(peers[1]));
+        done.count_down();
+    }));
+    Fiber::ptr b(new Fiber([&]() {
+        for (int i = 0; i < kRounds; i++) {
+            handoff(peers[0]);
+        }
+        done.count_down();
+    }));
+    peers[0] = a.get();
+    peers[1] = b.get();
+
+    SchedulerMetrics before = scheduler.getMetrics();
+    uint64_t start = now_ns();
+    scheduler.scheduleLock(a);
+    done.wait();
+    uint64_t ns = now_ns() - start;
+    report(direct ? "scheduleNext + YieldToNext" : "scheduleLock + yield     ", ns, before, scheduler.getMetrics());
+    scheduler.stop();
+}
+
+// 两个无缓冲通道来回传一个整数，通道的唤醒走runnext槽位和直接切换
+static void bench_channel() {
+    Scheduler scheduler(1, false, "bench");
+    scheduler.start();
+
+    Channel<int> ping(0), pong(0);
+    FiberLatch done(2);
+
+    SchedulerMetrics before = scheduler.getMetrics();
+    uint64_t start = now_ns();
+    scheduler.scheduleLock([&]() {
+        int v = 0;
+        for (int i = 0; i < kRounds; i++) {
+            ping.send(v);
+            pong.recv(v);
+        }
+        done.count_down();
+    });
+    scheduler.scheduleLock([&]() {
+        int v;
+        for (int i = 0; i < kRounds; i++) {
+            ping.recv(v);
+            pong.send(v + 1);
+        }
+        done.count_down();
+    });
+    done.wait();
+    uint64_t ns = now_ns() - start;
+    report("channel ping-pong         ", ns, before, scheduler.getMetrics());
+    scheduler.stop();
+}
+
+int main() {
+    bench_fibers(false);
+    bench_fibers(true);
+    bench_channel();
+    return 0;
+}
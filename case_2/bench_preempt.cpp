@@ -0,0 +1,100 @@
+// 协作式抢占基准：两个CPU密集的任务占满两个工作线程时，随后投递的小任务要等多久；以及安全点Fiber::MaybeYield()本身的开销
+// g++ -std=c++17 -O2 bench_preempt.cpp context.cpp stack_allocator.cpp coroutine.cpp fiber_pool.cpp numa_topology.cpp log.cpp metrics.cpp scheduler.cpp fiber_thread.cpp fiber_sync.cpp future.cpp -pthread -o bench_preempt
+// 调度器日志（包括看门狗的超时报告）打印在标准输出，结果打印在标准错误：./bench_preempt > /dev/null
+
+#include <chrono>
+#include <iostream>
+#include <thread>
+
+#include "scheduler.h"
+
+static const int kThreads = 2;
+static const int kSmallTasks = 100;
+static const uint64_t kHogMs = 300;
+static const uint64_t kSafepoints = 100000000;
+
+static volatile uint64_t s_sink;
+
+enum Mode {
+    NO_WATCHDOG,    // 不启用看门狗
+    SAFEPOINT,      // 循环中调用Fiber::MaybeYield()
+    NO_SAFEPOINT,   // 启用看门狗但循环中没有安全点，只有报告
+    FORCED          // 循环放在PreemptibleScope中，由信号强制让出
+};
+
+static void hog(Mode mode) {
+    uint64_t end = Scheduler::NowNs() + kHogMs * 1000000;
+    while (Scheduler::NowNs() < end) {
+        if (mode == FORCED) {
+            Fiber::PreemptibleScope scope;
+            for (int i = 0; i < 10000; i++) {
+                s_sink = s_sink + i;
+            }
+        } else {
+            for (int i = 0; i < 10000; i++) {
+                s_sink = s_sink + i;
+            }
+            if (mode == SAFEPOINT) {
+                Fiber::MaybeYield();
+            }
+        }
+    }
+}
+
+static void bench_wait(const char* name, Mode mode) {
+    Scheduler::Options options(kThreads, false, "bench");
+    options.timeSliceMs = mode == NO_WATCHDOG ? 0 : 10;
+    options.forcePreempt = mode == FORCED;
+    Scheduler scheduler(options);
+    scheduler.start();
+
+    for (int i = 0; i < kThreads; i++) {
+        scheduler.scheduleLock([mode]() {hog(mode);});
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+
+    std::atomic<uint64_t> worst{0};
+    std::atomic<int> done{0};
+    for (int i = 0; i < kSmallTasks; i++) {
+        uint64_t post = Scheduler::NowNs();
+        scheduler.scheduleLock([&worst, &done, post]() {
+            uint64_t wait = Scheduler::NowNs() - post;
+            uint64_t w = worst.load();
+            while (wait > w && !worst.compare_exchange_weak(w, wait)) {
+            }
+            done++;
+        });
+    }
+    while (done.load() < kSmallTasks) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    scheduler.stop();
+    SchedulerMetrics metrics = scheduler.getMetrics();
+    std::cerr << name << ": worst small-task wait " << worst.load() / 1000000 << " ms, overruns " << metrics.overruns
+              << ", yields " << metrics.preemptions << ", forced " << metrics.forcedPreemptions << std::endl;
+}
+
+// 没有要求让出时的安全点开销
+static void bench_safepoint() {
+    Scheduler::Options options(1, false, "bench");
+    options.timeSliceMs = 1000;
+    Scheduler scheduler(options);
+    scheduler.start();
+    scheduler.scheduleLock([]() {
+        uint64_t start = Scheduler::NowNs();
+        for (uint64_t i = 0; i < kSafepoints; i++) {
+            Fiber::MaybeYield();
+        }
+        std::cerr << "MaybeYield() not requested: " << (double)(Scheduler::NowNs() - start) / kSafepoints << " ns" << std::endl;
+    });
+    scheduler.stop();
+}
+
+int main() {
+    bench_wait("no watchdog", NO_WATCHDOG);
+    bench_wait("watchdog, no safepoint", NO_SAFEPOINT);
+    bench_wait("watchdog, MaybeYield()", SAFEPOINT);
+    bench_wait("watchdog, forced", FORCED);
+    bench_safepoint();
+    return 0;
+}
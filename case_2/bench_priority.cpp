@@ -0,0 +1,88 @@
+// 优先级类别基准：大量批处理任务排队时，少量延迟敏感任务从投递到开始执行的等待时间；以及只用普通类别时的吞吐
+// g++ -std=c++17 -O2 bench_priority.cpp context.cpp stack_allocator.cpp coroutine.cpp fiber_pool.cpp numa_topology.cpp log.cpp metrics.cpp scheduler.cpp fiber_thread.cpp fiber_sync.cpp future.cpp -pthread -o bench_priority
+// 调度器日志打印在标准输出，结果打印在标准错误：./bench_priority > /dev/null
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+#include "scheduler.h"
+
+static const int kBulk = 200000;
+static const int kRpc = 200;
+
+static uint64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// 批处理任务：做一点计算
+static void bulk_work() {
+    volatile int x = 0;
+    for (int i = 0; i < 200; i++) {
+        x = x + i;
+    }
+}
+
+// 每投递kBulk / kRpc个批处理任务，穿插投递一个延迟敏感任务，统计它的等待时间
+static void bench_mixed(bool use_priority) {
+    Scheduler scheduler(1, false, "bench");
+    std::vector<uint64_t> waits(kRpc);
+    std::atomic<int> done{0};
+    FiberLatch finished(kBulk + kRpc);
+
+    scheduler.start();
+    for (int i = 0; i < kBulk; i++) {
+        scheduler.scheduleLock([&]() {
+            bulk_work();
+            finished.count_down();
+        });
+        if (i % (kBulk / kRpc) == 0) {
+            int id = done.fetch_add(1);
+            uint64_t posted = now_ns();
+            auto rpc = [&, id, posted]() {
+                waits[id] = now_ns() - posted;
+                finished.count_down();
+            };
+            if (use_priority) {
+                scheduler.scheduleLock(rpc, Scheduler::PRIORITY_HIGH, Scheduler::NowNs() + 1000000);
+            } else {
+                scheduler.scheduleLock(rpc);
+            }
+        }
+    }
+    finished.wait();
+    scheduler.stop();
+
+    std::sort(waits.begin(), waits.end());
+    std::cerr << (use_priority ? "rpc as HIGH  " : "rpc as NORMAL") << ": wait p50 "
+              << waits[kRpc / 2] / 1000 << " us, p99 " << waits[kRpc * 99 / 100] / 1000 << " us, max "
+              << waits.back() / 1000 << " us" << std::endl;
+}
+
+// 只有普通任务时的吞吐，和加入优先级类别之前的调度路径对比
+static void bench_normal_only() {
+    Scheduler scheduler(1, false, "bench");
+    FiberLatch finished(kBulk);
+
+    scheduler.start();
+    uint64_t start = now_ns();
+    for (int i = 0; i < kBulk; i++) {
+        scheduler.scheduleLock([&]() {
+            finished.count_down();
+        });
+    }
+    finished.wait();
+    uint64_t ns = now_ns() - start;
+    scheduler.stop();
+    std::cerr << "normal only: " << (double)ns / kBulk << " ns/task" << std::endl;
+}
+
+int main() {
+    bench_mixed(false);
+    bench_mixed(true);
+    bench_normal_only();
+    return 0;
+}
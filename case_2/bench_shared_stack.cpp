@@ -0,0 +1,76 @@
+// 共享栈基准：比较私有栈和共享栈两种模式下，每个挂起协程占用的内存和切换耗时
+// g++ -std=c++17 -O2 bench_shared_stack.cpp context.cpp stack_allocator.cpp coroutine.cpp fiber_pool.cpp numa_topology.cpp log.cpp metrics.cpp scheduler.cpp fiber_thread.cpp fiber_sync.cpp future.cpp -pthread -o bench_shared_stack
+// 协程创建日志打印在标准输出，结果打印在标准错误：./bench_shared_stack > /dev/null
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+#include "coroutine.h"
+
+static const int kFibers = 10000;
+static const int kRounds = 20;
+
+// 当前进程的常驻内存（字节）
+static size_t rss_bytes() {
+    std::ifstream statm("/proc/self/statm");
+    size_t pages = 0, resident = 0;
+    statm >> pages >> resident;
+    return resident * sysconf(_SC_PAGESIZE);
+}
+
+// 模拟处理请求时用到的一点栈空间
+static int touch_stack(int depth) {
+    volatile char buf[256];
+    buf[0] = static_cast<char>(depth);
+    return depth ? touch_stack(depth - 1) + buf[0] : 0;
+}
+
+static void worker() {
+    Fiber* self = Fiber::GetThis().get();
+    while (true) {
+        touch_stack(4);
+        self->yield();
+    }
+}
+
+static void bench(bool shared_stack) {
+    std::vector<Fiber::ptr> fibers;
+    fibers.reserve(kFibers);
+
+    size_t rss_before = rss_bytes();
+    for (int i = 0; i < kFibers; i++) {
+        fibers.push_back(Fiber::ptr(new Fiber(worker, 0, false, shared_stack)));
+        fibers.back()->resume();
+    }
+    size_t rss_after = rss_bytes();
+
+    // 轮流切换所有挂起的协程，共享栈模式下每次切换都要拷贝
+    auto begin = std::chrono::steady_clock::now();
+    for (int r = 0; r < kRounds; r++) {
+        for (auto& fiber : fibers) {
+            fiber->resume();
+        }
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    size_t saved = 0;
+    for (auto& fiber : fibers) {
+        saved += fiber->getSavedStackSize();
+    }
+
+    double ns = std::chrono::duration<double, std::nano>(end - begin).count() / (kRounds * kFibers * 2.0);
+    std::cerr << (shared_stack ? "shared stack:  " : "private stack: ")
+              << "rss " << (rss_after - rss_before) / kFibers << " B/fiber, "
+              << "saved stack " << saved / kFibers << " B/fiber, "
+              << ns << " ns/switch" << std::endl;
+}
+
+int main() {
+    Fiber::GetThis();
+    std::cerr << "fibers: " << kFibers << ", rounds: " << kRounds << std::endl;
+    bench(false);
+    bench(true);
+    return 0;
+}
@@ -0,0 +1,52 @@
+// 停止延迟基准：空闲时stop()、带积压时stop(Abort)、任务执行很久时stop(Drain(限时))各自用的时间，以及丢弃的任务数
+// g++ -std=c++17 -O2 bench_stop.cpp context.cpp stack_allocator.cpp coroutine.cpp fiber_pool.cpp numa_topology.cpp log.cpp metrics.cpp scheduler.cpp fiber_thread.cpp fiber_sync.cpp future.cpp -pthread -o bench_stop
+// 调度器日志打印在标准输出，结果打印在标准错误：./bench_stop > /dev/null
+
+#include <chrono>
+#include <iostream>
+#include <thread>
+
+#include "scheduler.h"
+
+static const int kThreads = 8;
+static const int kBacklog = 100000;
+
+static void report(const char* name, const Scheduler::StopReport& r) {
+    std::cerr << name << ": " << r.elapsedMs << " ms, aborted " << r.aborted << ", dropped callbacks "
+              << r.droppedCallbacks << ", dropped fibers " << r.droppedFibers << std::endl;
+}
+
+int main() {
+    // 所有线程都在停车
+    {
+        Scheduler scheduler(kThreads, false, "bench");
+        scheduler.start();
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        report("idle, Drain()", scheduler.stop(Scheduler::Drain()));
+    }
+
+    // 大量任务还在排队
+    {
+        Scheduler scheduler(kThreads, false, "bench");
+        scheduler.start();
+        for (int i = 0; i < kBacklog; i++) {
+            scheduler.scheduleLock([]() {
+                std::this_thread::sleep_for(std::chrono::microseconds(10));
+            });
+        }
+        report("backlog, Abort", scheduler.stop(Scheduler::Abort()));
+    }
+
+    // 积压的任务一共要执行几秒，限时100毫秒
+    {
+        Scheduler scheduler(kThreads, false, "bench");
+        scheduler.start();
+        for (int i = 0; i < kBacklog; i++) {
+            scheduler.scheduleLock([]() {
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+            });
+        }
+        report("backlog, Drain(100ms)", scheduler.stop(Scheduler::Drain(100)));
+    }
+    return 0;
+}
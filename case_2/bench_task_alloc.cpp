@@ -0,0 +1,122 @@
+// 任务分配基准：统计每个函数任务从发布到执行完的堆分配次数，以及每次发布的耗时
+// g++ -std=c++17 -O2 bench_task_alloc.cpp context.cpp stack_allocator.cpp coroutine.cpp fiber_pool.cpp numa_topology.cpp log.cpp metrics.cpp scheduler.cpp fiber_thread.cpp fiber_sync.cpp future.cpp -pthread -o bench_task_alloc
+// 调度器日志打印在标准输出，结果打印在标准错误：./bench_task_alloc > /dev/null
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <thread>
+
+#include "scheduler.h"
+
+static const int kTasks = 100000;
+// 每批发布的任务数
+static const int kWave = 1000;
+
+// 统计全局operator new的调用次数
+static std::atomic<uint64_t> s_allocs{0};
+
+void* operator new(size_t size) {
+    s_allocs.fetch_add(1, std::memory_order_relaxed);
+    void* p = malloc(size ? size : 1);
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void* p) noexcept {
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+
+static double now_ns() {
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// 捕获48字节：std::function需要在堆上保存，UniqueFunction可以放在内部缓冲区
+struct Payload {
+    uint64_t v[5];
+    std::atomic<int>* done;
+};
+
+// 分批发布kTasks个任务，每批执行完再发布下一批，返回每次发布的耗时
+    // 同时在途的任务节点不超过任务节点缓存的容量时，发布和执行都不需要分配内存
+static double post_all(Scheduler& scheduler, std::atomic<int>& done) {
+    done = 0;
+    Payload payload = {{1, 2, 3, 4, 5}, &done};
+
+    double elapsed = 0;
+    for (int posted = 0; posted < kTasks; posted += kWave) {
+        double begin = now_ns();
+        for (int i = 0; i < kWave; i++) {
+            scheduler.scheduleLock([payload]() {
+                payload.done->fetch_add(1, std::memory_order_relaxed);
+            });
+        }
+        elapsed += now_ns() - begin;
+
+        while (done.load() < posted + kWave) {
+            std::this_thread::yield();
+        }
+    }
+    return elapsed / kTasks;
+}
+
+static void report(const char* name, Scheduler& scheduler, std::atomic<int>& done) {
+    // 先跑一轮，让任务节点缓存、队列和调度线程的协程都准备好
+    post_all(scheduler, done);
+
+    uint64_t before = s_allocs.load();
+    double ns = post_all(scheduler, done);
+    uint64_t allocs = s_allocs.load() - before;
+
+    std::cerr << name << ": " << ns << " ns/post, "
+              << (double)allocs / kTasks << " allocs/task" << std::endl;
+}
+
+int main() {
+    std::atomic<int> done{0};
+
+    {
+        // 外部线程发布，任务进入全局注入队列
+        Scheduler scheduler(2, false, "external");
+        scheduler.start();
+        report("external thread", scheduler, done);
+        scheduler.stop();
+    }
+
+    {
+        // 工作线程的协程中发布，任务进入本线程的deque
+        Scheduler scheduler(2, false, "worker");
+        scheduler.start();
+        std::atomic<bool> finished{false};
+        scheduler.scheduleLock([&]() {
+            report("worker fiber", scheduler, done);
+            finished = true;
+        });
+        while (!finished) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        scheduler.stop();
+    }
+
+    // 对比：同样的捕获放进std::function
+    {
+        Payload payload = {{1, 2, 3, 4, 5}, &done};
+        uint64_t before = s_allocs.load();
+        for (int i = 0; i < kTasks; i++) {
+            std::function<void()> f([payload]() {
+                payload.done->fetch_add(1, std::memory_order_relaxed);
+            });
+            f();
+        }
+        std::cerr << "std::function baseline: " << (double)(s_allocs.load() - before) / kTasks
+                  << " allocs/task" << std::endl;
+    }
+    return 0;
+}
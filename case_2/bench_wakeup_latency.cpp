@@ -0,0 +1,59 @@
+// 唤醒延迟基准：在不同的发布速率下，测量任务从发布到开始执行的时间，输出p50/p99
+// g++ -std=c++17 -O2 bench_wakeup_latency.cpp context.cpp stack_allocator.cpp coroutine.cpp fiber_pool.cpp numa_topology.cpp log.cpp metrics.cpp scheduler.cpp fiber_thread.cpp fiber_sync.cpp future.cpp -pthread -o bench_wakeup_latency
+// 调度器日志打印在标准输出，结果打印在标准错误：./bench_wakeup_latency > /dev/null
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "scheduler.h"
+
+static const int kTasks = 2000;
+
+static uint64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// interval_us：相邻两次发布的间隔，0表示连续发布
+static void bench(Scheduler& scheduler, int interval_us) {
+    std::vector<uint64_t> latency(kTasks, 0);
+    std::atomic<int> done{0};
+
+    for (int i = 0; i < kTasks; i++) {
+        uint64_t posted = now_ns();
+        scheduler.scheduleLock([&latency, &done, i, posted]() {
+            latency[i] = now_ns() - posted;
+            done++;
+        });
+        if (interval_us) {
+            std::this_thread::sleep_for(std::chrono::microseconds(interval_us));
+        }
+    }
+
+    while (done.load() < kTasks) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    std::sort(latency.begin(), latency.end());
+    std::cerr << "interval " << interval_us << " us: "
+              << "p50 " << latency[kTasks / 2] / 1000.0 << " us, "
+              << "p99 " << latency[kTasks * 99 / 100] / 1000.0 << " us, "
+              << "max " << latency.back() / 1000.0 << " us" << std::endl;
+}
+
+int main() {
+    // 主线程只发布任务，不参与调度
+    Scheduler scheduler(4, false, "bench");
+    scheduler.start();
+
+    // 从几乎一直空闲到连续发布
+    for (int interval_us : {1000, 100, 10, 0}) {
+        bench(scheduler, interval_us);
+    }
+
+    scheduler.stop();
+    return 0;
+}
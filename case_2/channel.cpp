@@ -0,0 +1,363 @@
+#include <algorithm>
+#include <vector>
+
+#include "channel.h"
+
+void ChannelWaiterList::push(ChannelWaiter* waiter) {
+    waiter->prev = m_tail;
+    waiter->next = nullptr;
+    if (m_tail) {
+        m_tail->next = waiter;
+    } else {
+        m_head = waiter;
+    }
+    m_tail = waiter;
+    waiter->linked = true;
+    m_size.store(m_size.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+ChannelWaiter* ChannelWaiterList::pop() {
+    ChannelWaiter* waiter = m_head;
+    if (waiter) {
+        remove(waiter);
+    }
+    return waiter;
+}
+
+void ChannelWaiterList::remove(ChannelWaiter* waiter) {
+    if (waiter->prev) {
+        waiter->prev->next = waiter->next;
+    } else {
+        m_head = waiter->next;
+    }
+    if (waiter->next) {
+        waiter->next->prev = waiter->prev;
+    } else {
+        m_tail = waiter->prev;
+    }
+    waiter->prev = waiter->next = nullptr;
+    waiter->linked = false;
+    m_size.store(m_size.load(std::memory_order_relaxed) - 1, std::memory_order_release);
+}
+
+ChannelWaiter* ChannelBase::Claim(ChannelWaiterList& list) {
+    while (ChannelWaiter* waiter = list.pop()) {
+        if (waiter->selected == nullptr) {
+            return waiter;
+        }
+        int expected = -1;
+        if (waiter->selected->compare_exchange_strong(expected, waiter->index, std::memory_order_acq_rel)) {
+            return waiter;
+        }
+        // 这个Select已经在其他通道上完成，分支由它自己清理，这里只是摘下
+    }
+    return nullptr;
+}
+
+bool ChannelBase::sendWouldBlock() const {
+    return !closed() && m_size.load(std::memory_order_acquire) >= m_capacity && m_recvq.size() == 0;
+}
+
+bool ChannelBase::recvWouldBlock() const {
+    // 先看是否为空再看是否关闭：关闭之前为空、关闭之后又被读到，两次观察之间通道确实处于空且未关闭的状态
+    if (m_size.load(std::memory_order_acquire) > 0 || m_sendq.size() > 0) {
+        return false;
+    }
+    return !closed();
+}
+
+int ChannelBase::sendLocked(void* value, ChannelWaiter** wake) {
+    if (m_closed.load(std::memory_order_relaxed)) {
+        return OP_CLOSED;
+    }
+
+    // 1. 有接收方在等，直接交给它
+    if (ChannelWaiter* receiver = Claim(m_recvq)) {
+        transfer(receiver->data, value);
+        receiver->ok = true;
+        *wake = receiver;
+        return OP_DONE;
+    }
+
+    // 2. 放进缓冲区
+    size_t size = m_size.load(std::memory_order_relaxed);
+    if (size < m_capacity) {
+        bufferPush(value);
+        m_size.store(size + 1, std::memory_order_release);
+        return OP_DONE;
+    }
+    return OP_BLOCKED;
+}
+
+int ChannelBase::recvLocked(void* out, ChannelWaiter** wake) {
+    size_t size = m_size.load(std::memory_order_relaxed);
+
+    // 1. 有发送方在等：无缓冲时直接从它手里取；有缓冲时缓冲区一定是满的，取队首，发送方的元素补到队尾
+    if (ChannelWaiter* sender = Claim(m_sendq)) {
+        if (size > 0) {
+            bufferPop(out);
+            bufferPush(sender->data);
+        } else {
+            transfer(out, sender->data);
+        }
+        sender->ok = true;
+        *wake = sender;
+        return OP_DONE;
+    }
+
+    // 2. 从缓冲区取，关闭以后也要先取完
+    if (size > 0) {
+        bufferPop(out);
+        m_size.store(size - 1, std::memory_order_release);
+        return OP_DONE;
+    }
+
+    if (m_closed.load(std::memory_order_relaxed)) {
+        return OP_CLOSED;
+    }
+    return OP_BLOCKED;
+}
+
+bool ChannelBase::sendImpl(void* value, bool block) {
+    if (!block && sendWouldBlock()) {
+        return false;
+    }
+
+    FiberWaiter waiter;
+    ChannelWaiter entry;
+    ChannelWaiter* wake = nullptr;
+
+    m_lock.lock();
+    int rt = sendLocked(value, &wake);
+    if (rt != OP_BLOCKED || !block) {
+        m_lock.unlock();
+        if (wake) {
+            FiberWaitQueue::Wake(wake->waiter);
+        }
+        return rt == OP_DONE;
+    }
+
+    FiberWaitQueue::Prepare(&waiter);
+    entry.waiter = &waiter;
+    entry.data = value;
+    m_sendq.push(&entry);
+    m_lock.unlock();
+
+    // 唤醒时元素已经被接收方取走，或者通道被关闭
+    FiberWaitQueue::Wait(&waiter);
+    return entry.ok;
+}
+
+bool ChannelBase::recvImpl(void* out, bool block, bool* completed) {
+    *completed = false;
+    if (!block && recvWouldBlock()) {
+        return false;
+    }
+
+    FiberWaiter waiter;
+    ChannelWaiter entry;
+    ChannelWaiter* wake = nullptr;
+
+    m_lock.lock();
+    int rt = recvLocked(out, &wake);
+    if (rt != OP_BLOCKED || !block) {
+        m_lock.unlock();
+        if (wake) {
+            FiberWaitQueue::Wake(wake->waiter);
+        }
+        *completed = rt != OP_BLOCKED;
+        return rt == OP_DONE;
+    }
+
+    FiberWaitQueue::Prepare(&waiter);
+    entry.waiter = &waiter;
+    entry.data = out;
+    m_recvq.push(&entry);
+    m_lock.unlock();
+
+    // 唤醒时元素已经由发送方写入out，或者通道被关闭
+    FiberWaitQueue::Wait(&waiter);
+    *completed = true;
+    return entry.ok;
+}
+
+bool ChannelBase::sendOrEnqueue(void* value, ChannelWaiter* entry) {
+    ChannelWaiter* wake = nullptr;
+
+    m_lock.lock();
+    int rt = sendLocked(value, &wake);
+    if (rt != OP_BLOCKED) {
+        m_lock.unlock();
+        if (wake) {
+            FiberWaitQueue::Wake(wake->waiter);
+        }
+        entry->ok = rt == OP_DONE;
+        return true;
+    }
+
+    entry->data = value;
+    m_sendq.push(entry);
+    m_lock.unlock();
+    return false;
+}
+
+bool ChannelBase::recvOrEnqueue(void* out, ChannelWaiter* entry) {
+    ChannelWaiter* wake = nullptr;
+
+    m_lock.lock();
+    int rt = recvLocked(out, &wake);
+    if (rt != OP_BLOCKED) {
+        m_lock.unlock();
+        if (wake) {
+            FiberWaitQueue::Wake(wake->waiter);
+        }
+        entry->ok = rt == OP_DONE;
+        return true;
+    }
+
+    entry->data = out;
+    m_recvq.push(entry);
+    m_lock.unlock();
+    return false;
+}
+
+void ChannelBase::close() {
+    // 摘下的等待者借用FiberWaitQueue串起来，释放锁以后再唤醒
+    FiberWaitQueue woken;
+
+    m_lock.lock();
+    if (m_closed.load(std::memory_order_relaxed)) {
+        m_lock.unlock();
+        return;
+    }
+    m_closed.store(true, std::memory_order_release);
+    while (ChannelWaiter* receiver = Claim(m_recvq)) {
+        receiver->ok = false;
+        woken.push(receiver->waiter);
+    }
+    while (ChannelWaiter* sender = Claim(m_sendq)) {
+        sender->ok = false;
+        woken.push(sender->waiter);
+    }
+    m_lock.unlock();
+
+    while (FiberWaiter* waiter = woken.pop()) {
+        FiberWaitQueue::Wake(waiter);
+    }
+}
+
+void ChannelBase::LockAll(const std::vector<ChannelBase*>& order) {
+    for (ChannelBase* channel : order) {
+        channel->m_lock.lock();
+    }
+}
+
+void ChannelBase::UnlockAll(const std::vector<ChannelBase*>& order) {
+    for (auto it = order.rbegin(); it != order.rend(); ++it) {
+        (*it)->m_lock.unlock();
+    }
+}
+
+// 分支的轮询起点，避免总是偏向靠前的分支
+static size_t select_start(size_t n) {
+    static thread_local uint32_t t_seed = 2463534242u;
+    t_seed ^= t_seed << 13;
+    t_seed ^= t_seed >> 17;
+    t_seed ^= t_seed << 5;
+    return t_seed % n;
+}
+
+int ChannelBase::Select(ChannelCase* cases, size_t n, bool block) {
+    // 1. 非阻塞时先不加锁看一遍，所有分支都无法完成就直接返回
+    if (!block) {
+        bool maybe_ready = false;
+        for (size_t i = 0; i < n && !maybe_ready; i++) {
+            ChannelBase* channel = cases[i].channel;
+            if (channel) {
+                maybe_ready = cases[i].send ? !channel->sendWouldBlock() : !channel->recvWouldBlock();
+            }
+        }
+        if (!maybe_ready) {
+            return -1;
+        }
+    }
+
+    std::vector<ChannelBase*> order;
+    order.reserve(n);
+    for (size_t i = 0; i < n; i++) {
+        if (cases[i].channel) {
+            order.push_back(cases[i].channel);
+        }
+    }
+    // 按地址排序去重，所有Select按同一顺序加锁，避免死锁
+    std::sort(order.begin(), order.end());
+    order.erase(std::unique(order.begin(), order.end()), order.end());
+
+    // 2. 持有所有通道的锁，从随机位置开始依次尝试
+    size_t start = n > 0 ? select_start(n) : 0;
+    LockAll(order);
+    for (size_t k = 0; k < n; k++) {
+        size_t i = (start + k) % n;
+        ChannelCase& c = cases[i];
+        if (c.channel == nullptr) {
+            continue;
+        }
+
+        ChannelWaiter* wake = nullptr;
+        int rt = c.send ? c.channel->sendLocked(c.data, &wake) : c.channel->recvLocked(c.data, &wake);
+        if (rt != OP_BLOCKED) {
+            UnlockAll(order);
+            if (wake) {
+                FiberWaitQueue::Wake(wake->waiter);
+            }
+            c.ok = rt == OP_DONE;
+            return static_cast<int>(i);
+        }
+    }
+
+    if (!block) {
+        UnlockAll(order);
+        return -1;
+    }
+
+    // 3. 在所有通道上登记，第一个CAS成功的对端完成交接并唤醒本协程
+    FiberWaiter waiter;
+    FiberWaitQueue::Prepare(&waiter);
+    std::atomic<int> selected{-1};
+    std::vector<ChannelWaiter> entries(n);
+    for (size_t i = 0; i < n; i++) {
+        if (cases[i].channel == nullptr) {
+            continue;
+        }
+        ChannelWaiter& entry = entries[i];
+        entry.waiter = &waiter;
+        entry.selected = &selected;
+        entry.index = static_cast<int>(i);
+        entry.data = cases[i].data;
+        if (cases[i].send) {
+            cases[i].channel->m_sendq.push(&entry);
+        } else {
+            cases[i].channel->m_recvq.push(&entry);
+        }
+    }
+    UnlockAll(order);
+
+    FiberWaitQueue::Wait(&waiter);
+
+    // 4. 从其余通道上摘掉没有被选中的分支；之后不会再有对端访问entries
+    LockAll(order);
+    for (size_t i = 0; i < n; i++) {
+        if (entries[i].linked) {
+            if (cases[i].send) {
+                cases[i].channel->m_sendq.remove(&entries[i]);
+            } else {
+                cases[i].channel->m_recvq.remove(&entries[i]);
+            }
+        }
+    }
+    UnlockAll(order);
+
+    int index = selected.load(std::memory_order_acquire);
+    cases[index].ok = entries[index].ok;
+    return index;
+}
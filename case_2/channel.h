@@ -0,0 +1,203 @@
+#ifndef _CHANNEL_H_
+#define _CHANNEL_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "fiber_sync.h"
+
+class ChannelBase;
+
+// 通道
+    // Channel<T>(0)为无缓冲通道，发送方和接收方直接交接；Channel<T>(n)缓冲n个元素；Channel<T>(kUnbounded)发送永不阻塞
+    // send/recv需要等待时挂起当前协程（等待方式同fiber_sync.h），由对端在交接完成以后通过scheduleLock唤醒
+    // 关闭以后发送失败，接收方取完缓冲区中剩余的元素后收到false
+    // 每个通道一把自旋锁保护缓冲区和两条等待队列；trySend/tryRecv以及非阻塞的Select在明显无法完成时不加锁直接返回
+    // 协议部分和元素类型无关，放在ChannelBase中实现，Channel<T>只负责搬运元素
+
+// Select的一个分支，由Channel<T>::sendCase()/recvCase()构造
+struct ChannelCase {
+    // 为空的分支永远不会被选中
+    ChannelBase* channel = nullptr;
+    bool send = false;
+    // 发送时为待发送的元素，选中时被移走；接收时为接收的位置
+    void* data = nullptr;
+    // 被选中以后填写，含义同send()/recv()的返回值
+    bool ok = false;
+};
+
+// 通道上排队的一次发送/接收，放在等待方的栈上
+struct ChannelWaiter {
+    FiberWaiter* waiter = nullptr;
+    // Select的所有分支共享，记录被选中的分支，先CAS成功的一方完成交接；普通send/recv为空
+    std::atomic<int>* selected = nullptr;
+    int index = 0;
+    void* data = nullptr;
+    // 交接成功为true，通道关闭为false
+    bool ok = false;
+
+    bool linked = false;
+    ChannelWaiter* prev = nullptr;
+    ChannelWaiter* next = nullptr;
+};
+
+// 双向链表，Select返回时要从没有被选中的通道上摘掉自己的分支
+class ChannelWaiterList {
+public:
+    bool empty() const {return m_head == nullptr;}
+    // 不加锁读取，只用于快速判断
+    uint32_t size() const {return m_size.load(std::memory_order_acquire);}
+
+    void push(ChannelWaiter* waiter);
+    ChannelWaiter* pop();
+    void remove(ChannelWaiter* waiter);
+
+private:
+    ChannelWaiter* m_head = nullptr;
+    ChannelWaiter* m_tail = nullptr;
+    std::atomic<uint32_t> m_size{0};
+};
+
+class ChannelBase {
+public:
+    static const size_t kUnbounded = SIZE_MAX;
+
+    explicit ChannelBase(size_t capacity): m_capacity(capacity) {}
+    virtual ~ChannelBase() {}
+    ChannelBase(const ChannelBase&) = delete;
+    ChannelBase& operator=(const ChannelBase&) = delete;
+
+    // 关闭通道，唤醒所有等待者；重复关闭无效果
+    void close();
+
+    bool closed() const {return m_closed.load(std::memory_order_acquire);}
+    size_t capacity() const {return m_capacity;}
+    // 缓冲区中的元素数
+    size_t size() const {return m_size.load(std::memory_order_relaxed);}
+
+    // 同时等待多个发送/接收，完成其中一个并返回它的下标，结果写在cases[i].ok中
+        // 有多个分支可以完成时随机选择一个；block为false并且没有分支可以完成时返回-1
+        // 所有分支都为空并且block为true时会永远挂起，和Go的空select一致
+    static int Select(ChannelCase* cases, size_t n, bool block = true);
+
+    // 供co_task.h中的等待器使用，entry->waiter由调用者设置好
+        // 能立即完成（或通道已关闭）时返回true，结果在entry->ok中；否则把entry挂进等待队列返回false，
+        // 完成后唤醒entry->waiter，返回false以后调用者不能再访问entry
+    bool sendOrEnqueue(void* value, ChannelWaiter* entry);
+    bool recvOrEnqueue(void* out, ChannelWaiter* entry);
+
+protected:
+    bool sendImpl(void* value, bool block);
+    bool recvImpl(void* out, bool block, bool* completed);
+
+    // 由Channel<T>实现的元素搬运，调用时持有m_lock
+    virtual void bufferPush(void* src) = 0;
+    virtual void bufferPop(void* dst) = 0;
+    virtual void transfer(void* dst, void* src) = 0;
+
+private:
+    enum OpResult {
+        OP_BLOCKED = 0,
+        OP_DONE,
+        OP_CLOSED
+    };
+
+    // 在锁内尝试完成一次发送/接收，需要唤醒的对端通过wake返回，释放锁以后再唤醒
+    int sendLocked(void* value, ChannelWaiter** wake);
+    int recvLocked(void* out, ChannelWaiter** wake);
+
+    // 不加锁判断操作一定无法立即完成，用于非阻塞操作的快速路径
+    bool sendWouldBlock() const;
+    bool recvWouldBlock() const;
+
+    // 从队列中取出第一个可以交接的等待者，已经被其他分支选中的Select分支直接丢弃
+    static ChannelWaiter* Claim(ChannelWaiterList& list);
+
+    // order已经按地址排序去重
+    static void LockAll(const std::vector<ChannelBase*>& order);
+    static void UnlockAll(const std::vector<ChannelBase*>& order);
+
+private:
+    const size_t m_capacity;
+    std::atomic<size_t> m_size{0};
+    std::atomic<bool> m_closed{false};
+
+    FiberSpinLock m_lock;
+    ChannelWaiterList m_sendq;
+    ChannelWaiterList m_recvq;
+};
+
+template<typename T>
+class Channel : public ChannelBase {
+public:
+    typedef std::shared_ptr<Channel> ptr;
+
+    explicit Channel(size_t capacity = 0): ChannelBase(capacity) {}
+
+    // 发送，没有接收方也没有缓冲空间时挂起；通道已关闭（或等待期间被关闭）返回false
+    bool send(T value) {
+        return sendImpl(&value, true);
+    }
+
+    // 不等待的发送，成功时value被移走
+    bool trySend(T& value) {
+        return sendImpl(&value, false);
+    }
+
+    // 接收，通道为空时挂起；通道已关闭并且缓冲区已取完返回false
+    bool recv(T& out) {
+        bool completed;
+        return recvImpl(&out, true, &completed);
+    }
+
+    // 不等待的接收，收到元素返回true；closed非空时告知失败是否因为通道已关闭
+    bool tryRecv(T& out, bool* closed = nullptr) {
+        bool completed;
+        bool ok = recvImpl(&out, false, &completed);
+        if (closed) {
+            *closed = completed && !ok;
+        }
+        return ok;
+    }
+
+    // 构造Select分支，value/out在Select返回之前必须有效
+    ChannelCase sendCase(T& value) {
+        ChannelCase c;
+        c.channel = this;
+        c.send = true;
+        c.data = &value;
+        return c;
+    }
+
+    ChannelCase recvCase(T& out) {
+        ChannelCase c;
+        c.channel = this;
+        c.send = false;
+        c.data = &out;
+        return c;
+    }
+
+protected:
+    void bufferPush(void* src) override {
+        m_buffer.push_back(std::move(*static_cast<T*>(src)));
+    }
+
+    void bufferPop(void* dst) override {
+        *static_cast<T*>(dst) = std::move(m_buffer.front());
+        m_buffer.pop_front();
+    }
+
+    void transfer(void* dst, void* src) override {
+        *static_cast<T*>(dst) = std::move(*static_cast<T*>(src));
+    }
+
+private:
+    std::deque<T> m_buffer;
+};
+
+#endif
@@ -0,0 +1,392 @@
+#ifndef _CO_TASK_H_
+#define _CO_TASK_H_
+
+#if !defined(__cpp_impl_coroutine)
+#error "co_task.h需要C++20协程支持，请使用-std=c++20编译"
+#endif
+
+#include <cassert>
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+#include "scheduler.h"
+#include "iomanager.h"
+#include "channel.h"
+#include "future.h"
+
+// 无栈协程（C++20 co_await）前端
+    // Task<T>是惰性的：创建时不运行，被co_await或者task_spawn()投递到调度器以后才开始
+    // 协程帧只保存跨越挂起点的局部变量，通常只有几百字节；有栈协程（Fiber）每个都要一整个栈
+    // 挂起时不占用任何栈：恢复函数通过scheduleLock投递到调度器，和普通函数任务一样在工作线程的任务协程上运行，
+        // 运行到下一个挂起点就返回，任务协程随即复用给下一个任务
+    // co_await另一个Task时直接对称转移，不经过调度器
+    // 两种协程互通：有栈协程通过task_spawn()返回的Future::get()等待Task（只挂起当前Fiber）；
+        // Task通过co_await scheduler.submit(f)等待在有栈协程中运行的f
+    // 协程体中不要调用会挂起当前Fiber的接口（FiberMutex::lock、Future::get()、被hook的阻塞系统调用等），
+        // 那样会挂起整个任务协程而不是Task本身，应当使用下面的等待器
+
+template<typename T>
+class Task;
+
+// promise中和结果类型无关的部分
+struct TaskPromiseBase {
+    // 等待本Task的协程，结束时转移过去；为空时是task_spawn()的根协程
+    std::coroutine_handle<> continuation;
+    std::exception_ptr exception;
+
+    std::suspend_always initial_suspend() noexcept {return {};}
+
+    struct FinalAwaiter {
+        bool await_ready() noexcept {return false;}
+
+        template<typename P>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<P> h) noexcept {
+            std::coroutine_handle<> next = h.promise().continuation;
+            return next ? next : std::noop_coroutine();
+        }
+
+        void await_resume() noexcept {}
+    };
+
+    FinalAwaiter final_suspend() noexcept {return {};}
+
+    void unhandled_exception() {
+        exception = std::current_exception();
+    }
+
+    void rethrow() {
+        if (exception) {
+            std::rethrow_exception(exception);
+        }
+    }
+};
+
+template<typename T>
+struct TaskPromise : public TaskPromiseBase {
+    std::optional<T> value;
+
+    Task<T> get_return_object();
+
+    template<typename U>
+    void return_value(U&& v) {
+        value.emplace(std::forward<U>(v));
+    }
+
+    T result() {
+        rethrow();
+        return std::move(*value);
+    }
+};
+
+template<>
+struct TaskPromise<void> : public TaskPromiseBase {
+    Task<void> get_return_object();
+
+    void return_void() {}
+
+    void result() {
+        rethrow();
+    }
+};
+
+template<typename T = void>
+class Task {
+public:
+    typedef TaskPromise<T> promise_type;
+    typedef std::coroutine_handle<promise_type> handle_type;
+
+    Task() {}
+    explicit Task(handle_type handle): m_handle(handle) {}
+    Task(Task&& other) noexcept: m_handle(std::exchange(other.m_handle, nullptr)) {}
+    Task& operator=(Task&& other) noexcept {
+        if (this != &other) {
+            if (m_handle) {
+                m_handle.destroy();
+            }
+            m_handle = std::exchange(other.m_handle, nullptr);
+        }
+        return *this;
+    }
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+
+    ~Task() {
+        if (m_handle) {
+            m_handle.destroy();
+        }
+    }
+
+    bool valid() const {return static_cast<bool>(m_handle);}
+
+    struct Awaiter {
+        handle_type handle;
+
+        bool await_ready() noexcept {return false;}
+
+        // 记下调用者，直接转移到被等待的Task
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<> caller) noexcept {
+            handle.promise().continuation = caller;
+            return handle;
+        }
+
+        T await_resume() {
+            return handle.promise().result();
+        }
+    };
+
+    // 只能等待一次
+    Awaiter operator co_await() & {
+        assert(m_handle && !m_handle.done());
+        return Awaiter{m_handle};
+    }
+
+    Awaiter operator co_await() && {
+        assert(m_handle && !m_handle.done());
+        return Awaiter{m_handle};
+    }
+
+private:
+    handle_type m_handle;
+};
+
+template<typename T>
+Task<T> TaskPromise<T>::get_return_object() {
+    return Task<T>(Task<T>::handle_type::from_promise(*this));
+}
+
+inline Task<void> TaskPromise<void>::get_return_object() {
+    return Task<void>(Task<void>::handle_type::from_promise(*this));
+}
+
+// task_spawn()的根协程：投递到调度器以后开始运行，结束时自己销毁协程帧
+struct TaskRoot {
+    struct promise_type {
+        TaskRoot get_return_object() {
+            return TaskRoot{std::coroutine_handle<promise_type>::from_promise(*this)};
+        }
+        std::suspend_always initial_suspend() noexcept {return {};}
+        std::suspend_never final_suspend() noexcept {return {};}
+        void return_void() {}
+        // 根协程自己捕获了所有异常
+        void unhandled_exception() {std::terminate();}
+    };
+
+    std::coroutine_handle<promise_type> handle;
+};
+
+// 投递到调度器的启动函数；任务没有运行就被丢弃时销毁根协程，等待者收到broken_promise
+class TaskStarter {
+public:
+    explicit TaskStarter(std::coroutine_handle<> handle): m_handle(handle) {}
+    TaskStarter(TaskStarter&& other) noexcept: m_handle(std::exchange(other.m_handle, nullptr)) {}
+    TaskStarter(const TaskStarter&) = delete;
+
+    ~TaskStarter() {
+        if (m_handle) {
+            m_handle.destroy();
+        }
+    }
+
+    void operator()() {
+        std::exchange(m_handle, nullptr).resume();
+    }
+
+private:
+    std::coroutine_handle<> m_handle;
+};
+
+template<typename T>
+TaskRoot task_run_root(Promise<T> promise, Task<T> task) {
+    try {
+        if constexpr (std::is_void<T>::value) {
+            co_await std::move(task);
+            promise.setValue();
+        } else {
+            promise.setValue(co_await std::move(task));
+        }
+    } catch (...) {
+        promise.setException(std::current_exception());
+    }
+}
+
+// 把Task投递到调度器运行，返回它的结果
+template<typename T>
+Future<T> task_spawn(Scheduler& scheduler, Task<T> task, int thread_id = -1) {
+    Promise<T> promise;
+    Future<T> future = promise.getFuture();
+    TaskRoot root = task_run_root(std::move(promise), std::move(task));
+    scheduler.scheduleLock(TaskStarter(root.handle), thread_id);
+    return future;
+}
+
+// 把恢复函数投递到调度器
+inline void task_resume_on(Scheduler* scheduler, std::coroutine_handle<> handle) {
+    assert(scheduler != nullptr);
+    scheduler->scheduleLock([handle]() {handle.resume();});
+}
+
+// co_await task_yield()：让出工作线程，重新排队
+struct YieldAwaiter {
+    bool await_ready() noexcept {return false;}
+
+    void await_suspend(std::coroutine_handle<> handle) {
+        task_resume_on(Scheduler::GetThis(), handle);
+    }
+
+    void await_resume() noexcept {}
+};
+
+inline YieldAwaiter task_yield() {
+    return YieldAwaiter();
+}
+
+// co_await task_sleep(ms)：需要在IOManager上运行
+struct SleepAwaiter {
+    uint64_t ms;
+
+    bool await_ready() noexcept {return false;}
+
+    void await_suspend(std::coroutine_handle<> handle) {
+        IOManager* iom = IOManager::GetThis();
+        assert(iom != nullptr);
+        // 到期的定时器回调本身就作为函数任务投递到调度器
+        iom->addTimer(ms, [handle]() {
+            handle.resume();
+        });
+    }
+
+    void await_resume() noexcept {}
+};
+
+inline SleepAwaiter task_sleep(uint64_t ms) {
+    return SleepAwaiter{ms};
+}
+
+// co_await task_wait_fd(fd, event)：等待fd可读/可写，注册失败时不挂起并返回false；需要在IOManager上运行
+    // 和被hook的read/write不同，这里不改动fd的阻塞属性，调用者自己把fd设置为非阻塞
+struct FdAwaiter {
+    int fd;
+    IOManager::Event event;
+    bool ok = true;
+
+    bool await_ready() noexcept {return false;}
+
+    bool await_suspend(std::coroutine_handle<> handle) {
+        IOManager* iom = IOManager::GetThis();
+        assert(iom != nullptr);
+        // 事件触发时回调被投递到调度器运行；注册成功以后事件随时可能触发，不能再访问本对象
+        if (iom->addEvent(fd, event, [handle]() {handle.resume();}) != 0) {
+            ok = false;
+            return false;
+        }
+        return true;
+    }
+
+    bool await_resume() noexcept {return ok;}
+};
+
+inline FdAwaiter task_wait_fd(int fd, IOManager::Event event) {
+    return FdAwaiter{fd, event};
+}
+
+// 通道等待器的公共部分：对端完成交接以后，把恢复函数投递到当前调度器
+class ChannelAwaiterBase {
+public:
+    bool await_ready() noexcept {return false;}
+
+    bool await_resume() noexcept {return m_entry.ok;}
+
+protected:
+    void prepare(std::coroutine_handle<> handle) {
+        m_waiter.scheduler = Scheduler::GetThis();
+        assert(m_waiter.scheduler != nullptr);
+        m_waiter.callback = [handle]() {handle.resume();};
+        m_entry.waiter = &m_waiter;
+    }
+
+protected:
+    FiberWaiter m_waiter;
+    ChannelWaiter m_entry;
+};
+
+// co_await task_recv(channel, out)：含义同Channel::recv()
+template<typename T>
+class ChannelRecvAwaiter : public ChannelAwaiterBase {
+public:
+    ChannelRecvAwaiter(Channel<T>& channel, T& out): m_channel(channel), m_out(out) {}
+
+    // 立即完成时不挂起
+    bool await_suspend(std::coroutine_handle<> handle) {
+        prepare(handle);
+        return !m_channel.recvOrEnqueue(&m_out, &m_entry);
+    }
+
+private:
+    Channel<T>& m_channel;
+    T& m_out;
+};
+
+// co_await task_send(channel, value)：含义同Channel::send()
+template<typename T>
+class ChannelSendAwaiter : public ChannelAwaiterBase {
+public:
+    ChannelSendAwaiter(Channel<T>& channel, T value): m_channel(channel), m_value(std::move(value)) {}
+
+    bool await_suspend(std::coroutine_handle<> handle) {
+        prepare(handle);
+        return !m_channel.sendOrEnqueue(&m_value, &m_entry);
+    }
+
+private:
+    Channel<T>& m_channel;
+    T m_value;
+};
+
+template<typename T>
+ChannelRecvAwaiter<T> task_recv(Channel<T>& channel, T& out) {
+    return ChannelRecvAwaiter<T>(channel, out);
+}
+
+template<typename T>
+ChannelSendAwaiter<T> task_send(Channel<T>& channel, T value) {
+    return ChannelSendAwaiter<T>(channel, std::move(value));
+}
+
+// co_await future：就绪时把恢复函数投递到挂起时所在的调度器，结果和异常同Future::get()
+template<typename T>
+class FutureAwaiter {
+public:
+    explicit FutureAwaiter(Future<T>& future): m_future(future) {}
+
+    bool await_ready() {return m_future.ready();}
+
+    void await_suspend(std::coroutine_handle<> handle) {
+        Scheduler* scheduler = Scheduler::GetThis();
+        assert(scheduler != nullptr);
+        m_future.onReady([scheduler, handle]() {
+            task_resume_on(scheduler, handle);
+        });
+    }
+
+    T await_resume() {
+        return m_future.get();
+    }
+
+private:
+    Future<T>& m_future;
+};
+
+template<typename T>
+FutureAwaiter<T> operator co_await(Future<T>& future) {
+    return FutureAwaiter<T>(future);
+}
+
+template<typename T>
+FutureAwaiter<T> operator co_await(Future<T>&& future) {
+    return FutureAwaiter<T>(future);
+}
+
+#endif
@@ -1,135 +1,426 @@
+#include <algorithm>
 #include <iostream>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
 #include "coroutine.h"
-/*
-typedef struct ucontext_t {
-    struct ucontext_t *uc_link;
-
-    sigset_t uc_sigmask;
-    
-    stack_t uc_stack;
-
-    mcontext_t uc_mcontext;
-
-} ucontext_t;
-*/
-
-int getcontext(ucontext_t *ucp);
-int setcontext(const ucontext_t *ucp);
-
-void makecontext(ucontext_t *ucp, void (*func)(), int argc, ...);
-
-int swapcontext(ucontext_t *oucp, const ucontext_t *ucp);
-
+#include "scheduler.h"
+#include "fiber_pool.h"
+#include "log.h"
 // 线程局部变量记录一个线程的协程控制信息
 // 当前线程正在运行的协程
 static thread_local Fiber* t_fiber = nullptr;
 
-// 当前线程的主协程，必须用shared_ptr持有，不然会在默认构造中创建中消失
-static thread_local std::shared_ptr<Fiber> t_thread_fiber = nullptr;
+// 当前线程的主协程，必须用Fiber::ptr持有，不然会在默认构造中创建中消失
+static thread_local Fiber::ptr t_thread_fiber = nullptr;
+
+// 刚刚切出、还没有清除m_onCpu的协程，由切入的一方在切换完成后清除
+static thread_local Fiber* t_switch_out = nullptr;
+
+// 经transferTo切入的协程由线程持有引用，直到它再切出；切出后的引用由切入的一方释放
+static thread_local Fiber::ptr t_transfer_hold = nullptr;
+static thread_local Fiber::ptr t_transfer_release = nullptr;
+
+// 存活的协程数量（所有线程）
+static std::atomic<uint64_t> s_fiber_count{0};
+
+// 下一个协程id，所有线程共用，id在进程内唯一，从1开始，0表示没有协程
+static std::atomic<uint64_t> s_fiber_id{1};
+
+// 协程局部存储：每个key的值的析构函数，下标是key
+static const size_t kMaxFiberLocals = 1024;
+static std::atomic<Fiber::LocalDestructor> s_local_dtors[kMaxFiberLocals];
+static std::atomic<size_t> s_local_keys{0};
+
+// 析构函数里可能又设置了别的局部变量，清理时最多重复几轮
+static const int kLocalClearRounds = 4;
+
+// 共享栈：多个协程轮流在同一块栈上运行，occupant是当前栈上保存着现场的协程
+struct SharedStack {
+    void* stack = nullptr;
+    size_t size = 0;
+    StackAllocator::Mode mode = StackAllocator::HEAP;
+    Fiber* occupant = nullptr;
+    // 使用这个栈的存活协程数，包括等待所属线程析构的协程
+    std::atomic<int> fibers{0};
+
+    // 在其他线程上释放了最后一个引用的协程，由所属线程析构（见Fiber::release()）
+    std::mutex deferredMutex;
+    std::vector<Fiber*> deferred;
+    std::atomic<bool> hasDeferred{false};
+};
+
+// 每个线程的共享栈数量和大小
+    // 共享栈协程按轮转分配到这些栈上，只有同一个栈上的协程互相切换时才需要拷贝
+static const int kSharedStackCount = 4;
+static const size_t kSharedStackSize = 256 * 1024;
+
+struct SharedStackSet {
+    SharedStack stacks[kSharedStackCount];
+    int next = 0;
+
+    ~SharedStackSet() {
+        reclaim();
+        for (int i = 0; i < kSharedStackCount; i++) {
+            if (stacks[i].stack) {
+                StackAllocator::Dealloc(stacks[i].stack, stacks[i].size, stacks[i].mode);
+            }
+        }
+    }
 
-// 当前线程的协程数量
-static thread_local int s_fiber_count = 0;
+    SharedStack* pick() {
+        SharedStack* ss = &stacks[next];
+        next = (next + 1) % kSharedStackCount;
+        if (ss->stack == nullptr) {
+            ss->size = kSharedStackSize;
+            ss->mode = StackAllocator::GetMode();
+            ss->stack = StackAllocator::Alloc(ss->size, ss->mode);
+        }
+        return ss;
+    }
 
-//当前线程的协程id
-static thread_local int s_fiber_id = 0;
+    bool owns(const SharedStack* ss) const {
+        return ss >= stacks && ss < stacks + kSharedStackCount;
+    }
+
+    // 析构其他线程转交过来的协程，只能在所属线程上调用
+    void reclaim() {
+        for (int i = 0; i < kSharedStackCount; i++) {
+            SharedStack& ss = stacks[i];
+            if (!ss.hasDeferred.load(std::memory_order_acquire)) {
+                continue;
+            }
+            std::vector<Fiber*> fibers;
+            {
+                std::lock_guard<std::mutex> lock(ss.deferredMutex);
+                fibers.swap(ss.deferred);
+                ss.hasDeferred.store(false, std::memory_order_relaxed);
+            }
+            for (Fiber* fiber : fibers) {
+                delete fiber;
+            }
+        }
+    }
+
+    int fibers() const {
+        int n = 0;
+        for (int i = 0; i < kSharedStackCount; i++) {
+            n += stacks[i].fibers.load(std::memory_order_acquire);
+        }
+        return n;
+    }
+};
+
+static thread_local SharedStackSet t_shared_stacks;
 
 void Fiber::SetThis(Fiber *f) {
     t_fiber = f;
 }
 
 // 返回当前线程正在执行的协程
-std::shared_ptr<Fiber> Fiber::GetThis() {
-    if (t_fiber) return t_fiber->shared_from_this();  //返回指向当前对象的shared_ptr
+Fiber::ptr Fiber::GetThis() {
+    if (t_fiber) return Fiber::ptr(t_fiber);  //引用计数加1，返回指向当前对象的Fiber::ptr
 
     // 如果当前线程还未创建协程，则创建线程的主协程
-        // Fiber是私有的，不能使用make_shared()
-    std::shared_ptr<Fiber> main_fiber(new Fiber());
+        // Fiber()是私有的，只能在这里创建
+    Fiber::ptr main_fiber(new Fiber());
     t_thread_fiber = main_fiber;
 
     assert(t_fiber == main_fiber.get());
 
-    return t_fiber->shared_from_this();
+    return main_fiber;
+
+}
+
+int Fiber::SharedStackFibers() {
+    t_shared_stacks.reclaim();
+    return t_shared_stacks.fibers();
+}
+
+uint64_t Fiber::TotalFibers() {
+    return s_fiber_count.load(std::memory_order_relaxed);
+}
+
+uint64_t Fiber::GetFiberId() {
+    return t_fiber ? t_fiber->m_id : 0;
+}
+
+bool Fiber::MaybeYield() {
+    if (!Scheduler::PreemptRequested()) {
+        return false;
+    }
+    // 调度协程、idle协程和不由调度器调度的协程不让出
+    Fiber* curr = t_fiber;
+    if (curr == nullptr || !curr->m_runInScheduler || curr == Scheduler::GetSchedulerFiber()) {
+        return false;
+    }
+    Scheduler::YieldToTail();
+    return true;
+}
+
+// 和信号处理函数在同一个线程上，只需要阻止编译器重排
+Fiber::PreemptibleScope::PreemptibleScope(): m_fiber(GetThis().get()) {
+    m_fiber->m_preemptible.store(m_fiber->m_preemptible.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+}
 
+Fiber::PreemptibleScope::~PreemptibleScope() {
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+    m_fiber->m_preemptible.store(m_fiber->m_preemptible.load(std::memory_order_relaxed) - 1, std::memory_order_relaxed);
+}
+
+bool Fiber::InPreemptibleScope() {
+    Fiber* curr = t_fiber;
+    return curr != nullptr && curr->m_runInScheduler && curr->m_sharedStack == nullptr
+        && curr->m_preemptible.load(std::memory_order_relaxed) > 0;
+}
+
+size_t Fiber::RegisterLocal(LocalDestructor dtor) {
+    size_t key = s_local_keys.fetch_add(1, std::memory_order_relaxed);
+    if (key >= kMaxFiberLocals) {
+        std::cerr << "RegisterLocal() failed: too many fiber locals\n";
+        exit(0);
+    }
+    s_local_dtors[key].store(dtor, std::memory_order_release);
+    return key;
+}
+
+// 快速路径只有一次线程局部变量读取和一次下标访问
+void*& Fiber::LocalSlot(size_t key) {
+    Fiber* f = t_fiber;
+    if (f && key < f->m_localCap) {
+        return f->m_locals[key];
+    }
+    if (f == nullptr) {
+        // 主协程由t_thread_fiber持有
+        f = GetThis().get();
+    }
+    f->growLocals(key);
+    return f->m_locals[key];
+}
+
+void Fiber::growLocals(size_t key) {
+    size_t cap = std::max(std::max(key + 1, m_localCap * 2), (size_t)8);
+    void** locals = (void**)realloc(m_locals, cap * sizeof(void*));
+    if (locals == nullptr) {
+        std::cerr << "growLocals() failed\n";
+        exit(0);
+    }
+    memset(locals + m_localCap, 0, (cap - m_localCap) * sizeof(void*));
+    m_locals = locals;
+    m_localCap = cap;
+}
+
+void Fiber::clearLocals() {
+    for (int round = 0; round < kLocalClearRounds; round++) {
+        bool found = false;
+        // 析构函数可能让槽位数组扩容，每次都重新读m_locals和m_localCap
+        for (size_t i = 0; i < m_localCap; i++) {
+            void* value = m_locals[i];
+            if (value) {
+                m_locals[i] = nullptr;
+                found = true;
+                s_local_dtors[i].load(std::memory_order_acquire)(value);
+            }
+        }
+        if (!found) {
+            return;
+        }
+    }
 }
 
 Fiber::Fiber() {
     SetThis(this); // 设置正在运行的协程为此协程
     m_state = RUNNING;
     
-    if (getcontext(&m_ctx)) {
+    if (context_init(&m_ctx)) {
         std::cerr << "Fiber() failed\n";
         exit(0);
     }
 
-    s_fiber_count++;
-    m_id = s_fiber_id++;
-    std::cout << "Fiber(): main id = " << m_id << std::endl;
+    s_fiber_count.fetch_add(1, std::memory_order_relaxed);
+    m_id = s_fiber_id.fetch_add(1, std::memory_order_relaxed);
+    FIBER_LOG_TRACE("Fiber(): main id = %llu", (unsigned long long)m_id);
 
 }
 
-Fiber::Fiber(std::function<void()> cb, size_t stacksize, bool run_in_scheduler):
-m_cb(cb), m_runInScheduler(run_in_scheduler) {
+Fiber::Fiber(UniqueFunction cb, size_t stacksize, bool run_in_scheduler, bool shared_stack):
+m_cb(std::move(cb)), m_runInScheduler(run_in_scheduler) {
     m_state = READY;
-    m_stacksize = stacksize ? stacksize : 128000;
-    m_stack = malloc(m_stacksize);
+    m_ownerThread = Scheduler::GetThreadId();
 
-    if (getcontext(&m_ctx)) {
-        std::cerr << "Fiber(std::function<void()> cb, size_t stacksize, bool run_in_scheduler) failed\n";
-        exit(0);
+    if (shared_stack) {
+        m_sharedStack = t_shared_stacks.pick();
+        if (m_sharedStack->stack == nullptr) {
+            std::cerr << "Fiber(UniqueFunction cb, size_t stacksize, bool run_in_scheduler) alloc shared stack failed\n";
+            exit(0);
+        }
+        m_stacksize = m_sharedStack->size;
+        m_needMake = true;
+        m_sharedStack->fibers.fetch_add(1, std::memory_order_relaxed);
+
+        m_id = s_fiber_id.fetch_add(1, std::memory_order_relaxed);
+        s_fiber_count.fetch_add(1, std::memory_order_relaxed);
+        FIBER_LOG_TRACE("Fiber(): shared stack child id = %llu", (unsigned long long)m_id);
+        return;
     }
 
-    m_ctx.uc_link = nullptr;
-    m_ctx.uc_stack.ss_sp = m_stack;
-    m_ctx.uc_stack.ss_size = m_stacksize;
+    // 从栈分配器取栈，实际大小按尺寸等级向上取整
+    size_t size = stacksize ? stacksize : 128000;
+    m_stackMode = StackAllocator::GetMode();
+    m_stack = StackAllocator::Alloc(size, m_stackMode);
+    m_stacksize = size;
+    if (m_stack == nullptr) {
+        std::cerr << "Fiber(UniqueFunction cb, size_t stacksize, bool run_in_scheduler) alloc stack failed\n";
+        exit(0);
+    }
 
-    makecontext(&m_ctx, &Fiber::MainFunc, 0);
+    if (context_make(&m_ctx, m_stack, m_stacksize, &Fiber::MainFunc)) {
+        std::cerr << "Fiber(UniqueFunction cb, size_t stacksize, bool run_in_scheduler) failed\n";
+        exit(0);
+    }
 
-    m_id = s_fiber_id++;
-    s_fiber_count++;
-    std::cout << "Fiber(): child id = " << m_id << std::endl;
+    m_id = s_fiber_id.fetch_add(1, std::memory_order_relaxed);
+    s_fiber_count.fetch_add(1, std::memory_order_relaxed);
+    FIBER_LOG_TRACE("Fiber(): child id = %llu", (unsigned long long)m_id);
 }
 
 Fiber::~Fiber() {
+    // 没有运行结束就析构的协程（主协程、被丢弃的协程）在这里析构局部变量
+    clearLocals();
+    free(m_locals);
+    s_fiber_count.fetch_sub(1, std::memory_order_relaxed);
     if (m_stack) {
-        free(m_stack);
+        StackAllocator::Dealloc(m_stack, m_stacksize, m_stackMode);
+    }
+    if (m_sharedStack) {
+        // occupant只由所属线程读写，其他线程上的最后一次释放已经由release()转交回来
+        assert(t_shared_stacks.owns(m_sharedStack));
+        if (m_sharedStack->occupant == this) {
+            m_sharedStack->occupant = nullptr;
+        }
+        m_sharedStack->fibers.fetch_sub(1, std::memory_order_release);
     }
+    free(m_saveBuf);
 }
 
 // 重置协程状态和入口函数，重用协程
-void Fiber::reset(std::function<void()> cb) {
-    assert(m_stack != nullptr);
+void Fiber::reset(UniqueFunction cb) {
+    assert(m_stack != nullptr || m_sharedStack != nullptr);
     assert(m_state == TERM);
 
-    m_cb = cb;
+    // 结束时已经清理过，这里保证重用的协程不会带着上一个任务的局部变量
+    clearLocals();
+    m_cb = std::move(cb);
     m_state = READY;
 
-    if (getcontext(&m_ctx)) {
+    // 共享栈协程等到切入时再构造上下文
+    if (m_sharedStack) {
+        m_needMake = true;
+        m_saveSize = 0;
+        return;
+    }
+
+    if (context_make(&m_ctx, m_stack, m_stacksize, &Fiber::MainFunc)) {
         std::cerr << "reset() failed\n";
         exit(0);
     }
+}
+
+void Fiber::release() {
+    // 共享栈协程必须在所属线程上析构：所属线程可能正在读写共享栈的occupant、拷贝这个协程的栈
+        // 转交给所属线程，在它下一次切入共享栈协程或者统计共享栈协程数时析构
+    if (m_sharedStack && !t_shared_stacks.owns(m_sharedStack)) {
+        std::lock_guard<std::mutex> lock(m_sharedStack->deferredMutex);
+        m_sharedStack->deferred.push_back(this);
+        m_sharedStack->hasDeferred.store(true, std::memory_order_release);
+        return;
+    }
+    if (m_pooled && FiberPool::Recycle(this)) {
+        return;
+    }
+    delete this;
+}
 
-    m_ctx.uc_link = nullptr;
-    m_ctx.uc_stack.ss_sp = m_stack;
-    m_ctx.uc_stack.ss_size = m_stacksize;
+void Fiber::acquireSharedStack() {
+    // 共享栈属于创建协程的线程
+    assert(t_shared_stacks.owns(m_sharedStack));
+    t_shared_stacks.reclaim();
 
-    makecontext(&m_ctx, &Fiber::MainFunc, 0);
+    Fiber* occupant = m_sharedStack->occupant;
+    if (occupant != this) {
+        if (occupant) {
+            occupant->saveSharedStack();
+        }
+        m_sharedStack->occupant = this;
+
+        if (!m_needMake && m_saveSize) {
+            char* top = static_cast<char*>(m_sharedStack->stack) + m_sharedStack->size;
+            memcpy(top - m_saveSize, m_saveBuf, m_saveSize);
+        }
+    }
+
+    if (m_needMake) {
+        if (context_make(&m_ctx, m_sharedStack->stack, m_sharedStack->size, &Fiber::MainFunc)) {
+            std::cerr << "acquireSharedStack() failed\n";
+            exit(0);
+        }
+        m_needMake = false;
+    }
+}
+
+void Fiber::saveSharedStack() {
+    // 已经结束的协程栈上没有需要保留的内容
+    if (m_state == TERM) {
+        m_saveSize = 0;
+        return;
+    }
+
+    char* base = static_cast<char*>(m_sharedStack->stack);
+    char* top = base + m_sharedStack->size;
+    // 从切出时保存在上下文中的栈指针拷贝到栈底，包括切换函数压在栈上的寄存器；取不到栈指针时拷贝整个栈
+    char* sp = static_cast<char*>(context_stack_pointer(&m_ctx));
+    assert(sp == nullptr || (sp >= base && sp <= top));
+    if (sp == nullptr) {
+        sp = base;
+    }
+
+    m_saveSize = top - sp;
+    if (m_saveSize > m_saveCap) {
+        free(m_saveBuf);
+        m_saveBuf = static_cast<char*>(malloc(m_saveSize));
+        m_saveCap = m_saveSize;
+    }
+    memcpy(m_saveBuf, sp, m_saveSize);
 }
 
 void Fiber::resume() {
+    // 等待协程在其他线程上完全切出
+    while (m_onCpu.exchange(true, std::memory_order_acquire)) {
+        std::this_thread::yield();
+    }
+
     assert(m_state == READY);
+    if (m_sharedStack) {
+        acquireSharedStack();
+    }
     SetThis(this);
     m_state = RUNNING;
     
     if (m_runInScheduler) {
-        if (swapcontext(&(Scheduler::GetSchedulerFiber()->m_ctx), &m_ctx)) {
+        if (context_swap(&(Scheduler::GetSchedulerFiber()->m_ctx), &m_ctx)) {
             std::cerr << "resum() to GetSchedulerFiber faild\n";
             pthread_exit(NULL);
         }
     } else {
-        if (swapcontext(&(t_thread_fiber->m_ctx), &m_ctx)) {
+        if (context_swap(&(t_thread_fiber->m_ctx), &m_ctx)) {
             std::cerr << "resum() to t_thread_fiber faild\n";
         }
     }
+
+    // 回到这里时切出的协程上下文保存完毕；中途经过transferTo时切出的是接力的最后一个协程，不一定是本协程
+    FinishSwitch();
 }
 
 void Fiber::yield() {
@@ -139,30 +430,85 @@ void Fiber::yield() {
         m_state = READY;
     }
 
+    t_switch_out = this;
+    if (t_transfer_hold) {
+        t_transfer_release = std::move(t_transfer_hold);
+    }
+
     if (m_runInScheduler) {
         SetThis(Scheduler::GetSchedulerFiber());
-        if (swapcontext(&m_ctx, &(Scheduler::GetSchedulerFiber()->m_ctx))) {
+        if (context_swap(&m_ctx, &(Scheduler::GetSchedulerFiber()->m_ctx))) {
             std::cerr << "yield() to to GetSchedulerFiber faild\n";
             pthread_exit(NULL);
         }
     } else {
-        SetThis(Scheduler::GetSchedulerFiber());
-        if (swapcontext(&m_ctx, &(t_thread_fiber->m_ctx))) {
+        SetThis(t_thread_fiber.get());
+        if (context_swap(&m_ctx, &(t_thread_fiber->m_ctx))) {
             std::cerr << "yield() to t_thread_fiber failed\n";
             pthread_exit(NULL);
         }
     }
+
+    // 可能是被transferTo直接切入的
+    FinishSwitch();
+}
+
+void Fiber::transferTo(ptr next) {
+    assert(t_fiber == this && m_state == RUNNING);
+    assert(m_runInScheduler && next->m_runInScheduler);
+    // 共享栈协程切入前要拷贝栈，不能在共享栈上直接切换
+    assert(m_sharedStack == nullptr && next->m_sharedStack == nullptr);
+
+    Fiber* to = next.get();
+    assert(to != this);
+
+    // 等待next在其他线程上完全切出
+    while (to->m_onCpu.exchange(true, std::memory_order_acquire)) {
+        std::this_thread::yield();
+    }
+    assert(to->m_state == READY);
+
+    m_state = READY;
+    t_switch_out = this;
+    // 本协程如果也是经transferTo切入的，切出完成后再释放它的引用
+    if (t_transfer_hold) {
+        t_transfer_release = std::move(t_transfer_hold);
+    }
+    t_transfer_hold = std::move(next);
+
+    SetThis(to);
+    to->m_state = RUNNING;
+    if (context_swap(&m_ctx, &to->m_ctx)) {
+        std::cerr << "transferTo() failed\n";
+        pthread_exit(NULL);
+    }
+
+    FinishSwitch();
+}
+
+void Fiber::FinishSwitch() {
+    if (t_switch_out) {
+        t_switch_out->m_onCpu.store(false, std::memory_order_release);
+        t_switch_out = nullptr;
+    }
+    if (t_transfer_release) {
+        t_transfer_release.reset();
+    }
 }
 
 void Fiber::MainFunc() {
-    
-    std::shared_ptr<Fiber> curr = GetThis();
+    // 第一次切入可能来自transferTo
+    FinishSwitch();
+
+    Fiber::ptr curr = GetThis();
 
     assert(curr != nullptr);
 
     curr->m_cb();
 
     curr->m_cb = nullptr;
+    // 协程还是当前协程，析构函数里仍然可以访问其他局部变量
+    curr->clearLocals();
     curr->m_state =TERM;
 
     auto raw_ptr = curr.get();
@@ -6,17 +6,23 @@
 #include <atomic>
 #include <functional>
 #include <cassert>
-#include <ucontext.h>
 #include <unistd.h>
 
-#include "scheduler.h"
+#include "context.h"
+#include "stack_allocator.h"
+#include "intrusive_ptr.h"
+#include "unique_function.h"
 
 class Scheduler;
 
-    // 公有继承：继承这个类的对象可以安全地生成一个指向自身的std::shared_ptr
-    // 通过shared_from_this方法获取指向调用对象的shared_ptr,对比this指针
-class Fiber : public std::enable_shared_from_this<Fiber> {
+struct SharedStack;
+
+    // 协程对象使用侵入式引用计数，通过Fiber::ptr持有
+    // 引用计数在对象内部，GetThis()从当前协程的裸指针直接得到Fiber::ptr，不需要shared_from_this
+class Fiber {
 public:
+    typedef IntrusivePtr<Fiber> ptr;
+
     // 协程的三种状态
     enum State {
         READY,
@@ -29,42 +35,155 @@ private:
 
 public:
     // 用于创建子协程的构造函数
-
-    Fiber(std::function<void()> cb, size_t stacksize = 0, bool run_in_scheduler = true);
+        // shared_stack为true时协程运行在当前线程的共享栈上（忽略stacksize），切出后只把用到的部分拷贝到私有缓冲区
+        // 共享栈属于创建协程的线程，这种协程只能在创建它的线程上resume
+        // 最后一个引用可以在任何线程上释放，但析构总是在创建它的线程上进行：其他线程释放时转交回去，
+            // 等那个线程下一次切入共享栈协程或者调用SharedStackFibers()时析构；协程必须在那个线程退出之前释放
+    Fiber(UniqueFunction cb, size_t stacksize = 0, bool run_in_scheduler = true, bool shared_stack = false);
 
     ~Fiber();
 
-    void reset(std::function<void()> cb);
+    // 重用已经结束的协程，cb被移动进来
+    void reset(UniqueFunction cb);
 
     void resume();
 
     void yield();
 
+    // 对称切换：当前协程切出，直接切入next，不经过调度协程
+        // 当前协程之后由谁恢复由调用者安排，和yield()一样；next之后yield()时照常回到调度协程
+        // 两个协程都必须是由调度器调度的私有栈协程，next处于READY状态、没有在任何队列中
+    void transferTo(ptr next);
+
     uint64_t getId() const {return m_id;}
 
     State getState() const {return m_state;}
 
     void setState(State st) {m_state = st;}
 
+    bool isSharedStack() const {return m_sharedStack != nullptr;}
+
+    // 是否由调度器调度，yield时切回调度协程
+    bool isRunInScheduler() const {return m_runInScheduler;}
+
+    // 创建协程的线程id，共享栈协程只能在这个线程上运行
+    int getOwnerThread() const {return m_ownerThread;}
+
+    // 共享栈协程切出后保存的栈大小
+    size_t getSavedStackSize() const {return m_saveSize;}
+
+    // 引用计数，由Fiber::ptr调用，计数归零时释放协程
+        // 从FiberPool取出的协程放回池中，其他的直接析构
+    void incRef() {m_ref.fetch_add(1, std::memory_order_relaxed);}
+    // 当前的引用数；读到1时其他持有者都已经释放，它们对协程的写入（包括切出时保存的上下文）都可见
+    uint32_t getRefCount() const {return m_ref.load(std::memory_order_acquire);}
+    void decRef() {
+        if (m_ref.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            release();
+        }
+    }
+
 public:
     static void SetThis(Fiber *f);
-    static std::shared_ptr<Fiber> GetThis();
+    static ptr GetThis();
 
+    // 存活的协程数量，包括各线程的主协程和协程池中缓存的协程
     static uint64_t TotalFibers();
 
+    // 当前线程的共享栈上存活的协程数，不为0时线程不能退出
+    static int SharedStackFibers();
+
     static void MainFunc();
 
+    // 当前协程的id，线程还没有协程时返回0
     static uint64_t GetFiberId();
 
+    // 安全点：调度器的看门狗发现当前任务运行超过时间片（Scheduler::Options::timeSliceMs）时让出并排到队尾，返回是否让出
+        // 没有要求让出时只读一个线程局部变量和一个标志，可以放在CPU密集循环的每次迭代里
+    static bool MaybeYield();
+
+    // 作用域内的代码允许被信号强制让出（Scheduler::Options::forcePreempt），可以嵌套
+        // 只能包住纯计算：不加锁、不分配内存、不调用调度器和系统调用，让出可能发生在任意一条指令上
+        // 让出以后可能在另一个线程上恢复，作用域内不能缓存thread_local变量的地址
+    class PreemptibleScope {
+    public:
+        PreemptibleScope();
+        ~PreemptibleScope();
+
+        PreemptibleScope(const PreemptibleScope&) = delete;
+        PreemptibleScope& operator=(const PreemptibleScope&) = delete;
+
+    private:
+        Fiber* m_fiber;
+    };
+
+    // 当前协程是由调度器调度的私有栈协程，并且处在PreemptibleScope中
+    static bool InPreemptibleScope();
+
+    // 协程局部存储（见fiber_local.h）
+        // 每个协程有一个按key下标访问的槽位数组，槽位里的值随协程在线程之间迁移
+    typedef void (*LocalDestructor)(void*);
+
+    // 登记一个key和它的值的析构函数，key从0开始递增，不回收
+    static size_t RegisterLocal(LocalDestructor dtor);
+
+    // 当前协程的第key个槽位，线程还没有协程时创建主协程；槽位数组不够大时扩容
+    static void*& LocalSlot(size_t key);
+
 private:
+    // 共享栈协程切入前占用共享栈：保存上一个占用者的栈，恢复自己的栈
+    void acquireSharedStack();
+    // 把共享栈上用到的部分拷贝到私有缓冲区
+    void saveSharedStack();
+    // 引用计数归零
+    void release();
+
+    // 析构并清空所有槽位里的值
+    void clearLocals();
+    // 把槽位数组扩大到能放下key
+    void growLocals(size_t key);
+
+    // 每次切换完成后在切入的一方调用：刚切出的协程上下文已经保存，清除它的m_onCpu
+    static void FinishSwitch();
+
+private:
+    friend class FiberPool;
+
     uint64_t m_id = 0;
     uint32_t m_stacksize = 0;
     State m_state = READY;
-    ucontext_t m_ctx;
+    FiberContext m_ctx;
     void* m_stack = nullptr;
-
-    std::function<void()> m_cb;
-    bool m_runInScheduler;  // 本协程是否参与调度器调度 
+    // 协程栈的分配方式，归还时需要
+    StackAllocator::Mode m_stackMode = StackAllocator::HEAP;
+
+    // 共享栈模式：运行栈、保存栈内容的缓冲区；拷贝的范围由切出时保存在m_ctx中的栈指针确定
+    SharedStack* m_sharedStack = nullptr;
+    char* m_saveBuf = nullptr;
+    size_t m_saveSize = 0;
+    size_t m_saveCap = 0;
+    // 共享栈协程第一次切入时才构造上下文，构造时会写栈
+    bool m_needMake = false;
+    int m_ownerThread = -1;
+
+    // 协程是否还占用着某个线程：从切入开始，到切出时上下文保存完毕为止
+        // 协程可能在切出之前就被投递到调度器，其他线程必须等它完全切出才能resume
+    std::atomic<bool> m_onCpu{false};
+
+    // 引用计数
+    std::atomic<uint32_t> m_ref{0};
+
+    UniqueFunction m_cb;
+    bool m_runInScheduler = false;  // 本协程是否参与调度器调度 
+    // 是否由FiberPool创建，释放时放回池中
+    bool m_pooled = false;
+
+    // 协程局部存储的槽位数组，第一次使用时分配，协程放回池中重用时保留
+    void** m_locals = nullptr;
+    size_t m_localCap = 0;
+
+    // PreemptibleScope的嵌套层数，只有协程自己和它所在线程的信号处理函数读写
+    std::atomic<int> m_preemptible{0};
 };
 
 
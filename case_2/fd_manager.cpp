@@ -0,0 +1,102 @@
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <fcntl.h>
+
+#include "fd_manager.h"
+#include "hook.h"
+
+FdCtx::FdCtx(int fd):
+m_fd(fd) {
+    init();
+}
+
+FdCtx::~FdCtx() {
+}
+
+bool FdCtx::init() {
+    if (m_isInit) {
+        return true;
+    }
+
+    struct stat fd_stat;
+    if (fstat(m_fd, &fd_stat) == -1) {
+        m_isInit = false;
+        m_isSocket = false;
+    } else {
+        m_isInit = true;
+        m_isSocket = S_ISSOCK(fd_stat.st_mode);
+    }
+
+    // socket统一设置为非阻塞，阻塞语义由hook层用事件等待模拟
+    if (m_isSocket) {
+        int flags = fcntl_f(m_fd, F_GETFL, 0);
+        if (!(flags & O_NONBLOCK)) {
+            fcntl_f(m_fd, F_SETFL, flags | O_NONBLOCK);
+        }
+        m_sysNonblock = true;
+    } else {
+        m_sysNonblock = false;
+    }
+
+    m_userNonblock = false;
+    m_isClosed = false;
+    return m_isInit;
+}
+
+void FdCtx::setTimeout(int type, uint64_t v) {
+    if (type == SO_RCVTIMEO) {
+        m_recvTimeout = v;
+    } else {
+        m_sendTimeout = v;
+    }
+}
+
+uint64_t FdCtx::getTimeout(int type) {
+    if (type == SO_RCVTIMEO) {
+        return m_recvTimeout;
+    }
+    return m_sendTimeout;
+}
+
+FdManager::FdManager() {
+    m_datas.resize(64);
+}
+
+FdManager* FdManager::GetInstance() {
+    // 不释放：其他静态对象析构时可能还会关闭fd
+    static FdManager* s_instance = new FdManager();
+    return s_instance;
+}
+
+FdCtx::ptr FdManager::get(int fd, bool auto_create) {
+    if (fd < 0) {
+        return nullptr;
+    }
+
+    {
+        std::shared_lock<std::shared_mutex> lock(m_mutex);
+        if ((size_t)fd < m_datas.size() && m_datas[fd]) {
+            return m_datas[fd];
+        }
+        if (!auto_create) {
+            return nullptr;
+        }
+    }
+
+    std::unique_lock<std::shared_mutex> lock(m_mutex);
+    if ((size_t)fd >= m_datas.size()) {
+        m_datas.resize(fd * 3 / 2 + 1);
+    }
+    if (!m_datas[fd]) {
+        m_datas[fd] = std::make_shared<FdCtx>(fd);
+    }
+    return m_datas[fd];
+}
+
+void FdManager::del(int fd) {
+    std::unique_lock<std::shared_mutex> lock(m_mutex);
+    if (fd < 0 || (size_t)fd >= m_datas.size()) {
+        return;
+    }
+    m_datas[fd].reset();
+}
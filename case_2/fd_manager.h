@@ -0,0 +1,73 @@
+#ifndef _FD_MANAGER_H_
+#define _FD_MANAGER_H_
+
+#include <memory>
+#include <atomic>
+#include <vector>
+#include <mutex>
+#include <shared_mutex>
+#include <cstdint>
+
+// fd的上下文，由hook层维护
+    // socket在创建时就被设置为非阻塞（sysNonblock），hook层据此把阻塞调用转换为等待事件+yield
+    // 用户自己设置的O_NONBLOCK记录在userNonblock中，这种fd的调用不做转换，直接返回EAGAIN给用户
+class FdCtx : public std::enable_shared_from_this<FdCtx> {
+public:
+    typedef std::shared_ptr<FdCtx> ptr;
+
+    FdCtx(int fd);
+    ~FdCtx();
+
+    bool isInit() const {return m_isInit;}
+    bool isSocket() const {return m_isSocket;}
+    bool isClosed() const {return m_isClosed;}
+    // close()时标记，唤醒的等待者据此返回EBADF
+    void setClosed() {m_isClosed = true;}
+
+    void setUserNonblock(bool v) {m_userNonblock = v;}
+    bool getUserNonblock() const {return m_userNonblock;}
+
+    void setSysNonblock(bool v) {m_sysNonblock = v;}
+    bool getSysNonblock() const {return m_sysNonblock;}
+
+    // type为SO_RCVTIMEO或SO_SNDTIMEO，单位毫秒，-1表示不超时
+    void setTimeout(int type, uint64_t v);
+    uint64_t getTimeout(int type);
+
+private:
+    bool init();
+
+private:
+    bool m_isInit = false;
+    bool m_isSocket = false;
+    bool m_sysNonblock = false;
+    bool m_userNonblock = false;
+    std::atomic<bool> m_isClosed{false};
+    int m_fd;
+
+    // 读超时（SO_RCVTIMEO）
+    uint64_t m_recvTimeout = (uint64_t)-1;
+    // 写超时（SO_SNDTIMEO）
+    uint64_t m_sendTimeout = (uint64_t)-1;
+};
+
+// fd上下文管理器，全局唯一
+class FdManager {
+public:
+    // 获取fd的上下文，不存在且auto_create为false时返回nullptr
+    FdCtx::ptr get(int fd, bool auto_create = false);
+
+    // fd关闭时删除上下文
+    void del(int fd);
+
+    static FdManager* GetInstance();
+
+private:
+    FdManager();
+
+private:
+    std::shared_mutex m_mutex;
+    std::vector<FdCtx::ptr> m_datas;
+};
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef _FIBER_LOCAL_H_
+#define _FIBER_LOCAL_H_
+
+#include <cassert>
+#include <cstddef>
+
+#include "coroutine.h"
+
+// 协程局部存储，用法类似thread_local，但值属于当前协程
+    // 协程会在调度器的工作线程之间迁移，thread_local保存的请求上下文（trace id、分配器、连接等）会错乱，放在这里则随协程一起迁移
+    // 每个FiberLocal在构造时登记一个key，值存放在协程的槽位数组中，访问只需要一次下标读取
+    // 协程运行结束、被重用（reset）或者析构时，析构所有槽位里的值；调度器的函数任务每个任务结束都会清理
+    // 不在协程中的调用者（普通线程）使用线程主协程的槽位，线程退出时析构
+    // 通常定义为静态对象；key不回收，FiberLocal析构以后，协程中残留的值仍然在协程结束时正常析构
+template<typename T>
+class FiberLocal {
+public:
+    FiberLocal(): m_key(Fiber::RegisterLocal(&FiberLocal::Destroy)) {}
+
+    FiberLocal(const FiberLocal&) = delete;
+    FiberLocal& operator=(const FiberLocal&) = delete;
+
+    // 当前协程的值，没有设置过时返回nullptr
+    T* get() const {
+        return static_cast<T*>(Fiber::LocalSlot(m_key));
+    }
+
+    T* operator->() const {
+        T* value = get();
+        assert(value != nullptr);
+        return value;
+    }
+
+    T& operator*() const {
+        T* value = get();
+        assert(value != nullptr);
+        return *value;
+    }
+
+    // 替换当前协程的值，接管value的所有权，旧值立即析构；不传参数时只析构旧值
+    void reset(T* value = nullptr) {
+        void*& slot = Fiber::LocalSlot(m_key);
+        T* old = static_cast<T*>(slot);
+        slot = value;
+        if (old != value) {
+            delete old;
+        }
+    }
+
+    // 取出当前协程的值，不析构，槽位置空
+    T* release() {
+        void*& slot = Fiber::LocalSlot(m_key);
+        T* value = static_cast<T*>(slot);
+        slot = nullptr;
+        return value;
+    }
+
+    size_t key() const {return m_key;}
+
+private:
+    static void Destroy(void* value) {
+        delete static_cast<T*>(value);
+    }
+
+private:
+    const size_t m_key;
+};
+
+#endif
@@ -0,0 +1,254 @@
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <algorithm>
+
+#include "fiber_pool.h"
+#include "numa_topology.h"
+
+// 线程缓存和全局池的默认上限
+static std::atomic<size_t> s_thread_limit{64};
+static std::atomic<size_t> s_global_limit{256};
+
+struct FiberThreadCache;
+
+// 全局池：线程缓存溢出的协程放在这里，由所有线程共享
+    // 和栈分配器一样按NUMA节点分开，协程连同它的栈只在同一节点的线程之间流转
+struct FiberGlobalPool {
+    std::mutex mutex;
+    std::vector<Fiber*> lists[NumaTopology::kMaxNodes];
+
+    // 当前线程节点的池
+    std::vector<Fiber*>& fibers() {
+        return lists[NumaTopology::ThreadNode() % NumaTopology::kMaxNodes];
+    }
+
+    // 已经退出的线程留下的计数
+    uint64_t retiredLocalHits = 0;
+    uint64_t retiredGlobalHits = 0;
+    uint64_t retiredMisses = 0;
+    uint64_t retiredRecycles = 0;
+    uint64_t retiredFrees = 0;
+
+    // 所有存活的线程缓存，用于汇总计数
+    std::mutex cachesMutex;
+    std::vector<FiberThreadCache*> caches;
+};
+
+// 不随静态析构释放，线程退出时可能还会放回协程
+static FiberGlobalPool& global_pool() {
+    static FiberGlobalPool* pool = new FiberGlobalPool();
+    return *pool;
+}
+
+struct FiberThreadCache {
+    std::vector<Fiber*> fibers;
+
+    // 只有所属线程写入，GetStats()从其他线程读取
+    std::atomic<uint64_t> localHits{0};
+    std::atomic<uint64_t> globalHits{0};
+    std::atomic<uint64_t> misses{0};
+    std::atomic<uint64_t> recycles{0};
+    std::atomic<uint64_t> frees{0};
+
+    FiberThreadCache();
+    ~FiberThreadCache();
+};
+
+// 线程缓存析构以后，本线程再取/放协程就直接走全局池
+static thread_local bool t_cache_destroyed = false;
+static thread_local FiberThreadCache t_cache;
+
+static void bump(std::atomic<uint64_t>& counter) {
+    counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+// 把协程放回全局池，满了返回false
+static bool push_global(FiberGlobalPool& pool, Fiber* fiber) {
+    if (pool.fibers().size() >= s_global_limit.load(std::memory_order_relaxed)) {
+        return false;
+    }
+    pool.fibers().push_back(fiber);
+    return true;
+}
+
+FiberThreadCache::FiberThreadCache() {
+    FiberGlobalPool& pool = global_pool();
+    std::lock_guard<std::mutex> lock(pool.cachesMutex);
+    pool.caches.push_back(this);
+}
+
+FiberThreadCache::~FiberThreadCache() {
+    t_cache_destroyed = true;
+
+    FiberGlobalPool& pool = global_pool();
+    {
+        std::lock_guard<std::mutex> lock(pool.cachesMutex);
+        pool.caches.erase(std::find(pool.caches.begin(), pool.caches.end(), this));
+    }
+
+    // 线程退出，缓存的协程全部归还到全局池，放不下的在锁外析构
+    std::vector<Fiber*> overflow;
+    {
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        pool.retiredLocalHits += localHits.load(std::memory_order_relaxed);
+        pool.retiredGlobalHits += globalHits.load(std::memory_order_relaxed);
+        pool.retiredMisses += misses.load(std::memory_order_relaxed);
+        pool.retiredRecycles += recycles.load(std::memory_order_relaxed);
+        pool.retiredFrees += frees.load(std::memory_order_relaxed);
+
+        for (Fiber* fiber : fibers) {
+            if (!push_global(pool, fiber)) {
+                overflow.push_back(fiber);
+                pool.retiredFrees++;
+            }
+        }
+        fibers.clear();
+    }
+
+    for (Fiber* fiber : overflow) {
+        delete fiber;
+    }
+}
+
+Fiber::ptr FiberPool::Acquire(UniqueFunction cb) {
+    Fiber* fiber = nullptr;
+    FiberGlobalPool& pool = global_pool();
+
+    if (t_cache_destroyed) {
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        if (!pool.fibers().empty()) {
+            fiber = pool.fibers().back();
+            pool.fibers().pop_back();
+            pool.retiredGlobalHits++;
+        } else {
+            pool.retiredMisses++;
+        }
+    } else if (!t_cache.fibers.empty()) {
+        // 1. 线程缓存
+        fiber = t_cache.fibers.back();
+        t_cache.fibers.pop_back();
+        bump(t_cache.localHits);
+    } else {
+        // 2. 从全局池批量取回线程上限的一半
+        size_t batch = std::max<size_t>(s_thread_limit.load(std::memory_order_relaxed) / 2, 1);
+        {
+            std::lock_guard<std::mutex> lock(pool.mutex);
+            size_t n = std::min(batch, pool.fibers().size());
+            t_cache.fibers.insert(t_cache.fibers.end(), pool.fibers().end() - n, pool.fibers().end());
+            pool.fibers().resize(pool.fibers().size() - n);
+        }
+        if (!t_cache.fibers.empty()) {
+            fiber = t_cache.fibers.back();
+            t_cache.fibers.pop_back();
+            bump(t_cache.globalHits);
+        } else {
+            bump(t_cache.misses);
+        }
+    }
+
+    // 3. 新建
+    if (fiber == nullptr) {
+        fiber = new Fiber(std::move(cb));
+        fiber->m_pooled = true;
+        return Fiber::ptr(fiber);
+    }
+
+    fiber->reset(std::move(cb));
+    return Fiber::ptr(fiber);
+}
+
+bool FiberPool::Recycle(Fiber* fiber) {
+    // 没有运行结束的协程栈上还有现场，不能重用
+    if (fiber->m_state != Fiber::TERM) {
+        return false;
+    }
+    // 最后一个引用在调度器切回之后才释放，协程一定已经完全切出
+    assert(!fiber->m_onCpu.load(std::memory_order_relaxed));
+
+    FiberGlobalPool& pool = global_pool();
+    if (t_cache_destroyed) {
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        if (!push_global(pool, fiber)) {
+            pool.retiredFrees++;
+            return false;
+        }
+        pool.retiredRecycles++;
+        return true;
+    }
+
+    t_cache.fibers.push_back(fiber);
+    bump(t_cache.recycles);
+
+    // 超过上限，归还一半到全局池
+    size_t limit = s_thread_limit.load(std::memory_order_relaxed);
+    if (t_cache.fibers.size() <= limit) {
+        return true;
+    }
+
+    std::vector<Fiber*> overflow;
+    {
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        while (t_cache.fibers.size() > limit / 2) {
+            if (!push_global(pool, t_cache.fibers.back())) {
+                overflow.push_back(t_cache.fibers.back());
+            }
+            t_cache.fibers.pop_back();
+        }
+    }
+
+    // 全局池也满了，在锁外析构
+    for (Fiber* p : overflow) {
+        bump(t_cache.frees);
+        delete p;
+    }
+    return true;
+}
+
+void FiberPool::SetLimits(size_t per_thread, size_t global) {
+    s_thread_limit.store(per_thread, std::memory_order_relaxed);
+    s_global_limit.store(global, std::memory_order_relaxed);
+}
+
+FiberPool::Stats FiberPool::GetStats() {
+    Stats stats;
+    FiberGlobalPool& pool = global_pool();
+    {
+        std::lock_guard<std::mutex> lock(pool.cachesMutex);
+        for (FiberThreadCache* cache : pool.caches) {
+            stats.localHits += cache->localHits.load(std::memory_order_relaxed);
+            stats.globalHits += cache->globalHits.load(std::memory_order_relaxed);
+            stats.misses += cache->misses.load(std::memory_order_relaxed);
+            stats.recycles += cache->recycles.load(std::memory_order_relaxed);
+            stats.frees += cache->frees.load(std::memory_order_relaxed);
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(pool.mutex);
+    stats.localHits += pool.retiredLocalHits;
+    stats.globalHits += pool.retiredGlobalHits;
+    stats.misses += pool.retiredMisses;
+    stats.recycles += pool.retiredRecycles;
+    stats.frees += pool.retiredFrees;
+    for (int n = 0; n < NumaTopology::kMaxNodes; n++) {
+        stats.cached += pool.lists[n].size();
+    }
+    return stats;
+}
+
+void FiberPool::Trim() {
+    std::vector<Fiber*> fibers;
+    FiberGlobalPool& pool = global_pool();
+    {
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        for (int n = 0; n < NumaTopology::kMaxNodes; n++) {
+            pool.retiredFrees += pool.lists[n].size();
+            fibers.insert(fibers.end(), pool.lists[n].begin(), pool.lists[n].end());
+            pool.lists[n].clear();
+        }
+    }
+
+    for (Fiber* fiber : fibers) {
+        delete fiber;
+    }
+}
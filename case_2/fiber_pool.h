@@ -0,0 +1,47 @@
+#ifndef _FIBER_POOL_H_
+#define _FIBER_POOL_H_
+
+#include <cstddef>
+#include <cstdint>
+
+#include "coroutine.h"
+
+// 协程对象池
+    // 从池中取出的协程最后一个Fiber::ptr释放时，如果已经结束，不析构而是放回当前线程的缓存
+    // 再次取出时只需要reset()重新构造上下文，不再分配协程对象和栈
+    // 每个线程有自己的缓存，不加锁；线程缓存超过上限时归还一半到全局池，全局池满了才真正释放
+    // 全局池按NUMA节点分开（见NumaTopology），只和当前线程所属节点的池交换
+    // 池中的协程都使用默认栈大小、私有栈、参与调度器调度；没有结束就被释放的协程照常析构
+    // 池是进程级的而不是属于某个调度器：协程可能比创建它的调度器活得久，放回时不能依赖调度器还存在
+class FiberPool {
+public:
+    struct Stats {
+        uint64_t localHits = 0;   // 线程缓存命中
+        uint64_t globalHits = 0;  // 线程缓存未命中，从全局池取到
+        uint64_t misses = 0;      // 新建了协程
+        uint64_t recycles = 0;    // 放回池中的协程
+        uint64_t frees = 0;       // 池满了真正析构的协程
+        uint64_t cached = 0;      // 全局池中当前缓存的协程数
+    };
+
+public:
+    // 取一个协程，入口函数为cb，池中没有时新建
+    static Fiber::ptr Acquire(UniqueFunction cb);
+
+    // 设置每个线程缓存和全局池最多保留的协程数，超出的直接析构
+    static void SetLimits(size_t per_thread, size_t global);
+
+    // 汇总所有线程的计数
+    static Stats GetStats();
+
+    // 析构全局池中缓存的协程
+    static void Trim();
+
+private:
+    friend class Fiber;
+
+    // 协程引用计数归零时调用，放回池中返回true，否则由调用者析构
+    static bool Recycle(Fiber* fiber);
+};
+
+#endif
@@ -0,0 +1,336 @@
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "fiber_sync.h"
+#include "scheduler.h"
+
+static void futex_wait(std::atomic<uint32_t>* addr, uint32_t val) {
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(addr), FUTEX_WAIT_PRIVATE, val, nullptr, nullptr, 0);
+}
+
+static void futex_wake(std::atomic<uint32_t>* addr, int count) {
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(addr), FUTEX_WAKE_PRIVATE, count, nullptr, nullptr, 0);
+}
+
+void FiberWaitQueue::push(FiberWaiter* waiter) {
+    waiter->next = nullptr;
+    if (m_tail) {
+        m_tail->next = waiter;
+    } else {
+        m_head = waiter;
+    }
+    m_tail = waiter;
+}
+
+FiberWaiter* FiberWaitQueue::pop() {
+    FiberWaiter* waiter = m_head;
+    if (waiter) {
+        m_head = waiter->next;
+        if (m_head == nullptr) {
+            m_tail = nullptr;
+        }
+    }
+    return waiter;
+}
+
+void FiberWaitQueue::Prepare(FiberWaiter* waiter) {
+    waiter->fiber = nullptr;
+    waiter->scheduler = nullptr;
+    waiter->ready.store(0, std::memory_order_relaxed);
+
+    // 只有调度器调度的任务协程可以挂起；线程的主协程、调度协程只能阻塞线程
+    Scheduler* scheduler = Scheduler::GetThis();
+    Fiber* scheduler_fiber = Scheduler::GetSchedulerFiber();
+    if (scheduler == nullptr || scheduler_fiber == nullptr) {
+        return;
+    }
+    Fiber::ptr curr = Fiber::GetThis();
+    if (curr.get() != scheduler_fiber && curr->isRunInScheduler()) {
+        waiter->fiber = std::move(curr);
+        waiter->scheduler = scheduler;
+    }
+}
+
+void FiberWaitQueue::Wait(FiberWaiter* waiter) {
+    // 唤醒者可能已经把fiber移走，这里只看scheduler判断等待方式
+    // 刚唤醒的协程在runnext槽位里时直接切过去
+    if (waiter->scheduler) {
+        Scheduler::YieldToNext();
+        return;
+    }
+
+    while (waiter->ready.load(std::memory_order_acquire) == 0) {
+        futex_wait(&waiter->ready, 0);
+    }
+}
+
+void FiberWaitQueue::Wake(FiberWaiter* waiter) {
+    if (waiter->scheduler) {
+        // 投递之后等待的协程随时可能在其他线程上恢复并返回，先把需要的东西取出来
+            // 唤醒方在同一个调度器的工作线程上时放进runnext槽位，唤醒方挂起后接着运行
+        Scheduler* scheduler = waiter->scheduler;
+        if (waiter->fiber) {
+            Fiber::ptr fiber = std::move(waiter->fiber);
+            scheduler->scheduleNext(std::move(fiber));
+        } else {
+            UniqueFunction callback = std::move(waiter->callback);
+            scheduler->scheduleNext(std::move(callback));
+        }
+        return;
+    }
+
+    // 置位以后等待的线程可能已经返回，futex_wake作用在失效的地址上也是无害的
+    waiter->ready.store(1, std::memory_order_release);
+    futex_wake(&waiter->ready, 1);
+}
+
+// 依次唤醒已经从等待队列中取出的等待者
+static void wake_all(FiberWaitQueue& woken) {
+    while (FiberWaiter* waiter = woken.pop()) {
+        FiberWaitQueue::Wake(waiter);
+    }
+}
+
+void FiberMutex::lockSlow() {
+    FiberWaiter waiter;
+    while (true) {
+        FiberWaitQueue::Prepare(&waiter);
+
+        m_queueLock.lock();
+        // 标记为有等待者再检查：解锁者看到CONTENDED时一定会来队列里唤醒
+        if (m_state.exchange(CONTENDED, std::memory_order_acquire) == UNLOCKED) {
+            m_queueLock.unlock();
+            return;
+        }
+        m_queue.push(&waiter);
+        m_queueLock.unlock();
+
+        // 被唤醒以后重新竞争，失败就再排一次队
+        FiberWaitQueue::Wait(&waiter);
+    }
+}
+
+void FiberMutex::unlockSlow() {
+    m_queueLock.lock();
+    FiberWaiter* waiter = m_queue.pop();
+    m_queueLock.unlock();
+
+    if (waiter) {
+        FiberWaitQueue::Wake(waiter);
+    }
+}
+
+void FiberCondVar::wait(std::unique_lock<FiberMutex>& lock) {
+    FiberWaiter waiter;
+    FiberWaitQueue::Prepare(&waiter);
+
+    m_queueLock.lock();
+    m_queue.push(&waiter);
+    m_waiters.store(m_waiters.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    m_queueLock.unlock();
+
+    lock.unlock();
+    FiberWaitQueue::Wait(&waiter);
+    lock.lock();
+}
+
+void FiberCondVar::notify_one() {
+    if (m_waiters.load(std::memory_order_relaxed) == 0) {
+        return;
+    }
+
+    m_queueLock.lock();
+    FiberWaiter* waiter = m_queue.pop();
+    if (waiter) {
+        m_waiters.store(m_waiters.load(std::memory_order_relaxed) - 1, std::memory_order_relaxed);
+    }
+    m_queueLock.unlock();
+
+    if (waiter) {
+        FiberWaitQueue::Wake(waiter);
+    }
+}
+
+void FiberCondVar::notify_all() {
+    if (m_waiters.load(std::memory_order_relaxed) == 0) {
+        return;
+    }
+
+    FiberWaitQueue woken;
+    m_queueLock.lock();
+    std::swap(woken, m_queue);
+    m_waiters.store(0, std::memory_order_relaxed);
+    m_queueLock.unlock();
+
+    wake_all(woken);
+}
+
+void FiberSemaphore::acquireSlow() {
+    FiberWaiter waiter;
+    FiberWaitQueue::Prepare(&waiter);
+
+    m_queueLock.lock();
+    // 先登记再检查计数，和release()中先加计数再检查等待者配对，两边至少有一边能看到对方
+    m_waiters.fetch_add(1, std::memory_order_seq_cst);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (try_acquire()) {
+        m_waiters.fetch_sub(1, std::memory_order_relaxed);
+        m_queueLock.unlock();
+        return;
+    }
+    m_queue.push(&waiter);
+    m_queueLock.unlock();
+
+    // 唤醒时许可已经转交给本等待者
+    FiberWaitQueue::Wait(&waiter);
+}
+
+void FiberSemaphore::release(int64_t n) {
+    m_count.fetch_add(n, std::memory_order_seq_cst);
+    if (m_waiters.load(std::memory_order_seq_cst) == 0) {
+        return;
+    }
+
+    FiberWaitQueue woken;
+    m_queueLock.lock();
+    while (!m_queue.empty() && try_acquire()) {
+        woken.push(m_queue.pop());
+        m_waiters.fetch_sub(1, std::memory_order_relaxed);
+    }
+    m_queueLock.unlock();
+
+    wake_all(woken);
+}
+
+void FiberLatch::count_down(int64_t n) {
+    if (m_count.fetch_sub(n, std::memory_order_acq_rel) - n > 0) {
+        return;
+    }
+
+    FiberWaitQueue woken;
+    m_queueLock.lock();
+    std::swap(woken, m_queue);
+    m_queueLock.unlock();
+
+    wake_all(woken);
+}
+
+void FiberLatch::wait() {
+    if (try_wait()) {
+        return;
+    }
+
+    FiberWaiter waiter;
+    FiberWaitQueue::Prepare(&waiter);
+
+    m_queueLock.lock();
+    if (try_wait()) {
+        m_queueLock.unlock();
+        return;
+    }
+    m_queue.push(&waiter);
+    m_queueLock.unlock();
+
+    FiberWaitQueue::Wait(&waiter);
+}
+
+void FiberRWMutex::lockSlow() {
+    FiberWaiter waiter;
+    FiberWaitQueue::Prepare(&waiter);
+
+    m_queueLock.lock();
+    // 先登记再重试，和解锁时先放锁再检查等待者配对
+    m_waiters.fetch_add(1, std::memory_order_seq_cst);
+    m_writersWaiting.fetch_add(1, std::memory_order_seq_cst);
+    int32_t expected = 0;
+    if (m_state.compare_exchange_strong(expected, kWriter, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+        m_waiters.fetch_sub(1, std::memory_order_relaxed);
+        m_writersWaiting.fetch_sub(1, std::memory_order_relaxed);
+        m_queueLock.unlock();
+        return;
+    }
+    m_writers.push(&waiter);
+    m_queueLock.unlock();
+
+    // 唤醒时锁已经转交给本等待者
+    FiberWaitQueue::Wait(&waiter);
+}
+
+void FiberRWMutex::lockSharedSlow() {
+    FiberWaiter waiter;
+    FiberWaitQueue::Prepare(&waiter);
+
+    m_queueLock.lock();
+    m_waiters.fetch_add(1, std::memory_order_seq_cst);
+    if (m_writersWaiting.load(std::memory_order_relaxed) == 0) {
+        int32_t state = m_state.load(std::memory_order_seq_cst);
+        while (state >= 0) {
+            if (m_state.compare_exchange_weak(state, state + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+                m_waiters.fetch_sub(1, std::memory_order_relaxed);
+                m_queueLock.unlock();
+                return;
+            }
+        }
+    }
+    m_readers.push(&waiter);
+    m_queueLock.unlock();
+
+    FiberWaitQueue::Wait(&waiter);
+}
+
+void FiberRWMutex::unlock() {
+    m_state.store(0, std::memory_order_seq_cst);
+    if (m_waiters.load(std::memory_order_seq_cst) == 0) {
+        return;
+    }
+
+    FiberWaitQueue woken;
+    m_queueLock.lock();
+    handOff(woken);
+    m_queueLock.unlock();
+
+    wake_all(woken);
+}
+
+void FiberRWMutex::unlock_shared() {
+    // 只有最后一个读者负责转交
+    if (m_state.fetch_sub(1, std::memory_order_seq_cst) != 1) {
+        return;
+    }
+    if (m_waiters.load(std::memory_order_seq_cst) == 0) {
+        return;
+    }
+
+    FiberWaitQueue woken;
+    m_queueLock.lock();
+    handOff(woken);
+    m_queueLock.unlock();
+
+    wake_all(woken);
+}
+
+void FiberRWMutex::handOff(FiberWaitQueue& woken) {
+    // 有写者排队时只交给写者；锁被其他人抢先拿走时由它们解锁时再转交
+    if (!m_writers.empty()) {
+        int32_t expected = 0;
+        if (m_state.compare_exchange_strong(expected, kWriter, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+            woken.push(m_writers.pop());
+            m_writersWaiting.fetch_sub(1, std::memory_order_relaxed);
+            m_waiters.fetch_sub(1, std::memory_order_relaxed);
+        }
+        return;
+    }
+
+    // 没有写者，放行所有排队的读者
+    while (!m_readers.empty()) {
+        int32_t state = m_state.load(std::memory_order_relaxed);
+        if (state < 0) {
+            break;
+        }
+        if (m_state.compare_exchange_weak(state, state + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+            woken.push(m_readers.pop());
+            m_waiters.fetch_sub(1, std::memory_order_relaxed);
+        }
+    }
+}
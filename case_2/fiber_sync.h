@@ -0,0 +1,265 @@
+#ifndef _FIBER_SYNC_H_
+#define _FIBER_SYNC_H_
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <sched.h>
+
+#include "coroutine.h"
+
+class Scheduler;
+
+// 协程同步原语
+    // 竞争时把当前协程挂进等待队列然后yield，唤醒时通过Scheduler::scheduleLock重新投递，不阻塞工作线程
+    // 不在调度器协程中的调用者（普通线程、调度协程自己）退化为在futex上阻塞线程
+    // 无竞争时加锁/解锁只有一次原子操作；等待队列用自旋锁保护，临界区只有几条指令
+    // 接口名和标准库保持一致（lock/unlock/try_lock等），可以直接配合std::lock_guard、std::unique_lock使用
+
+// 等待者，放在等待方的栈上
+struct FiberWaiter {
+    // 等待的协程和它所属的调度器，普通线程等待时为空
+    Fiber::ptr fiber;
+    Scheduler* scheduler = nullptr;
+    // fiber为空而scheduler非空时，唤醒时把callback投递到scheduler（C++20协程的恢复，见co_task.h），不调用Wait()
+    UniqueFunction callback;
+    // 普通线程等待时的futex字，唤醒者置1
+    std::atomic<uint32_t> ready{0};
+
+    FiberWaiter* next = nullptr;
+};
+
+// 等待队列：先进先出，自己不加锁，由使用者在持有自旋锁时操作
+class FiberWaitQueue {
+public:
+    bool empty() const {return m_head == nullptr;}
+
+    void push(FiberWaiter* waiter);
+    FiberWaiter* pop();
+
+    // 挂起当前协程或线程，直到waiter被Wake()；调用前waiter已经入队，并且已经释放了保护队列的锁
+    static void Wait(FiberWaiter* waiter);
+
+    // 初始化waiter：在调度器协程中记录当前协程，否则准备在futex上等待
+    static void Prepare(FiberWaiter* waiter);
+
+    // 唤醒一个已经出队的等待者，调用之后不能再访问waiter
+    static void Wake(FiberWaiter* waiter);
+
+private:
+    FiberWaiter* m_head = nullptr;
+    FiberWaiter* m_tail = nullptr;
+};
+
+// 保护等待队列的自旋锁，自旋一段时间后让出线程
+class FiberSpinLock {
+public:
+    void lock() {
+        for (int spins = 0; m_flag.exchange(true, std::memory_order_acquire); spins++) {
+            if (spins > 64) {
+                sched_yield();
+            }
+        }
+    }
+
+    void unlock() {
+        m_flag.store(false, std::memory_order_release);
+    }
+
+private:
+    std::atomic<bool> m_flag{false};
+};
+
+// 互斥锁，不可重入
+class FiberMutex {
+public:
+    FiberMutex() {}
+    FiberMutex(const FiberMutex&) = delete;
+    FiberMutex& operator=(const FiberMutex&) = delete;
+
+    void lock() {
+        uint32_t expected = UNLOCKED;
+        if (m_state.compare_exchange_strong(expected, LOCKED, std::memory_order_acquire, std::memory_order_relaxed)) {
+            return;
+        }
+        lockSlow();
+    }
+
+    bool try_lock() {
+        uint32_t expected = UNLOCKED;
+        return m_state.compare_exchange_strong(expected, LOCKED, std::memory_order_acquire, std::memory_order_relaxed);
+    }
+
+    void unlock() {
+        if (m_state.exchange(UNLOCKED, std::memory_order_release) == CONTENDED) {
+            unlockSlow();
+        }
+    }
+
+private:
+    void lockSlow();
+    void unlockSlow();
+
+private:
+    // CONTENDED：已加锁并且可能有等待者，解锁时需要唤醒
+    enum State : uint32_t {
+        UNLOCKED = 0,
+        LOCKED = 1,
+        CONTENDED = 2
+    };
+
+    std::atomic<uint32_t> m_state{UNLOCKED};
+    FiberSpinLock m_queueLock;
+    FiberWaitQueue m_queue;
+};
+
+// 条件变量，配合FiberMutex使用
+class FiberCondVar {
+public:
+    FiberCondVar() {}
+    FiberCondVar(const FiberCondVar&) = delete;
+    FiberCondVar& operator=(const FiberCondVar&) = delete;
+
+    // 先进入等待队列再释放锁，notify不会丢失；可能被虚假唤醒，调用者应当在循环中检查条件
+    void wait(std::unique_lock<FiberMutex>& lock);
+
+    template<typename Predicate>
+    void wait(std::unique_lock<FiberMutex>& lock, Predicate pred) {
+        while (!pred()) {
+            wait(lock);
+        }
+    }
+
+    void notify_one();
+    void notify_all();
+
+private:
+    // 没有等待者时notify只读一次这个计数
+    std::atomic<uint32_t> m_waiters{0};
+    FiberSpinLock m_queueLock;
+    FiberWaitQueue m_queue;
+};
+
+// 计数信号量
+class FiberSemaphore {
+public:
+    explicit FiberSemaphore(int64_t count = 0): m_count(count) {}
+    FiberSemaphore(const FiberSemaphore&) = delete;
+    FiberSemaphore& operator=(const FiberSemaphore&) = delete;
+
+    void acquire() {
+        if (!try_acquire()) {
+            acquireSlow();
+        }
+    }
+
+    bool try_acquire() {
+        int64_t count = m_count.load(std::memory_order_relaxed);
+        while (count > 0) {
+            if (m_count.compare_exchange_weak(count, count - 1, std::memory_order_acquire, std::memory_order_relaxed)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // 归还n个许可，有等待者时直接转交给它们
+    void release(int64_t n = 1);
+
+private:
+    void acquireSlow();
+
+private:
+    std::atomic<int64_t> m_count;
+    // 排队中的等待者数，release()据此决定是否需要进入慢路径
+    std::atomic<uint32_t> m_waiters{0};
+    FiberSpinLock m_queueLock;
+    FiberWaitQueue m_queue;
+};
+
+// 一次性的倒数门闩
+class FiberLatch {
+public:
+    explicit FiberLatch(int64_t count): m_count(count) {}
+    FiberLatch(const FiberLatch&) = delete;
+    FiberLatch& operator=(const FiberLatch&) = delete;
+
+    // 计数减n，减到0时唤醒所有等待者
+    void count_down(int64_t n = 1);
+
+    bool try_wait() const {
+        return m_count.load(std::memory_order_acquire) <= 0;
+    }
+
+    // 等待计数减到0
+    void wait();
+
+    void arrive_and_wait(int64_t n = 1) {
+        count_down(n);
+        wait();
+    }
+
+private:
+    std::atomic<int64_t> m_count;
+    FiberSpinLock m_queueLock;
+    FiberWaitQueue m_queue;
+};
+
+// 读写锁，写者优先：有写者排队时新的读者不再进入
+class FiberRWMutex {
+public:
+    FiberRWMutex() {}
+    FiberRWMutex(const FiberRWMutex&) = delete;
+    FiberRWMutex& operator=(const FiberRWMutex&) = delete;
+
+    void lock() {
+        int32_t expected = 0;
+        if (m_state.compare_exchange_strong(expected, kWriter, std::memory_order_acquire, std::memory_order_relaxed)) {
+            return;
+        }
+        lockSlow();
+    }
+
+    bool try_lock() {
+        int32_t expected = 0;
+        return m_state.compare_exchange_strong(expected, kWriter, std::memory_order_acquire, std::memory_order_relaxed);
+    }
+
+    void unlock();
+
+    void lock_shared() {
+        if (!try_lock_shared()) {
+            lockSharedSlow();
+        }
+    }
+
+    bool try_lock_shared() {
+        if (m_writersWaiting.load(std::memory_order_relaxed) > 0) {
+            return false;
+        }
+        int32_t state = m_state.load(std::memory_order_relaxed);
+        return state >= 0 && m_state.compare_exchange_strong(state, state + 1, std::memory_order_acquire, std::memory_order_relaxed);
+    }
+
+    void unlock_shared();
+
+private:
+    void lockSlow();
+    void lockSharedSlow();
+    // 锁空出来以后按写者优先转交给排队的等待者
+        // 调用时持有m_queueLock，拿到锁的等待者放进woken，释放m_queueLock以后再唤醒
+    void handOff(FiberWaitQueue& woken);
+
+private:
+    static const int32_t kWriter = -1;
+
+    // 读者数，写者持有时为kWriter
+    std::atomic<int32_t> m_state{0};
+    std::atomic<uint32_t> m_waiters{0};
+    std::atomic<uint32_t> m_writersWaiting{0};
+    FiberSpinLock m_queueLock;
+    FiberWaitQueue m_readers;
+    FiberWaitQueue m_writers;
+};
+
+#endif
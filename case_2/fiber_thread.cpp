@@ -1,10 +1,22 @@
+#include <pthread.h>
+
 #include "fiber_thread.h"
+#include "numa_topology.h"
 
-static thread_local std::atomic<int> s_working_thread_id{1};
+// 进程内所有线程共用：动态线程池在控制线程上创建工作线程，id不能和调度器所在线程创建的重复
+static std::atomic<int> s_working_thread_id{1};
 
-Thread::Thread(std::function<void()> cb, const std::string & name) : m_name(name){
+Thread::Thread(std::function<void()> cb, const std::string & name, const std::vector<int>& cpus) : m_name(name), m_cpus(cpus){
     m_thread_id = s_working_thread_id++;
-    m_thread = std::thread([this, cb]() {Scheduler::SetThreadId(this->m_thread_id); cb();});
+    m_thread = std::thread([this, cb]() {
+        // 系统线程名最长15个字符
+        pthread_setname_np(pthread_self(), m_name.substr(0, 15).c_str());
+        if (!m_cpus.empty()) {
+            NumaTopology::BindCurrentThread(m_cpus);
+        }
+        Scheduler::SetThreadId(this->m_thread_id);
+        cb();
+    });
 }
 
 Thread::~Thread() {
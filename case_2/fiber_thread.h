@@ -6,15 +6,18 @@
 #include <thread>
 #include <atomic>
 #include <memory>
+#include <vector>
 #include <iostream>
 
 #include "scheduler.h"
+#include "log.h"
 
 class Scheduler;
 
 class Thread : public std::enable_shared_from_this<Thread> {
 public:
-    Thread(std::function<void()> cb, const std::string & name);
+    // 线程启动后先用name设置系统线程名（超过15个字符截断），cpus不为空时绑定到这些CPU，再执行cb
+    Thread(std::function<void()> cb, const std::string & name, const std::vector<int>& cpus = {});
     ~Thread();
 
     int getId() const {
@@ -25,12 +28,14 @@ public:
         if (m_thread.joinable()) {
             m_thread.join();
         }
-        std::cout << "thread: " << m_thread_id << " is finished\n";
+        FIBER_LOG_TRACE("thread: %d is finished", m_thread_id);
     }
 
 private:
     // 线程名称
     std::string m_name;
+    // 绑定的CPU，为空时不绑定
+    std::vector<int> m_cpus;
     // 线程id
     int m_thread_id;
     // 线程对象
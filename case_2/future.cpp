@@ -0,0 +1,71 @@
+#include "future.h"
+
+void FutureStateBase::wait() {
+    if (ready()) {
+        return;
+    }
+
+    FiberWaiter waiter;
+    FiberWaitQueue::Prepare(&waiter);
+
+    m_lock.lock();
+    if (ready()) {
+        m_lock.unlock();
+        return;
+    }
+    m_waiters.push(&waiter);
+    m_lock.unlock();
+
+    FiberWaitQueue::Wait(&waiter);
+}
+
+void FutureStateBase::onReady(UniqueFunction cb) {
+    m_lock.lock();
+    if (!ready()) {
+        m_callbacks.push_back(std::move(cb));
+        m_lock.unlock();
+        return;
+    }
+    m_lock.unlock();
+
+    cb();
+}
+
+void FutureStateBase::claim() {
+    if (m_claimed.exchange(true, std::memory_order_acq_rel)) {
+        throw std::future_error(std::future_errc::promise_already_satisfied);
+    }
+}
+
+void FutureStateBase::setException(std::exception_ptr e) {
+    claim();
+    m_exception = e;
+    markReady();
+}
+
+void FutureStateBase::abandon() {
+    if (m_claimed.exchange(true, std::memory_order_acq_rel)) {
+        return;
+    }
+    m_exception = std::make_exception_ptr(std::future_error(std::future_errc::broken_promise));
+    markReady();
+}
+
+void FutureStateBase::markReady() {
+    FiberWaitQueue woken;
+    std::vector<UniqueFunction> callbacks;
+
+    m_lock.lock();
+    m_ready.store(true, std::memory_order_release);
+    std::swap(woken, m_waiters);
+    callbacks.swap(m_callbacks);
+    m_lock.unlock();
+
+    while (FiberWaiter* waiter = woken.pop()) {
+        FiberWaitQueue::Wake(waiter);
+    }
+    // 回调可能释放最后一个持有本状态的引用，之后不能再访问成员
+    for (UniqueFunction& cb : callbacks) {
+        cb();
+    }
+}
@@ -0,0 +1,297 @@
+#ifndef _FUTURE_H_
+#define _FUTURE_H_
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <exception>
+#include <future>
+#include <memory>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "fiber_sync.h"
+#include "unique_function.h"
+
+// Future/Promise
+    // Future::get()在调度器协程中挂起当前协程直到结果就绪，在普通线程中阻塞在futex上（等待方式同fiber_sync.h）
+    // 任务抛出的异常保存在共享状态中，get()时重新抛出；Promise没有设置结果就析构时get()抛出std::future_error(broken_promise)
+    // 就绪时先唤醒所有等待者，再在设置结果的线程上依次运行注册的回调，when_all/when_any用回调实现，不占用线程等待
+    // Future只能移动，get()只能调用一次
+
+// 和结果类型无关的部分：就绪标记、异常、等待队列、回调
+class FutureStateBase {
+public:
+    virtual ~FutureStateBase() {}
+
+    bool ready() const {return m_ready.load(std::memory_order_acquire);}
+
+    // 等待就绪
+    void wait();
+
+    // 就绪时在设置结果的线程上运行cb，已经就绪时立即在当前线程上运行
+    void onReady(UniqueFunction cb);
+
+    // 重复设置时抛出std::future_error(promise_already_satisfied)
+    void setException(std::exception_ptr e);
+
+    // Promise没有设置结果就析构，等待者收到broken_promise；已经设置过则什么也不做
+    void abandon();
+
+    // get()就绪以后调用，有异常时抛出
+    void rethrow() {
+        if (m_exception) {
+            std::rethrow_exception(m_exception);
+        }
+    }
+
+protected:
+    // 写结果之前调用，保证结果只被写一次，重复设置时抛出promise_already_satisfied
+    void claim();
+
+    // 调用者已经写好了结果，置为就绪，唤醒等待者、运行回调
+    void markReady();
+
+private:
+    std::atomic<bool> m_ready{false};
+    // 已经有人开始写结果
+    std::atomic<bool> m_claimed{false};
+    std::exception_ptr m_exception;
+
+    FiberSpinLock m_lock;
+    FiberWaitQueue m_waiters;
+    std::vector<UniqueFunction> m_callbacks;
+};
+
+template<typename T>
+class FutureState : public FutureStateBase {
+public:
+    typedef std::shared_ptr<FutureState> ptr;
+
+    template<typename... Args>
+    void setValue(Args&&... args) {
+        claim();
+        m_value.emplace(std::forward<Args>(args)...);
+        markReady();
+    }
+
+    T take() {
+        return std::move(*m_value);
+    }
+
+private:
+    std::optional<T> m_value;
+};
+
+template<>
+class FutureState<void> : public FutureStateBase {
+public:
+    typedef std::shared_ptr<FutureState> ptr;
+
+    void setValue() {
+        claim();
+        markReady();
+    }
+
+    void take() {}
+};
+
+template<typename T>
+class Promise;
+
+template<typename T>
+class Future {
+public:
+    typedef T value_type;
+
+    Future() {}
+    Future(Future&&) = default;
+    Future& operator=(Future&&) = default;
+    Future(const Future&) = delete;
+    Future& operator=(const Future&) = delete;
+
+    // 是否关联了共享状态，get()之后变为false
+    bool valid() const {return m_state != nullptr;}
+    bool ready() const {return m_state && m_state->ready();}
+
+    void wait() const {
+        assert(m_state);
+        m_state->wait();
+    }
+
+    // 等待并取出结果，有异常时抛出
+    T get() {
+        assert(m_state);
+        typename FutureState<T>::ptr state = std::move(m_state);
+        state->wait();
+        state->rethrow();
+        return state->take();
+    }
+
+    // 就绪时运行cb，用于组合多个Future
+    void onReady(UniqueFunction cb) {
+        assert(m_state);
+        m_state->onReady(std::move(cb));
+    }
+
+    // 返回一个已经就绪的Future
+    template<typename... Args>
+    static Future MakeReady(Args&&... args) {
+        Promise<T> promise;
+        Future future = promise.getFuture();
+        promise.setValue(std::forward<Args>(args)...);
+        return future;
+    }
+
+private:
+    friend class Promise<T>;
+
+    explicit Future(typename FutureState<T>::ptr state): m_state(std::move(state)) {}
+
+private:
+    typename FutureState<T>::ptr m_state;
+};
+
+template<typename T>
+class Promise {
+public:
+    Promise(): m_state(std::make_shared<FutureState<T>>()) {}
+    Promise(Promise&&) = default;
+    Promise& operator=(Promise&& other) {
+        if (this != &other) {
+            abandon();
+            m_state = std::move(other.m_state);
+            m_retrieved = other.m_retrieved;
+        }
+        return *this;
+    }
+    Promise(const Promise&) = delete;
+    Promise& operator=(const Promise&) = delete;
+
+    ~Promise() {
+        abandon();
+    }
+
+    // 只能调用一次
+    Future<T> getFuture() {
+        assert(m_state && !m_retrieved);
+        m_retrieved = true;
+        return Future<T>(m_state);
+    }
+
+    template<typename... Args>
+    void setValue(Args&&... args) {
+        m_state->setValue(std::forward<Args>(args)...);
+    }
+
+    void setException(std::exception_ptr e) {
+        m_state->setException(e);
+    }
+
+    // 运行f，把返回值或者抛出的异常写入共享状态
+    template<typename F>
+    void setFrom(F& f) {
+        try {
+            if constexpr (std::is_void<T>::value) {
+                f();
+                setValue();
+            } else {
+                setValue(f());
+            }
+        } catch (...) {
+            setException(std::current_exception());
+        }
+    }
+
+private:
+    void abandon() {
+        if (m_state) {
+            m_state->abandon();
+        }
+        m_state.reset();
+    }
+
+private:
+    typename FutureState<T>::ptr m_state;
+    bool m_retrieved = false;
+};
+
+template<typename T>
+struct WhenAnyResult {
+    // 第一个就绪的Future的下标，输入为空时为SIZE_MAX
+    size_t index = SIZE_MAX;
+    std::vector<Future<T>> futures;
+};
+
+// 所有输入都就绪时就绪，结果为原样交还的输入，各自的值和异常通过get()取出
+template<typename T>
+Future<std::vector<Future<T>>> when_all(std::vector<Future<T>> futures) {
+    struct Context {
+        Promise<std::vector<Future<T>>> promise;
+        std::vector<Future<T>> futures;
+        // 多计一次，所有回调注册完以后再减掉，避免注册过程中就完成
+        std::atomic<size_t> remaining{0};
+    };
+
+    std::shared_ptr<Context> ctx = std::make_shared<Context>();
+    Future<std::vector<Future<T>>> result = ctx->promise.getFuture();
+    ctx->futures = std::move(futures);
+    ctx->remaining.store(ctx->futures.size() + 1, std::memory_order_relaxed);
+
+    auto arrive = [](const std::shared_ptr<Context>& c) {
+        if (c->remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            c->promise.setValue(std::move(c->futures));
+        }
+    };
+    for (Future<T>& future : ctx->futures) {
+        future.onReady([ctx, arrive]() {arrive(ctx);});
+    }
+    arrive(ctx);
+    return result;
+}
+
+// 任意一个输入就绪时就绪，结果中记录它的下标，并交还所有输入
+template<typename T>
+Future<WhenAnyResult<T>> when_any(std::vector<Future<T>> futures) {
+    struct Context {
+        Promise<WhenAnyResult<T>> promise;
+        std::vector<Future<T>> futures;
+        std::atomic<bool> done{false};
+        std::atomic<size_t> first{SIZE_MAX};
+        // 第一个就绪的输入和注册回调的过程都结束以后才能交还输入
+        std::atomic<int> pending{2};
+    };
+
+    std::shared_ptr<Context> ctx = std::make_shared<Context>();
+    Future<WhenAnyResult<T>> result = ctx->promise.getFuture();
+    ctx->futures = std::move(futures);
+
+    if (ctx->futures.empty()) {
+        ctx->promise.setValue(WhenAnyResult<T>());
+        return result;
+    }
+
+    // 两者中较晚结束的一方设置结果
+    auto finish = [](const std::shared_ptr<Context>& c) {
+        if (c->pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            WhenAnyResult<T> any;
+            any.index = c->first.load(std::memory_order_relaxed);
+            any.futures = std::move(c->futures);
+            c->promise.setValue(std::move(any));
+        }
+    };
+    for (size_t i = 0; i < ctx->futures.size(); i++) {
+        ctx->futures[i].onReady([ctx, finish, i]() {
+            if (!ctx->done.exchange(true, std::memory_order_acq_rel)) {
+                ctx->first.store(i, std::memory_order_relaxed);
+                finish(ctx);
+            }
+        });
+    }
+    finish(ctx);
+    return result;
+}
+
+#endif
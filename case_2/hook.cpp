@@ -0,0 +1,479 @@
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <sys/ioctl.h>
+#include <chrono>
+
+#include "hook.h"
+#include "fd_manager.h"
+#include "iomanager.h"
+
+// 当前线程是否开启hook
+static thread_local bool t_hook_enable = false;
+
+#define HOOK_FUN(XX) \
+    XX(sleep) \
+    XX(usleep) \
+    XX(nanosleep) \
+    XX(socket) \
+    XX(connect) \
+    XX(accept) \
+    XX(read) \
+    XX(readv) \
+    XX(recv) \
+    XX(recvfrom) \
+    XX(recvmsg) \
+    XX(write) \
+    XX(writev) \
+    XX(send) \
+    XX(sendto) \
+    XX(sendmsg) \
+    XX(close) \
+    XX(fcntl) \
+    XX(ioctl) \
+    XX(setsockopt)
+
+// 取得被hook的原函数
+static void hook_init() {
+    static bool is_inited = false;
+    if (is_inited) {
+        return;
+    }
+    is_inited = true;
+
+#define XX(name) name ## _f = (name ## _fun)dlsym(RTLD_NEXT, #name);
+    HOOK_FUN(XX);
+#undef XX
+}
+
+// 在main()之前取得原函数
+struct HookIniter {
+    HookIniter() {
+        hook_init();
+    }
+};
+
+static HookIniter s_hook_initer;
+
+bool is_hook_enable() {
+    return t_hook_enable;
+}
+
+void set_hook_enable(bool flag) {
+    t_hook_enable = flag;
+}
+
+static uint64_t now_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// 当前是否可以挂起协程代替阻塞：开启了hook，运行在IOManager中，并且不在调度协程里
+static bool can_yield() {
+    if (!t_hook_enable || IOManager::GetThis() == nullptr) {
+        return false;
+    }
+    return Fiber::GetThis().get() != Scheduler::GetSchedulerFiber();
+}
+
+// 一次等待的结果，事件和超时谁先到谁把state从WAITING改掉
+    // 协程只有在自己改成READY以后才会重新等待，所以过期的超时回调不会取消下一次等待
+enum WaitState {
+    WAITING = 0,
+    READY = 1,
+    TIMEDOUT = 2
+};
+
+// 挂起当前协程直到fd上的事件就绪，timeout_ms为-1时不超时
+    // 就绪返回0，超时返回-1并设置errno为ETIMEDOUT
+    // 超时由一个定时器实现，定时器到期时取消fd上的事件，把协程唤醒
+static int wait_event(IOManager* iom, int fd, IOManager::Event event, uint64_t timeout_ms) {
+    if (iom->addEvent(fd, event)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    auto state = std::make_shared<std::atomic<int>>(WAITING);
+    Timer::ptr timer;
+    if (timeout_ms != (uint64_t)-1) {
+        timer = iom->addTimer(timeout_ms, [state, iom, fd, event]() {
+            int expected = WAITING;
+            if (state->compare_exchange_strong(expected, TIMEDOUT)) {
+                iom->cancelEvent(fd, event);
+            }
+        });
+    }
+
+    Fiber::GetThis()->yield();
+
+    if (timer) {
+        timer->cancel();
+    }
+
+    int expected = WAITING;
+    if (!state->compare_exchange_strong(expected, READY)) {
+        errno = ETIMEDOUT;
+        return -1;
+    }
+    return 0;
+}
+
+// 挂起当前协程一段时间
+static void fiber_sleep(const struct timespec& ts) {
+    IOManager* iom = IOManager::GetThis();
+    Fiber::ptr fiber = Fiber::GetThis();
+
+    // 时长为0时只让出一次
+    if (ts.tv_sec == 0 && ts.tv_nsec == 0) {
+        iom->scheduleLock(fiber);
+    } else {
+        auto timeout = std::chrono::seconds(ts.tv_sec) + std::chrono::nanoseconds(ts.tv_nsec);
+        iom->addTimer(timeout, [iom, fiber]() {
+            iom->scheduleLock(fiber);
+        });
+    }
+
+    Fiber* raw_ptr = fiber.get();
+    fiber.reset();
+    raw_ptr->yield();
+}
+
+// 读写类调用的通用实现
+    // socket已经被设置为非阻塞，调用返回EAGAIN时注册事件并挂起协程，就绪后重试
+    // timeout_so为SO_RCVTIMEO或SO_SNDTIMEO，超时从调用开始计算，和内核一样超时返回EAGAIN
+template<typename OriginFun, typename... Args>
+static ssize_t do_io(int fd, OriginFun fun, IOManager::Event event, int timeout_so, Args&&... args) {
+    if (!can_yield()) {
+        return fun(fd, std::forward<Args>(args)...);
+    }
+
+    FdCtx::ptr ctx = FdManager::GetInstance()->get(fd);
+    if (!ctx) {
+        return fun(fd, std::forward<Args>(args)...);
+    }
+
+    if (ctx->isClosed()) {
+        errno = EBADF;
+        return -1;
+    }
+
+    // 不是socket，或者用户自己要求非阻塞
+    if (!ctx->isSocket() || ctx->getUserNonblock()) {
+        return fun(fd, std::forward<Args>(args)...);
+    }
+
+    uint64_t timeout = ctx->getTimeout(timeout_so);
+    uint64_t deadline = timeout == (uint64_t)-1 ? (uint64_t)-1 : now_ms() + timeout;
+
+    while (true) {
+        ssize_t n = fun(fd, args...);
+        while (n == -1 && errno == EINTR) {
+            n = fun(fd, args...);
+        }
+        if (n != -1 || errno != EAGAIN) {
+            return n;
+        }
+
+        uint64_t remain = (uint64_t)-1;
+        if (deadline != (uint64_t)-1) {
+            uint64_t now = now_ms();
+            if (now >= deadline) {
+                errno = EAGAIN;
+                return -1;
+            }
+            remain = deadline - now;
+        }
+
+        if (wait_event(IOManager::GetThis(), fd, event, remain) != 0) {
+            if (errno == ETIMEDOUT) {
+                errno = EAGAIN;
+            }
+            return -1;
+        }
+
+        // 等待期间fd被关闭
+        if (ctx->isClosed()) {
+            errno = EBADF;
+            return -1;
+        }
+    }
+}
+
+extern "C" {
+
+#define XX(name) name ## _fun name ## _f = nullptr;
+    HOOK_FUN(XX);
+#undef XX
+
+// sleep
+unsigned int sleep(unsigned int seconds) {
+    if (!can_yield()) {
+        return sleep_f(seconds);
+    }
+
+    struct timespec ts = {(time_t)seconds, 0};
+    fiber_sleep(ts);
+    return 0;
+}
+
+int usleep(useconds_t usec) {
+    if (!can_yield()) {
+        return usleep_f(usec);
+    }
+
+    struct timespec ts = {(time_t)(usec / 1000000), (long)(usec % 1000000) * 1000};
+    fiber_sleep(ts);
+    return 0;
+}
+
+int nanosleep(const struct timespec* req, struct timespec* rem) {
+    // 参数不合法时由原函数返回EINVAL
+    if (!can_yield() || req == nullptr || req->tv_sec < 0 || req->tv_nsec < 0 || req->tv_nsec >= 1000000000) {
+        return nanosleep_f(req, rem);
+    }
+
+    fiber_sleep(*req);
+    if (rem) {
+        rem->tv_sec = 0;
+        rem->tv_nsec = 0;
+    }
+    return 0;
+}
+
+// socket
+int socket(int domain, int type, int protocol) {
+    if (!t_hook_enable) {
+        return socket_f(domain, type, protocol);
+    }
+
+    int fd = socket_f(domain, type, protocol);
+    if (fd >= 0) {
+        FdManager::GetInstance()->get(fd, true);
+    }
+    return fd;
+}
+
+int connect_with_timeout(int fd, const struct sockaddr* addr, socklen_t addrlen, uint64_t timeout_ms) {
+    if (!can_yield()) {
+        return connect_f(fd, addr, addrlen);
+    }
+
+    FdCtx::ptr ctx = FdManager::GetInstance()->get(fd);
+    if (!ctx || ctx->isClosed()) {
+        errno = EBADF;
+        return -1;
+    }
+
+    if (!ctx->isSocket() || ctx->getUserNonblock()) {
+        return connect_f(fd, addr, addrlen);
+    }
+
+    int n = connect_f(fd, addr, addrlen);
+    if (n == 0) {
+        return 0;
+    } else if (n != -1 || errno != EINPROGRESS) {
+        return n;
+    }
+
+    // 连接建立或者失败时socket可写
+    if (wait_event(IOManager::GetThis(), fd, IOManager::WRITE, timeout_ms) != 0) {
+        return -1;
+    }
+
+    int error = 0;
+    socklen_t len = sizeof(int);
+    if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &len) == -1) {
+        return -1;
+    }
+    if (error) {
+        errno = error;
+        return -1;
+    }
+    return 0;
+}
+
+int connect(int sockfd, const struct sockaddr* addr, socklen_t addrlen) {
+    // 和Linux一样，connect的超时使用SO_SNDTIMEO
+    uint64_t timeout = (uint64_t)-1;
+    FdCtx::ptr ctx = FdManager::GetInstance()->get(sockfd);
+    if (ctx) {
+        timeout = ctx->getTimeout(SO_SNDTIMEO);
+    }
+    return connect_with_timeout(sockfd, addr, addrlen, timeout);
+}
+
+int accept(int s, struct sockaddr* addr, socklen_t* addrlen) {
+    int fd = do_io(s, accept_f, IOManager::READ, SO_RCVTIMEO, addr, addrlen);
+    if (fd >= 0 && t_hook_enable) {
+        FdManager::GetInstance()->get(fd, true);
+    }
+    return fd;
+}
+
+// read
+ssize_t read(int fd, void* buf, size_t count) {
+    return do_io(fd, read_f, IOManager::READ, SO_RCVTIMEO, buf, count);
+}
+
+ssize_t readv(int fd, const struct iovec* iov, int iovcnt) {
+    return do_io(fd, readv_f, IOManager::READ, SO_RCVTIMEO, iov, iovcnt);
+}
+
+ssize_t recv(int sockfd, void* buf, size_t len, int flags) {
+    return do_io(sockfd, recv_f, IOManager::READ, SO_RCVTIMEO, buf, len, flags);
+}
+
+ssize_t recvfrom(int sockfd, void* buf, size_t len, int flags, struct sockaddr* src_addr, socklen_t* addrlen) {
+    return do_io(sockfd, recvfrom_f, IOManager::READ, SO_RCVTIMEO, buf, len, flags, src_addr, addrlen);
+}
+
+ssize_t recvmsg(int sockfd, struct msghdr* msg, int flags) {
+    return do_io(sockfd, recvmsg_f, IOManager::READ, SO_RCVTIMEO, msg, flags);
+}
+
+// write
+ssize_t write(int fd, const void* buf, size_t count) {
+    return do_io(fd, write_f, IOManager::WRITE, SO_SNDTIMEO, buf, count);
+}
+
+ssize_t writev(int fd, const struct iovec* iov, int iovcnt) {
+    return do_io(fd, writev_f, IOManager::WRITE, SO_SNDTIMEO, iov, iovcnt);
+}
+
+ssize_t send(int s, const void* msg, size_t len, int flags) {
+    return do_io(s, send_f, IOManager::WRITE, SO_SNDTIMEO, msg, len, flags);
+}
+
+ssize_t sendto(int s, const void* msg, size_t len, int flags, const struct sockaddr* to, socklen_t tolen) {
+    return do_io(s, sendto_f, IOManager::WRITE, SO_SNDTIMEO, msg, len, flags, to, tolen);
+}
+
+ssize_t sendmsg(int s, const struct msghdr* msg, int flags) {
+    return do_io(s, sendmsg_f, IOManager::WRITE, SO_SNDTIMEO, msg, flags);
+}
+
+// fd
+int close(int fd) {
+    // 不管是否开启hook都要清理上下文，否则复用这个fd号的新fd会拿到旧的上下文
+    FdCtx::ptr ctx = FdManager::GetInstance()->get(fd);
+    if (ctx) {
+        ctx->setClosed();
+        IOManager* iom = IOManager::GetThis();
+        if (iom) {
+            iom->cancelAll(fd);
+        }
+        FdManager::GetInstance()->del(fd);
+    }
+    return close_f(fd);
+}
+
+int fcntl(int fd, int cmd, ... /* arg */) {
+    va_list va;
+    va_start(va, cmd);
+    switch (cmd) {
+        // 对用户隐藏hook层设置的O_NONBLOCK
+        case F_SETFL: {
+            int arg = va_arg(va, int);
+            va_end(va);
+            FdCtx::ptr ctx = FdManager::GetInstance()->get(fd);
+            if (!ctx || ctx->isClosed() || !ctx->isSocket()) {
+                return fcntl_f(fd, cmd, arg);
+            }
+            ctx->setUserNonblock(arg & O_NONBLOCK);
+            if (ctx->getSysNonblock()) {
+                arg |= O_NONBLOCK;
+            } else {
+                arg &= ~O_NONBLOCK;
+            }
+            return fcntl_f(fd, cmd, arg);
+        }
+        case F_GETFL: {
+            va_end(va);
+            int arg = fcntl_f(fd, cmd);
+            FdCtx::ptr ctx = FdManager::GetInstance()->get(fd);
+            if (arg == -1 || !ctx || ctx->isClosed() || !ctx->isSocket()) {
+                return arg;
+            }
+            if (ctx->getUserNonblock()) {
+                return arg | O_NONBLOCK;
+            }
+            return arg & ~O_NONBLOCK;
+        }
+        // 参数为int
+        case F_DUPFD:
+        case F_DUPFD_CLOEXEC:
+        case F_SETFD:
+        case F_SETOWN:
+        case F_SETSIG:
+        case F_SETLEASE:
+        case F_NOTIFY:
+#ifdef F_SETPIPE_SZ
+        case F_SETPIPE_SZ:
+#endif
+        {
+            int arg = va_arg(va, int);
+            va_end(va);
+            return fcntl_f(fd, cmd, arg);
+        }
+        // 没有参数
+        case F_GETFD:
+        case F_GETOWN:
+        case F_GETSIG:
+        case F_GETLEASE:
+#ifdef F_GETPIPE_SZ
+        case F_GETPIPE_SZ:
+#endif
+        {
+            va_end(va);
+            return fcntl_f(fd, cmd);
+        }
+        // 其余命令的参数为指针（F_SETLK、F_GETOWN_EX等）
+        default: {
+            void* arg = va_arg(va, void*);
+            va_end(va);
+            return fcntl_f(fd, cmd, arg);
+        }
+    }
+}
+
+int ioctl(int d, unsigned long int request, ...) {
+    va_list va;
+    va_start(va, request);
+    void* arg = va_arg(va, void*);
+    va_end(va);
+
+    if (request == FIONBIO) {
+        bool user_nonblock = !!*(int*)arg;
+        FdCtx::ptr ctx = FdManager::GetInstance()->get(d);
+        if (ctx && !ctx->isClosed() && ctx->isSocket()) {
+            ctx->setUserNonblock(user_nonblock);
+            // 内核中的socket保持非阻塞
+            if (ctx->getSysNonblock()) {
+                int on = 1;
+                return ioctl_f(d, request, &on);
+            }
+        }
+    }
+    return ioctl_f(d, request, arg);
+}
+
+int setsockopt(int sockfd, int level, int optname, const void* optval, socklen_t optlen) {
+    if (!t_hook_enable) {
+        return setsockopt_f(sockfd, level, optname, optval, optlen);
+    }
+
+    // 记录超时时间，socket本身是非阻塞的，内核的超时不会生效
+    if (level == SOL_SOCKET && (optname == SO_RCVTIMEO || optname == SO_SNDTIMEO)) {
+        FdCtx::ptr ctx = FdManager::GetInstance()->get(sockfd);
+        if (ctx && optval && optlen >= sizeof(struct timeval)) {
+            const struct timeval* v = (const struct timeval*)optval;
+            uint64_t ms = v->tv_sec * 1000 + v->tv_usec / 1000;
+            // 和SO_RCVTIMEO一样，0表示不超时
+            ctx->setTimeout(optname, ms == 0 ? (uint64_t)-1 : ms);
+        }
+    }
+    return setsockopt_f(sockfd, level, optname, optval, optlen);
+}
+
+}
@@ -0,0 +1,95 @@
+#ifndef _HOOK_H_
+#define _HOOK_H_
+
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+// 系统调用hook
+    // 本文件重新定义了下面这些libc函数，原函数通过dlsym(RTLD_NEXT, ...)取得，保存在xxx_f中
+    // 线程开启hook并且运行在IOManager的协程中时，会阻塞的调用被转换为"注册fd事件 + yield"，
+    // 只挂起当前协程而不阻塞线程；其他情况下直接调用原函数
+    // IOManager的工作线程默认开启hook，其他线程需要自己调用set_hook_enable(true)
+    // glibc 2.34之前的版本链接时需要加-ldl
+
+// 当前线程是否开启hook
+bool is_hook_enable();
+// 设置当前线程是否开启hook
+void set_hook_enable(bool flag);
+
+extern "C" {
+
+// sleep
+typedef unsigned int (*sleep_fun)(unsigned int seconds);
+extern sleep_fun sleep_f;
+
+typedef int (*usleep_fun)(useconds_t usec);
+extern usleep_fun usleep_f;
+
+typedef int (*nanosleep_fun)(const struct timespec* req, struct timespec* rem);
+extern nanosleep_fun nanosleep_f;
+
+// socket
+typedef int (*socket_fun)(int domain, int type, int protocol);
+extern socket_fun socket_f;
+
+typedef int (*connect_fun)(int sockfd, const struct sockaddr* addr, socklen_t addrlen);
+extern connect_fun connect_f;
+
+typedef int (*accept_fun)(int s, struct sockaddr* addr, socklen_t* addrlen);
+extern accept_fun accept_f;
+
+// read
+typedef ssize_t (*read_fun)(int fd, void* buf, size_t count);
+extern read_fun read_f;
+
+typedef ssize_t (*readv_fun)(int fd, const struct iovec* iov, int iovcnt);
+extern readv_fun readv_f;
+
+typedef ssize_t (*recv_fun)(int sockfd, void* buf, size_t len, int flags);
+extern recv_fun recv_f;
+
+typedef ssize_t (*recvfrom_fun)(int sockfd, void* buf, size_t len, int flags, struct sockaddr* src_addr, socklen_t* addrlen);
+extern recvfrom_fun recvfrom_f;
+
+typedef ssize_t (*recvmsg_fun)(int sockfd, struct msghdr* msg, int flags);
+extern recvmsg_fun recvmsg_f;
+
+// write
+typedef ssize_t (*write_fun)(int fd, const void* buf, size_t count);
+extern write_fun write_f;
+
+typedef ssize_t (*writev_fun)(int fd, const struct iovec* iov, int iovcnt);
+extern writev_fun writev_f;
+
+typedef ssize_t (*send_fun)(int s, const void* msg, size_t len, int flags);
+extern send_fun send_f;
+
+typedef ssize_t (*sendto_fun)(int s, const void* msg, size_t len, int flags, const struct sockaddr* to, socklen_t tolen);
+extern sendto_fun sendto_f;
+
+typedef ssize_t (*sendmsg_fun)(int s, const struct msghdr* msg, int flags);
+extern sendmsg_fun sendmsg_f;
+
+// fd
+typedef int (*close_fun)(int fd);
+extern close_fun close_f;
+
+typedef int (*fcntl_fun)(int fd, int cmd, ... /* arg */);
+extern fcntl_fun fcntl_f;
+
+typedef int (*ioctl_fun)(int d, unsigned long int request, ...);
+extern ioctl_fun ioctl_f;
+
+typedef int (*setsockopt_fun)(int sockfd, int level, int optname, const void* optval, socklen_t optlen);
+extern setsockopt_fun setsockopt_f;
+
+// 带超时的connect，timeout_ms为-1时不超时，超时返回-1并设置errno为ETIMEDOUT
+int connect_with_timeout(int fd, const struct sockaddr* addr, socklen_t addrlen, uint64_t timeout_ms);
+
+}
+
+#endif
@@ -0,0 +1,80 @@
+#ifndef _INTRUSIVE_PTR_H_
+#define _INTRUSIVE_PTR_H_
+
+#include <cstddef>
+#include <utility>
+
+// 侵入式智能指针：引用计数放在对象内部
+    // T需要提供incRef()和decRef()，decRef()在计数归零时负责释放对象
+    // 和std::shared_ptr相比没有控制块，从裸指针（例如当前协程）重新得到智能指针只需要计数加1
+template<typename T>
+class IntrusivePtr {
+public:
+    IntrusivePtr() {}
+    IntrusivePtr(std::nullptr_t) {}
+
+    // 接管裸指针，计数加1
+    IntrusivePtr(T* p): m_ptr(p) {
+        if (m_ptr) {
+            m_ptr->incRef();
+        }
+    }
+
+    IntrusivePtr(const IntrusivePtr& other): m_ptr(other.m_ptr) {
+        if (m_ptr) {
+            m_ptr->incRef();
+        }
+    }
+
+    IntrusivePtr(IntrusivePtr&& other) noexcept: m_ptr(other.m_ptr) {
+        other.m_ptr = nullptr;
+    }
+
+    ~IntrusivePtr() {
+        if (m_ptr) {
+            m_ptr->decRef();
+        }
+    }
+
+    IntrusivePtr& operator=(const IntrusivePtr& other) {
+        IntrusivePtr(other).swap(*this);
+        return *this;
+    }
+
+    IntrusivePtr& operator=(IntrusivePtr&& other) noexcept {
+        IntrusivePtr(std::move(other)).swap(*this);
+        return *this;
+    }
+
+    IntrusivePtr& operator=(std::nullptr_t) {
+        reset();
+        return *this;
+    }
+
+    void reset() {
+        IntrusivePtr().swap(*this);
+    }
+
+    void reset(T* p) {
+        IntrusivePtr(p).swap(*this);
+    }
+
+    void swap(IntrusivePtr& other) noexcept {
+        std::swap(m_ptr, other.m_ptr);
+    }
+
+    T* get() const {return m_ptr;}
+    T* operator->() const {return m_ptr;}
+    T& operator*() const {return *m_ptr;}
+    explicit operator bool() const {return m_ptr != nullptr;}
+
+    bool operator==(const IntrusivePtr& other) const {return m_ptr == other.m_ptr;}
+    bool operator!=(const IntrusivePtr& other) const {return m_ptr != other.m_ptr;}
+    bool operator==(std::nullptr_t) const {return m_ptr == nullptr;}
+    bool operator!=(std::nullptr_t) const {return m_ptr != nullptr;}
+
+private:
+    T* m_ptr = nullptr;
+};
+
+#endif
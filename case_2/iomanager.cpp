@@ -0,0 +1,430 @@
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+
+#include "iomanager.h"
+#include "hook.h"
+
+// 每次epoll_wait最多取出的事件数
+static const int kMaxEvents = 256;
+
+IOManager::FdContext::EventContext& IOManager::FdContext::getEventContext(Event event) {
+    assert(event == READ || event == WRITE);
+    return event == READ ? read : write;
+}
+
+void IOManager::FdContext::resetEventContext(EventContext& ctx) {
+    ctx.scheduler = nullptr;
+    ctx.fiber.reset();
+    ctx.cb = nullptr;
+}
+
+// 调用者持有mutex
+void IOManager::FdContext::triggerEvent(Event event) {
+    assert(events & event);
+
+    // 边缘触发，事件只触发一次，触发后注销
+    events = (Event)(events & ~event);
+
+    EventContext& ctx = getEventContext(event);
+    if (ctx.cb) {
+        ctx.scheduler->scheduleLock(std::move(ctx.cb));
+    } else {
+        ctx.scheduler->scheduleLock(std::move(ctx.fiber));
+    }
+    resetEventContext(ctx);
+}
+
+IOManager::IOManager(size_t threads, bool use_caller, const std::string& name):
+IOManager(Options(threads, use_caller, name)) {
+}
+
+IOManager::IOManager(const Options& options):
+Scheduler(options) {
+    m_epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (m_epfd < 0) {
+        std::cerr << "IOManager() epoll_create1 failed: " << strerror(errno) << std::endl;
+        exit(0);
+    }
+
+    m_wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_wakeFd < 0) {
+        std::cerr << "IOManager() eventfd failed: " << strerror(errno) << std::endl;
+        exit(0);
+    }
+
+    // 唤醒fd用水平触发，data.ptr指向m_wakeFd以便和fd事件区分
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.ptr = &m_wakeFd;
+    if (epoll_ctl(m_epfd, EPOLL_CTL_ADD, m_wakeFd, &ev) != 0) {
+        std::cerr << "IOManager() epoll_ctl failed: " << strerror(errno) << std::endl;
+        exit(0);
+    }
+
+    // 定时器用绝对时间设置，CLOCK_MONOTONIC和steady_clock是同一个时钟
+    m_timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (m_timerFd < 0) {
+        std::cerr << "IOManager() timerfd_create failed: " << strerror(errno) << std::endl;
+        exit(0);
+    }
+
+    ev.events = EPOLLIN;
+    ev.data.ptr = &m_timerFd;
+    if (epoll_ctl(m_epfd, EPOLL_CTL_ADD, m_timerFd, &ev) != 0) {
+        std::cerr << "IOManager() epoll_ctl failed: " << strerror(errno) << std::endl;
+        exit(0);
+    }
+
+    m_fdContexts.resize(32, nullptr);
+}
+
+IOManager::~IOManager() {
+    stop();
+    // 之后用户手里的定时器不会再通过onTimerFrontChanged()访问m_timerFd
+    detachTimers();
+
+    close(m_epfd);
+    close(m_wakeFd);
+    close(m_timerFd);
+
+    for (FdContext* ctx : m_fdContexts) {
+        delete ctx;
+    }
+}
+
+IOManager* IOManager::GetThis() {
+    return dynamic_cast<IOManager*>(Scheduler::GetThis());
+}
+
+IOManager::FdContext* IOManager::getFdContext(int fd, bool auto_create) {
+    if (fd < 0) {
+        return nullptr;
+    }
+
+    {
+        std::shared_lock<std::shared_mutex> lock(m_fdMutex);
+        if ((size_t)fd < m_fdContexts.size() && m_fdContexts[fd]) {
+            return m_fdContexts[fd];
+        }
+        if (!auto_create) {
+            return nullptr;
+        }
+    }
+
+    std::unique_lock<std::shared_mutex> lock(m_fdMutex);
+    if ((size_t)fd >= m_fdContexts.size()) {
+        m_fdContexts.resize(std::max((size_t)fd + 1, m_fdContexts.size() * 3 / 2), nullptr);
+    }
+    if (!m_fdContexts[fd]) {
+        m_fdContexts[fd] = new FdContext();
+        m_fdContexts[fd]->fd = fd;
+    }
+    return m_fdContexts[fd];
+}
+
+int IOManager::addEvent(int fd, Event event, UniqueFunction cb) {
+    FdContext* fd_ctx = getFdContext(fd, true);
+    if (!fd_ctx) {
+        return -1;
+    }
+
+    std::lock_guard<std::mutex> lock(fd_ctx->mutex);
+
+    // 同一个事件不能重复注册
+    if (fd_ctx->events & event) {
+        std::cerr << "addEvent() event already registered, fd: " << fd << " event: " << event << std::endl;
+        return -1;
+    }
+
+    int op = fd_ctx->events ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+    epoll_event epevent{};
+    epevent.events = EPOLLET | (uint32_t)fd_ctx->events | (uint32_t)event;
+    epevent.data.ptr = fd_ctx;
+    if (epoll_ctl(m_epfd, op, fd, &epevent) != 0) {
+        std::cerr << "addEvent() epoll_ctl failed: " << strerror(errno) << std::endl;
+        return -1;
+    }
+
+    m_pendingEventCount++;
+    fd_ctx->events = (Event)(fd_ctx->events | event);
+
+    // 事件可能在这里就已经在其他线程上触发了，但触发时要先拿到fd_ctx->mutex
+    FdContext::EventContext& ev_ctx = fd_ctx->getEventContext(event);
+    assert(!ev_ctx.scheduler && !ev_ctx.fiber && !ev_ctx.cb);
+    ev_ctx.scheduler = Scheduler::GetThis() ? Scheduler::GetThis() : this;
+    if (cb) {
+        ev_ctx.cb = std::move(cb);
+    } else {
+        // 当前协程随后yield，事件触发时被重新调度，resume会等它完全切出
+        ev_ctx.fiber = Fiber::GetThis();
+        assert(ev_ctx.fiber->getState() == Fiber::RUNNING);
+    }
+    return 0;
+}
+
+bool IOManager::delEvent(int fd, Event event) {
+    FdContext* fd_ctx = getFdContext(fd, false);
+    if (!fd_ctx) {
+        return false;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(fd_ctx->mutex);
+        if (!(fd_ctx->events & event)) {
+            return false;
+        }
+
+        Event left = (Event)(fd_ctx->events & ~event);
+        int op = left ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
+        epoll_event epevent{};
+        epevent.events = EPOLLET | (uint32_t)left;
+        epevent.data.ptr = fd_ctx;
+        if (epoll_ctl(m_epfd, op, fd, &epevent) != 0) {
+            std::cerr << "delEvent() epoll_ctl failed: " << strerror(errno) << std::endl;
+            return false;
+        }
+
+        fd_ctx->events = left;
+        fd_ctx->resetEventContext(fd_ctx->getEventContext(event));
+    }
+
+    if (--m_pendingEventCount == 0) {
+        onEventDone();
+    }
+    return true;
+}
+
+bool IOManager::cancelEvent(int fd, Event event) {
+    FdContext* fd_ctx = getFdContext(fd, false);
+    if (!fd_ctx) {
+        return false;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(fd_ctx->mutex);
+        if (!(fd_ctx->events & event)) {
+            return false;
+        }
+
+        Event left = (Event)(fd_ctx->events & ~event);
+        int op = left ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
+        epoll_event epevent{};
+        epevent.events = EPOLLET | (uint32_t)left;
+        epevent.data.ptr = fd_ctx;
+        if (epoll_ctl(m_epfd, op, fd, &epevent) != 0) {
+            std::cerr << "cancelEvent() epoll_ctl failed: " << strerror(errno) << std::endl;
+            return false;
+        }
+
+        fd_ctx->triggerEvent(event);
+    }
+
+    if (--m_pendingEventCount == 0) {
+        onEventDone();
+    }
+    return true;
+}
+
+bool IOManager::cancelAll(int fd) {
+    FdContext* fd_ctx = getFdContext(fd, false);
+    if (!fd_ctx) {
+        return false;
+    }
+
+    size_t count = 0;
+    {
+        std::lock_guard<std::mutex> lock(fd_ctx->mutex);
+        if (!fd_ctx->events) {
+            return false;
+        }
+
+        epoll_event epevent{};
+        if (epoll_ctl(m_epfd, EPOLL_CTL_DEL, fd, &epevent) != 0) {
+            std::cerr << "cancelAll() epoll_ctl failed: " << strerror(errno) << std::endl;
+            return false;
+        }
+
+        if (fd_ctx->events & READ) {
+            fd_ctx->triggerEvent(READ);
+            count++;
+        }
+        if (fd_ctx->events & WRITE) {
+            fd_ctx->triggerEvent(WRITE);
+            count++;
+        }
+        assert(fd_ctx->events == NONE);
+    }
+
+    if (m_pendingEventCount.fetch_sub(count) == count) {
+        onEventDone();
+    }
+    return true;
+}
+
+void IOManager::wakePoller() {
+    uint64_t one = 1;
+    ssize_t rt = write(m_wakeFd, &one, sizeof(one));
+    (void)rt;  // 计数器溢出（EAGAIN）时已经有未读的唤醒，忽略即可
+}
+
+void IOManager::onEventDone() {
+    // 调度器在等最后的事件完成，唤醒所有线程让它们退出
+    if (Scheduler::stopping()) {
+        unparkAll();
+        wakePoller();
+    }
+}
+
+void IOManager::run() {
+    // 任务中阻塞的系统调用只挂起协程，不阻塞工作线程
+    bool hook_enable = is_hook_enable();
+    set_hook_enable(true);
+    Scheduler::run();
+    set_hook_enable(hook_enable);
+}
+
+void IOManager::tickle() {
+    // 和idle()中成为poller之后的检查配对
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!hasIdleThreads()) {
+        return;
+    }
+
+    // 优先唤醒停车的线程，没有的话把阻塞在epoll_wait上的线程叫起来
+    if (!unparkOne() && m_pollerThread.load(std::memory_order_relaxed) != -1) {
+        wakePoller();
+    }
+}
+
+void IOManager::wakeThread(int thread_id) {
+    if (m_pollerThread.load(std::memory_order_relaxed) == thread_id) {
+        wakePoller();
+    }
+}
+
+bool IOManager::stopping() {
+    // Abort时不再等还没有触发的事件和定时器
+    return Scheduler::stopping() && (aborting() || (m_pendingEventCount.load() == 0 && !hasTimer()));
+}
+
+void IOManager::onTimerFrontChanged(uint64_t next_ns) {
+    // it_value全为0时停止timerfd，到期时间已经过去时立即可读
+    itimerspec its{};
+    its.it_value.tv_sec = next_ns / 1000000000;
+    its.it_value.tv_nsec = next_ns % 1000000000;
+    if (timerfd_settime(m_timerFd, TFD_TIMER_ABSTIME, &its, nullptr) != 0) {
+        std::cerr << "onTimerFrontChanged() timerfd_settime failed: " << strerror(errno) << std::endl;
+    }
+
+    if (next_ns == 0) {
+        onEventDone();
+    }
+}
+
+void IOManager::idle() {
+    epoll_event* events = new epoll_event[kMaxEvents];
+    std::unique_ptr<epoll_event[]> holder(events);
+
+    while (true) {
+        // 同一时刻只有一个线程阻塞在epoll_wait上，其他空闲线程停车
+        int expected = -1;
+        if (m_pollerThread.compare_exchange_strong(expected, GetThreadId())) {
+            int n = 0;
+
+            // 成为poller以后再检查一次，和tickle()构成Dekker式的同步
+                // 发布任务的线程要么看到本线程是poller（写eventfd），要么本线程在这里看到新任务
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (!hasPendingWork() && !stopping()) {
+                do {
+                    n = epoll_wait(m_epfd, events, kMaxEvents, -1);
+                } while (n < 0 && errno == EINTR);
+            }
+
+            // 先让出poller的位置，触发事件时投递任务就不会再写eventfd唤醒自己
+            m_pollerThread.store(-1, std::memory_order_seq_cst);
+
+            for (int i = 0; i < n; i++) {
+                epoll_event& event = events[i];
+
+                if (event.data.ptr == &m_wakeFd) {
+                    uint64_t dummy;
+                    while (read(m_wakeFd, &dummy, sizeof(dummy)) > 0);
+                    continue;
+                }
+
+                // 到期的定时器在下面统一处理
+                if (event.data.ptr == &m_timerFd) {
+                    uint64_t dummy;
+                    while (read(m_timerFd, &dummy, sizeof(dummy)) > 0);
+                    continue;
+                }
+
+                FdContext* fd_ctx = (FdContext*)event.data.ptr;
+                std::lock_guard<std::mutex> lock(fd_ctx->mutex);
+
+                // 出错或者对端关闭时，唤醒所有等待的事件，由等待者通过读写得到错误
+                if (event.events & (EPOLLERR | EPOLLHUP)) {
+                    event.events |= (EPOLLIN | EPOLLOUT) & fd_ctx->events;
+                }
+
+                int real_events = NONE;
+                if (event.events & EPOLLIN) {
+                    real_events |= READ;
+                }
+                if (event.events & EPOLLOUT) {
+                    real_events |= WRITE;
+                }
+
+                // 事件已经被删除或者取消
+                if ((fd_ctx->events & real_events) == NONE) {
+                    continue;
+                }
+
+                // 注销已经触发的事件，保留剩余的
+                int left = fd_ctx->events & ~real_events;
+                int op = left ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
+                event.events = EPOLLET | left;
+                if (epoll_ctl(m_epfd, op, fd_ctx->fd, &event) != 0) {
+                    std::cerr << "idle() epoll_ctl failed: " << strerror(errno) << std::endl;
+                    continue;
+                }
+
+                if (real_events & READ & fd_ctx->events) {
+                    fd_ctx->triggerEvent(READ);
+                    m_pendingEventCount--;
+                }
+                if (real_events & WRITE & fd_ctx->events) {
+                    fd_ctx->triggerEvent(WRITE);
+                    m_pendingEventCount--;
+                }
+            }
+
+            // 到期的定时器
+            std::vector<std::function<void()>> cbs;
+            listExpiredCb(cbs);
+            if (!cbs.empty()) {
+                scheduleBatch(std::make_move_iterator(cbs.begin()), std::make_move_iterator(cbs.end()));
+            }
+
+            if (stopping()) {
+                // 调度器停止，唤醒所有线程退出
+                unparkAll();
+            } else {
+                // 本线程回去执行任务，交给一个停车的线程继续等待IO
+                unparkOne();
+            }
+        } else {
+            park();
+        }
+
+        Fiber::ptr curr = Fiber::GetThis();
+        auto raw_ptr = curr.get();
+        curr.reset();
+        raw_ptr->yield();
+    }
+}
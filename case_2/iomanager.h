@@ -0,0 +1,109 @@
+#ifndef _IOMANAGER_H_
+#define _IOMANAGER_H_
+
+#include <shared_mutex>
+
+#include "scheduler.h"
+#include "timer.h"
+
+// 基于epoll的IO协程调度器
+    // 协程在fd上注册读/写事件后yield，fd就绪时由调度器重新调度该协程（或者事件的回调函数）
+    // 同一时刻只有一个空闲线程阻塞在epoll_wait上（poller），其他空闲线程在futex上停车
+    // 有新任务时优先唤醒停车的线程，没有停车的线程时通过eventfd唤醒poller
+    // 定时器的最早到期时间设置在一个timerfd上，poller在epoll_wait中等到恰好到期的时刻
+class IOManager : public Scheduler, public TimerManager {
+public:
+    typedef std::shared_ptr<IOManager> ptr;
+
+    // 事件类型，和epoll的EPOLLIN/EPOLLOUT取值相同
+    enum Event {
+        NONE = 0x0,
+        READ = 0x1,
+        WRITE = 0x4
+    };
+
+private:
+    // fd的上下文：注册的事件以及每个事件触发后要执行的协程或回调
+    struct FdContext {
+        struct EventContext {
+            // 事件触发后在哪个调度器上执行
+            Scheduler* scheduler = nullptr;
+            // 协程/回调二选一
+            Fiber::ptr fiber;
+            UniqueFunction cb;
+        };
+
+        EventContext& getEventContext(Event event);
+        void resetEventContext(EventContext& ctx);
+        // 触发事件：把协程或回调投递到调度器，并注销该事件
+        void triggerEvent(Event event);
+
+        EventContext read;
+        EventContext write;
+        int fd = 0;
+        // 当前注册的事件
+        Event events = NONE;
+        std::mutex mutex;
+    };
+
+public:
+    IOManager(size_t threads = 1, bool use_caller = true, const std::string& name = "IOManager");
+    explicit IOManager(const Options& options);
+    ~IOManager();
+
+    // 添加事件，成功返回0
+        // cb为空时，事件触发后resume当前协程，调用者随后应当yield
+    int addEvent(int fd, Event event, UniqueFunction cb = nullptr);
+
+    // 删除事件，不触发
+    bool delEvent(int fd, Event event);
+
+    // 取消事件，如果事件已注册则立即触发一次
+    bool cancelEvent(int fd, Event event);
+
+    // 取消fd上的所有事件
+    bool cancelAll(int fd);
+
+    static IOManager* GetThis();
+
+protected:
+    // 工作线程开启系统调用hook后进入调度循环
+    void run() override;
+    void tickle() override;
+    void idle() override;
+    // 还有等待中的事件或定时器时不能停止
+    bool stopping() override;
+    void wakeThread(int thread_id) override;
+
+    // 把timerfd设置到新的最早到期时间
+    void onTimerFrontChanged(uint64_t next_ns) override;
+
+private:
+    // 返回fd的上下文，auto_create为true时按需扩容
+    FdContext* getFdContext(int fd, bool auto_create);
+
+    // 通过eventfd唤醒阻塞在epoll_wait上的线程
+    void wakePoller();
+
+    // 事件数或定时器数变为0且调度器正在停止时，唤醒所有线程退出
+    void onEventDone();
+
+private:
+    int m_epfd = 0;
+    // 用于唤醒epoll_wait的eventfd
+    int m_wakeFd = 0;
+    // 定时器到期时可读的timerfd
+    int m_timerFd = 0;
+
+    // 等待中的事件数
+    std::atomic<size_t> m_pendingEventCount = {0};
+
+    // 正阻塞在epoll_wait上的线程id，没有时为-1
+    std::atomic<int> m_pollerThread = {-1};
+
+    // 保护m_fdContexts的扩容
+    std::shared_mutex m_fdMutex;
+    std::vector<FdContext*> m_fdContexts;
+};
+
+#endif
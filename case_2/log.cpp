@@ -0,0 +1,207 @@
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <cstdarg>
+#include <cstdlib>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include "log.h"
+
+// 后台写线程两次取空缓冲区之间的间隔
+static const int kFlushIntervalMs = 10;
+
+struct LogRecord {
+    uint64_t ns;
+    int level;
+    char msg[Logger::kMessageSize];
+};
+
+// 单生产者单消费者环形缓冲区
+    // 生产者是所属线程，消费者是持有registry.mutex的线程（后台写线程或者调用Flush()的线程）
+struct LogRing {
+    LogRecord slots[Logger::kRingSize];
+    // 消费者读到的位置和生产者写到的位置，只增不减，取模得到槽位
+    std::atomic<size_t> head{0};
+    std::atomic<size_t> tail{0};
+    // 所属线程已经退出，取空后由消费者释放
+    std::atomic<bool> closed{false};
+    int tid = 0;
+};
+
+struct LogRegistry {
+    std::mutex mutex;
+    std::vector<LogRing*> rings;
+    FILE* out = stdout;
+};
+
+// 不随静态析构释放，进程退出时atexit中还要用
+static LogRegistry& registry() {
+    static LogRegistry* r = new LogRegistry();
+    return *r;
+}
+
+static std::atomic<uint64_t> s_dropped{0};
+static std::atomic<bool> s_exiting{false};
+static std::once_flag s_writer_once;
+
+static const char* level_name(int level) {
+    switch (level) {
+        case Logger::TRACE: return "TRACE";
+        case Logger::DEBUG: return "DEBUG";
+        case Logger::INFO: return "INFO";
+        case Logger::WARN: return "WARN";
+        case Logger::ERROR: return "ERROR";
+    }
+    return "?";
+}
+
+static uint64_t now_ns() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void write_record(FILE* out, int tid, uint64_t ns, int level, const char* msg) {
+    fprintf(out, "%-5s %llu.%06llu [%d] %s\n", level_name(level),
+            (unsigned long long)(ns / 1000000000ull), (unsigned long long)(ns % 1000000000ull / 1000),
+            tid, msg);
+}
+
+static void writer_main() {
+    while (!s_exiting.load(std::memory_order_relaxed)) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(kFlushIntervalMs));
+        Logger::Flush();
+    }
+}
+
+static void on_exit() {
+    s_exiting.store(true, std::memory_order_relaxed);
+    Logger::Flush();
+
+    uint64_t dropped = Logger::Dropped();
+    if (dropped) {
+        LogRegistry& r = registry();
+        std::lock_guard<std::mutex> lock(r.mutex);
+        fprintf(r.out, "WARN  %llu log records dropped\n", (unsigned long long)dropped);
+        fflush(r.out);
+    }
+}
+
+// 第一次写日志时启动后台写线程
+static void start_writer() {
+    std::thread(writer_main).detach();
+    atexit(on_exit);
+}
+
+// 持有本线程的缓冲区，线程退出时把缓冲区交给消费者释放
+struct LogRingHolder {
+    LogRing* ring = nullptr;
+
+    ~LogRingHolder();
+};
+
+// 缓冲区交出以后，本线程再写日志就在锁内直接输出
+static thread_local bool t_ring_destroyed = false;
+static thread_local LogRingHolder t_ring;
+
+LogRingHolder::~LogRingHolder() {
+    t_ring_destroyed = true;
+    if (ring) {
+        ring->closed.store(true, std::memory_order_release);
+    }
+}
+
+static LogRing* thread_ring() {
+    if (t_ring.ring == nullptr) {
+        std::call_once(s_writer_once, start_writer);
+
+        LogRing* ring = new LogRing();
+        ring->tid = syscall(SYS_gettid);
+        LogRegistry& r = registry();
+        std::lock_guard<std::mutex> lock(r.mutex);
+        r.rings.push_back(ring);
+        t_ring.ring = ring;
+    }
+    return t_ring.ring;
+}
+
+void Logger::Log(Level level, const char* fmt, ...) {
+    uint64_t ns = now_ns();
+
+    if (t_ring_destroyed) {
+        char msg[kMessageSize];
+        va_list args;
+        va_start(args, fmt);
+        vsnprintf(msg, sizeof(msg), fmt, args);
+        va_end(args);
+
+        LogRegistry& r = registry();
+        std::lock_guard<std::mutex> lock(r.mutex);
+        write_record(r.out, syscall(SYS_gettid), ns, level, msg);
+        return;
+    }
+
+    LogRing* ring = thread_ring();
+    size_t tail = ring->tail.load(std::memory_order_relaxed);
+    if (tail - ring->head.load(std::memory_order_acquire) >= kRingSize) {
+        s_dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    LogRecord& record = ring->slots[tail % kRingSize];
+    record.ns = ns;
+    record.level = level;
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(record.msg, sizeof(record.msg), fmt, args);
+    va_end(args);
+
+    ring->tail.store(tail + 1, std::memory_order_release);
+}
+
+void Logger::SetOutput(FILE* out) {
+    LogRegistry& r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    r.out = out;
+}
+
+void Logger::Flush() {
+    LogRegistry& r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+
+    bool wrote = false;
+    for (size_t i = 0; i < r.rings.size();) {
+        LogRing* ring = r.rings[i];
+        // 先读closed再读tail：看到closed时，线程退出前写入的日志一定都能看到
+        bool closed = ring->closed.load(std::memory_order_acquire);
+        size_t head = ring->head.load(std::memory_order_relaxed);
+        size_t tail = ring->tail.load(std::memory_order_acquire);
+
+        for (; head != tail; head++) {
+            const LogRecord& record = ring->slots[head % kRingSize];
+            write_record(r.out, ring->tid, record.ns, record.level, record.msg);
+            wrote = true;
+        }
+        ring->head.store(head, std::memory_order_release);
+
+        if (closed) {
+            r.rings[i] = r.rings.back();
+            r.rings.pop_back();
+            delete ring;
+        } else {
+            i++;
+        }
+    }
+
+    if (wrote) {
+        fflush(r.out);
+    }
+}
+
+uint64_t Logger::Dropped() {
+    return s_dropped.load(std::memory_order_relaxed);
+}
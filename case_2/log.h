@@ -0,0 +1,89 @@
+#ifndef _LOG_H_
+#define _LOG_H_
+
+#include <cstdio>
+#include <cstddef>
+#include <cstdint>
+
+// 日志级别
+#define FIBER_LOG_LEVEL_TRACE 0
+#define FIBER_LOG_LEVEL_DEBUG 1
+#define FIBER_LOG_LEVEL_INFO  2
+#define FIBER_LOG_LEVEL_WARN  3
+#define FIBER_LOG_LEVEL_ERROR 4
+#define FIBER_LOG_LEVEL_OFF   5
+
+// 编译期日志级别，低于这个级别的日志调用在预处理阶段就被删除，参数也不会求值
+    // 默认：定义了NDEBUG（发布构建）时为INFO，否则为TRACE
+#ifndef FIBER_LOG_LEVEL
+#ifdef NDEBUG
+#define FIBER_LOG_LEVEL FIBER_LOG_LEVEL_INFO
+#else
+#define FIBER_LOG_LEVEL FIBER_LOG_LEVEL_TRACE
+#endif
+#endif
+
+// 异步日志
+    // 每个线程有自己的单生产者单消费者环形缓冲区，写日志只格式化到缓冲区的槽位里，不加锁、不做IO
+    // 后台写线程定期把所有线程的缓冲区取空，写到输出文件（默认标准输出）
+    // 缓冲区满了直接丢弃这条日志并计数，不会阻塞调用者
+    // 日志按线程分别有序，不同线程之间的先后以记录的时间戳为准
+class Logger {
+public:
+    enum Level {
+        TRACE = FIBER_LOG_LEVEL_TRACE,
+        DEBUG = FIBER_LOG_LEVEL_DEBUG,
+        INFO = FIBER_LOG_LEVEL_INFO,
+        WARN = FIBER_LOG_LEVEL_WARN,
+        ERROR = FIBER_LOG_LEVEL_ERROR
+    };
+
+    // 每个线程缓冲区的槽位数和每条日志的最大长度（超出截断）
+    static const size_t kRingSize = 512;
+    static const size_t kMessageSize = 232;
+
+public:
+    // 格式化一条日志放进本线程的缓冲区，一般通过FIBER_LOG_XXX宏调用
+    static void Log(Level level, const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+
+    // 设置输出文件，默认标准输出
+    static void SetOutput(FILE* out);
+
+    // 在调用线程上立即取空所有缓冲区，进程退出时也会调用
+    static void Flush();
+
+    // 因为缓冲区满了被丢弃的日志条数
+    static uint64_t Dropped();
+};
+
+#if FIBER_LOG_LEVEL <= FIBER_LOG_LEVEL_TRACE
+#define FIBER_LOG_TRACE(...) Logger::Log(Logger::TRACE, __VA_ARGS__)
+#else
+#define FIBER_LOG_TRACE(...) ((void)0)
+#endif
+
+#if FIBER_LOG_LEVEL <= FIBER_LOG_LEVEL_DEBUG
+#define FIBER_LOG_DEBUG(...) Logger::Log(Logger::DEBUG, __VA_ARGS__)
+#else
+#define FIBER_LOG_DEBUG(...) ((void)0)
+#endif
+
+#if FIBER_LOG_LEVEL <= FIBER_LOG_LEVEL_INFO
+#define FIBER_LOG_INFO(...) Logger::Log(Logger::INFO, __VA_ARGS__)
+#else
+#define FIBER_LOG_INFO(...) ((void)0)
+#endif
+
+#if FIBER_LOG_LEVEL <= FIBER_LOG_LEVEL_WARN
+#define FIBER_LOG_WARN(...) Logger::Log(Logger::WARN, __VA_ARGS__)
+#else
+#define FIBER_LOG_WARN(...) ((void)0)
+#endif
+
+#if FIBER_LOG_LEVEL <= FIBER_LOG_LEVEL_ERROR
+#define FIBER_LOG_ERROR(...) Logger::Log(Logger::ERROR, __VA_ARGS__)
+#else
+#define FIBER_LOG_ERROR(...) ((void)0)
+#endif
+
+#endif
@@ -1,11 +1,13 @@
 #include "scheduler.h"
+#include "fiber_pool.h"
+#include "fiber_sync.h"
 
 static unsigned int test_number;
-std::mutex mutex_cout;
+FiberMutex mutex_cout;
 
 void task() {
     {
-        std::lock_guard<std::mutex> lock(mutex_cout);
+        std::lock_guard<FiberMutex> lock(mutex_cout);
         std::cout << "task" << test_number++ << " is under processing in thread: " << Scheduler::GetThreadId() << std::endl;
     }
     std::this_thread::sleep_for(std::chrono::microseconds(1000));
@@ -17,27 +19,45 @@ int main(int argc, char const *argv[]) {
         std::shared_ptr<Scheduler> scheduler = std::make_shared<Scheduler> (3, true, "scheduler_1");
 
         scheduler->start();
+
+        // 每4秒输出一次调度器计数
+        scheduler->setMetricsDump(4000, [](const SchedulerMetrics& metrics) {
+            std::lock_guard<FiberMutex> lock(mutex_cout);
+            std::cout << metrics.toString();
+        });
         sleep(8);
 
         std::cout << "begin post\n";
 
+        // 等待这一批全部完成，不再靠sleep估计
+        std::vector<Future<void>> futures;
         for (int i = 0; i < 5; i++) {
-            std::shared_ptr<Fiber> fiber = std::make_shared<Fiber>(task);
-            scheduler->scheduleLock(fiber);
+            futures.push_back(scheduler->submit(task));
         }
+        when_all(std::move(futures)).get();
+        std::cout << "first batch done\n";
 
-        sleep(8);
-
+        // 批量发布，只唤醒一次
+        std::vector<Fiber::ptr> fibers;
         for (int i = 0; i < 20; i++) {
-            std::shared_ptr<Fiber> fiber = std::make_shared<Fiber>(task);
-            scheduler->scheduleLock(fiber);
+            fibers.push_back(FiberPool::Acquire(task));
         }
+        scheduler->scheduleBatch(fibers.begin(), fibers.end());
 
         sleep(4);
 
         scheduler->stop();
+        std::cout << scheduler->getMetrics().toString();
     }
 
+    StackAllocator::Stats stats = StackAllocator::GetStats();
+    std::cout << "stack allocator: local hits " << stats.localHits << ", global hits " << stats.globalHits
+              << ", misses " << stats.misses << ", cached " << stats.cached << std::endl;
+
+    FiberPool::Stats pool_stats = FiberPool::GetStats();
+    std::cout << "fiber pool: local hits " << pool_stats.localHits << ", global hits " << pool_stats.globalHits
+              << ", misses " << pool_stats.misses << ", recycles " << pool_stats.recycles << std::endl;
+
     return 0;
 }
 
@@ -0,0 +1,115 @@
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+
+#include "metrics.h"
+
+LatencyHistogram::LatencyHistogram() {
+    for (int i = 0; i < kBucketCount; i++) {
+        m_counts[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+void LatencyHistogram::merge(const LatencyHistogram& other) {
+    for (int i = 0; i < kBucketCount; i++) {
+        metrics_bump(m_counts[i], other.m_counts[i].load(std::memory_order_relaxed));
+    }
+    metrics_bump(m_sum, other.m_sum.load(std::memory_order_relaxed));
+    uint64_t other_max = other.max();
+    if (other_max > max()) {
+        m_max.store(other_max, std::memory_order_relaxed);
+    }
+}
+
+uint64_t LatencyHistogram::count() const {
+    uint64_t total = 0;
+    for (int i = 0; i < kBucketCount; i++) {
+        total += m_counts[i].load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+double LatencyHistogram::mean() const {
+    uint64_t n = count();
+    return n ? (double)m_sum.load(std::memory_order_relaxed) / n : 0;
+}
+
+uint64_t LatencyHistogram::percentile(double p) const {
+    uint64_t total = count();
+    if (total == 0) {
+        return 0;
+    }
+
+    uint64_t target = (uint64_t)std::ceil(p / 100 * total);
+    if (target == 0) {
+        target = 1;
+    }
+
+    uint64_t seen = 0;
+    for (int i = 0; i < kBucketCount; i++) {
+        seen += m_counts[i].load(std::memory_order_relaxed);
+        if (seen >= target) {
+            // 桶的上界可能超过实际记录到的最大值
+            return std::min(BucketUpperBound(i), max());
+        }
+    }
+    return max();
+}
+
+uint64_t LatencyHistogram::BucketUpperBound(int index) {
+    if (index < kSubCount) {
+        return index;
+    }
+    int exp = (index >> kSubBits) + kSubBits - 1;
+    uint64_t sub = index & (kSubCount - 1);
+    uint64_t lower = ((uint64_t)kSubCount + sub) << (exp - kSubBits);
+    return lower + ((uint64_t)1 << (exp - kSubBits)) - 1;
+}
+
+LatencySummary LatencySummary::From(const LatencyHistogram& histogram) {
+    LatencySummary summary;
+    summary.count = histogram.count();
+    summary.mean = histogram.mean();
+    summary.p50 = histogram.percentile(50);
+    summary.p90 = histogram.percentile(90);
+    summary.p99 = histogram.percentile(99);
+    summary.p999 = histogram.percentile(99.9);
+    summary.max = histogram.max();
+    return summary;
+}
+
+std::string SchedulerMetrics::toString() const {
+    std::ostringstream os;
+    os << "scheduler " << name << ": tasks " << tasks << ", switches " << switches << ", transfers " << transfers
+       << ", steals " << steals << ", busy " << busyNs / 1000000 << "ms, idle " << idleNs / 1000000 << "ms"
+       << ", queued " << queueDepth << " + inject " << injectQueueDepth
+       << ", active " << activeThreads << ", idle threads " << idleThreads
+       << ", fibers " << totalFibers << "\n";
+    os << "  post-to-start ns: count " << postToStart.count << ", mean " << (uint64_t)postToStart.mean
+       << ", p50 " << postToStart.p50 << ", p90 " << postToStart.p90 << ", p99 " << postToStart.p99
+       << ", p99.9 " << postToStart.p999 << ", max " << postToStart.max << "\n";
+    // 只用了普通优先级时不输出分类统计
+    static const char* const kClassNames[kClasses] = {"high", "normal", "low"};
+    if (classWait[0].count || classWait[2].count || deadlineMisses) {
+        for (int c = 0; c < kClasses; c++) {
+            const LatencySummary& wait = classWait[c];
+            os << "  " << kClassNames[c] << " wait ns: count " << wait.count << ", p50 " << wait.p50
+               << ", p99 " << wait.p99 << ", max " << wait.max << ", queued " << classQueueDepth[c] << "\n";
+        }
+        os << "  deadline misses " << deadlineMisses << "\n";
+    }
+    // 动态线程池增减过线程时才输出；已经退出的线程id为-1
+    if (threadsSpawned || threadsRetired) {
+        os << "  pool: live threads " << liveThreads << ", spawned " << threadsSpawned
+           << ", retired " << threadsRetired << "\n";
+    }
+    if (overruns || preemptions) {
+        os << "  preempt: overruns " << overruns << ", yields " << preemptions << ", forced " << forcedPreemptions << "\n";
+    }
+    for (const WorkerMetrics& w : workers) {
+        os << "  thread " << w.threadId << ": tasks " << w.tasks << ", switches " << w.switches << ", transfers " << w.transfers
+           << ", steals " << w.steals << ", busy " << w.busyNs / 1000000 << "ms, idle " << w.idleNs / 1000000 << "ms"
+           << ", queued " << w.queueDepth << "\n";
+    }
+    return os.str();
+}
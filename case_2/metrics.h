@@ -0,0 +1,152 @@
+#ifndef _METRICS_H_
+#define _METRICS_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <time.h>
+
+// 为0时调度器不读时钟：不记录投递到开始执行的延迟，也不统计空闲时间，其余计数照常
+#ifndef FIBER_METRICS
+#define FIBER_METRICS 1
+#endif
+
+// 单写者计数器加一：只有所属线程写入，其他线程只读，不需要原子的读-改-写
+static inline void metrics_bump(std::atomic<uint64_t>& counter, uint64_t n = 1) {
+    counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+// 统计用的单调时钟，FIBER_METRICS为0时返回0
+static inline uint64_t metrics_now_ns() {
+#if FIBER_METRICS
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+#else
+    return 0;
+#endif
+}
+
+// 延迟直方图（HDR风格的对数-线性分桶）
+    // 小于2^kSubBits的值每个值一个桶，之后每个2的幂区间再均分为2^kSubBits个桶
+    // 桶的宽度和值成正比，相对误差不超过1/2^kSubBits，覆盖整个uint64_t范围只需要496个桶
+    // record()只能由一个线程调用，其他线程可以随时读取（读到的是近似一致的快照）
+class LatencyHistogram {
+public:
+    static const int kSubBits = 3;
+    static const int kSubCount = 1 << kSubBits;
+    static const int kBucketCount = (64 - kSubBits + 1) * kSubCount;
+
+    LatencyHistogram();
+
+    LatencyHistogram(const LatencyHistogram&) = delete;
+    LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+
+    void record(uint64_t value) {
+        metrics_bump(m_counts[BucketIndex(value)]);
+        metrics_bump(m_sum, value);
+        if (value > m_max.load(std::memory_order_relaxed)) {
+            m_max.store(value, std::memory_order_relaxed);
+        }
+    }
+
+    // 把other的计数累加到本对象，本对象不能同时被record()
+    void merge(const LatencyHistogram& other);
+
+    uint64_t count() const;
+    uint64_t max() const {return m_max.load(std::memory_order_relaxed);}
+    double mean() const;
+
+    // 第p百分位（0~100）所在桶的上界，没有记录时返回0
+    uint64_t percentile(double p) const;
+
+    static int BucketIndex(uint64_t value) {
+        if (value < (uint64_t)kSubCount) {
+            return static_cast<int>(value);
+        }
+        int exp = 63 - __builtin_clzll(value);
+        return ((exp - kSubBits + 1) << kSubBits) + static_cast<int>((value >> (exp - kSubBits)) & (kSubCount - 1));
+    }
+
+    // 桶中最大的值
+    static uint64_t BucketUpperBound(int index);
+
+private:
+    std::atomic<uint64_t> m_counts[kBucketCount];
+    std::atomic<uint64_t> m_sum{0};
+    std::atomic<uint64_t> m_max{0};
+};
+
+// 延迟分布的摘要，单位纳秒
+struct LatencySummary {
+    uint64_t count = 0;
+    double mean = 0;
+    uint64_t p50 = 0;
+    uint64_t p90 = 0;
+    uint64_t p99 = 0;
+    uint64_t p999 = 0;
+    uint64_t max = 0;
+
+    static LatencySummary From(const LatencyHistogram& histogram);
+};
+
+// 一个工作线程的计数快照
+struct WorkerMetrics {
+    int threadId = -1;
+    uint64_t tasks = 0;       // 执行的任务数
+    uint64_t switches = 0;    // 从调度协程切换到任务协程或idle协程的次数
+    uint64_t transfers = 0;   // 不经过调度协程，从任务协程直接切换到runnext槽位中协程的次数
+    uint64_t steals = 0;      // 从其他线程窃取到的任务数
+    uint64_t idleNs = 0;      // 在idle协程中的时间
+    uint64_t busyNs = 0;      // 开始调度以来除去空闲的时间
+    size_t queueDepth = 0;    // 本地deque和inbox中等待的任务数
+};
+
+// 调度器的计数快照，由Scheduler::getMetrics()汇总
+struct SchedulerMetrics {
+    // 优先级类别数，和Scheduler::Priority对应：0高、1普通、2低
+    static const int kClasses = 3;
+
+    std::string name;
+    std::vector<WorkerMetrics> workers;
+
+    // 所有工作线程的合计
+    uint64_t tasks = 0;
+    uint64_t switches = 0;
+    uint64_t transfers = 0;
+    uint64_t steals = 0;
+    uint64_t idleNs = 0;
+    uint64_t busyNs = 0;
+    size_t queueDepth = 0;
+
+    size_t injectQueueDepth = 0;  // 全局注入队列中等待的任务数
+    size_t activeThreads = 0;     // 正在执行任务的线程数
+    size_t idleThreads = 0;       // 在idle协程中的线程数
+    uint64_t totalFibers = 0;     // 进程中存活的协程数
+
+    // 动态线程池：运行中的工作线程数（不含use_caller主线程）、新增和退出的次数
+    size_t liveThreads = 0;
+    uint64_t threadsSpawned = 0;
+    uint64_t threadsRetired = 0;
+
+    // 任务从投递到开始执行的延迟
+    LatencySummary postToStart;
+    // 按优先级类别分开的投递到开始执行的延迟
+    LatencySummary classWait[kClasses];
+    // 高/低优先级队列中等待的任务数（普通任务在queueDepth和injectQueueDepth中）
+    size_t classQueueDepth[kClasses] = {0, 0, 0};
+    // 开始执行时已经过了截止时间的任务数
+    uint64_t deadlineMisses = 0;
+
+    // 协作式抢占：看门狗发现的超过时间片的调度次数、在安全点让出的次数、其中被信号强制让出的次数
+    uint64_t overruns = 0;
+    uint64_t preemptions = 0;
+    uint64_t forcedPreemptions = 0;
+
+    // 多行文本，便于直接打进日志
+    std::string toString() const;
+};
+
+#endif
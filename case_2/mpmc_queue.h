@@ -0,0 +1,105 @@
+#ifndef _MPMC_QUEUE_H_
+#define _MPMC_QUEUE_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// 有界多生产者多消费者无锁队列
+    // 参考 Dmitry Vyukov 的 bounded MPMC queue
+    // 每个槽位有一个序号，生产者/消费者通过CAS抢占位置，再通过序号发布/回收槽位
+    // 容量向上取整为2的幂
+template<typename T>
+class BoundedMpmcQueue {
+public:
+    explicit BoundedMpmcQueue(size_t capacity) {
+        size_t size = 2;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        m_mask = size - 1;
+        m_buffer = new Cell[size];
+        for (size_t i = 0; i < size; i++) {
+            m_buffer[i].seq.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    ~BoundedMpmcQueue() {
+        delete[] m_buffer;
+    }
+
+    BoundedMpmcQueue(const BoundedMpmcQueue&) = delete;
+    BoundedMpmcQueue& operator=(const BoundedMpmcQueue&) = delete;
+
+    // 队列已满返回false
+    bool push(const T& data) {
+        Cell* cell;
+        size_t pos = m_enqueuePos.load(std::memory_order_relaxed);
+        while (true) {
+            cell = &m_buffer[pos & m_mask];
+            size_t seq = cell->seq.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (m_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = m_enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+
+        cell->data = data;
+        cell->seq.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // 队列为空返回false
+    bool pop(T& data) {
+        Cell* cell;
+        size_t pos = m_dequeuePos.load(std::memory_order_relaxed);
+        while (true) {
+            cell = &m_buffer[pos & m_mask];
+            size_t seq = cell->seq.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+            if (diff == 0) {
+                if (m_dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = m_dequeuePos.load(std::memory_order_relaxed);
+            }
+        }
+
+        data = cell->data;
+        cell->seq.store(pos + m_mask + 1, std::memory_order_release);
+        return true;
+    }
+
+    // 近似大小
+    size_t size() const {
+        size_t enq = m_enqueuePos.load(std::memory_order_relaxed);
+        size_t deq = m_dequeuePos.load(std::memory_order_relaxed);
+        return enq > deq ? enq - deq : 0;
+    }
+
+    bool empty() const {return size() == 0;}
+
+    size_t capacity() const {return m_mask + 1;}
+
+private:
+    struct Cell {
+        std::atomic<size_t> seq;
+        T data;
+    };
+
+    Cell* m_buffer = nullptr;
+    size_t m_mask = 0;
+    alignas(64) std::atomic<size_t> m_enqueuePos{0};
+    alignas(64) std::atomic<size_t> m_dequeuePos{0};
+};
+
+#endif
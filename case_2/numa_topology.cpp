@@ -0,0 +1,178 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <iostream>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+
+#include "numa_topology.h"
+
+struct Topology {
+    // 每个节点的CPU
+    std::vector<std::vector<int>> nodeCpus;
+    // CPU所在的节点
+    std::vector<int> cpuNode;
+    // 有CPU的节点，只有内存的节点和不存在的编号不在其中
+    std::vector<int> nodes;
+
+    Topology();
+};
+
+// 解析"0-3,8-11"格式的CPU列表
+static std::vector<int> parse_cpu_list(const char* s) {
+    std::vector<int> cpus;
+    while (*s) {
+        char* end;
+        long first = strtol(s, &end, 10);
+        if (end == s) {
+            break;
+        }
+        long last = first;
+        s = end;
+        if (*s == '-') {
+            last = strtol(s + 1, &end, 10);
+            s = end;
+        }
+        for (long cpu = first; cpu <= last; cpu++) {
+            cpus.push_back(static_cast<int>(cpu));
+        }
+        if (*s == ',') {
+            s++;
+        } else {
+            break;
+        }
+    }
+    return cpus;
+}
+
+Topology::Topology() {
+    // 节点编号可能不连续，依次尝试，连续多个不存在时停止
+    for (int node = 0, missing = 0; missing < 64; node++) {
+        std::string path = "/sys/devices/system/node/node" + std::to_string(node) + "/cpulist";
+        FILE* f = fopen(path.c_str(), "r");
+        if (f == nullptr) {
+            missing++;
+            continue;
+        }
+        missing = 0;
+
+        char buf[4096] = {0};
+        size_t n = fread(buf, 1, sizeof(buf) - 1, f);
+        fclose(f);
+        buf[n] = '\0';
+
+        nodeCpus.resize(node + 1);
+        nodeCpus[node] = parse_cpu_list(buf);
+        for (int cpu : nodeCpus[node]) {
+            if (cpu >= (int)cpuNode.size()) {
+                cpuNode.resize(cpu + 1, 0);
+            }
+            cpuNode[cpu] = node;
+        }
+    }
+
+    if (nodeCpus.empty()) {
+        long count = sysconf(_SC_NPROCESSORS_CONF);
+        nodeCpus.resize(1);
+        for (long cpu = 0; cpu < count; cpu++) {
+            nodeCpus[0].push_back(static_cast<int>(cpu));
+        }
+        cpuNode.assign(count > 0 ? count : 0, 0);
+    }
+
+    for (size_t node = 0; node < nodeCpus.size(); node++) {
+        if (!nodeCpus[node].empty()) {
+            nodes.push_back(static_cast<int>(node));
+        }
+    }
+    // 一个CPU都没有读到时当作一个节点
+    if (nodes.empty()) {
+        nodes.push_back(0);
+    }
+}
+
+static const Topology& topology() {
+    static const Topology t;
+    return t;
+}
+
+static thread_local int t_thread_node = 0;
+
+int NumaTopology::NodeCount() {
+    return static_cast<int>(topology().nodeCpus.size());
+}
+
+const std::vector<int>& NumaTopology::Nodes() {
+    return topology().nodes;
+}
+
+int NumaTopology::NodeOfCpu(int cpu) {
+    const Topology& t = topology();
+    if (cpu < 0 || cpu >= (int)t.cpuNode.size()) {
+        return 0;
+    }
+    return t.cpuNode[cpu];
+}
+
+const std::vector<int>& NumaTopology::CpusOfNode(int node) {
+    static const std::vector<int> empty;
+    const Topology& t = topology();
+    if (node < 0 || node >= (int)t.nodeCpus.size()) {
+        return empty;
+    }
+    return t.nodeCpus[node];
+}
+
+int NumaTopology::ThreadNode() {
+    return t_thread_node;
+}
+
+void NumaTopology::SetThreadNode(int node) {
+    t_thread_node = node < 0 ? 0 : node;
+}
+
+bool NumaTopology::BindCurrentThread(const std::vector<int>& cpus) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus) {
+        if (cpu >= 0 && cpu < CPU_SETSIZE) {
+            CPU_SET(cpu, &set);
+        }
+    }
+
+    int rt = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (rt) {
+        std::cerr << "NumaTopology::BindCurrentThread() failed: " << strerror(rt) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void* NumaTopology::AllocOnNode(size_t size, int node) {
+    void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) {
+        return nullptr;
+    }
+
+    // 在第一次访问之前设置策略，物理页在缺页时从node分配；只有一个节点或者失败时保持默认策略
+    if (node >= 0 && NodeCount() > 1) {
+        unsigned long mask[kMaxNodes / (8 * sizeof(unsigned long)) + 1] = {0};
+        int bits = 8 * sizeof(unsigned long);
+        if (node < (int)(sizeof(mask) * 8)) {
+            mask[node / bits] |= 1ul << (node % bits);
+            syscall(SYS_mbind, p, size, MPOL_PREFERRED, mask, sizeof(mask) * 8, 0);
+        }
+    }
+    return p;
+}
+
+void NumaTopology::FreeOnNode(void* p, size_t size) {
+    if (p) {
+        munmap(p, size);
+    }
+}
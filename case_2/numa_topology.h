@@ -0,0 +1,41 @@
+#ifndef _NUMA_TOPOLOGY_H_
+#define _NUMA_TOPOLOGY_H_
+
+#include <cstddef>
+#include <vector>
+
+// NUMA拓扑和线程放置
+    // 拓扑从/sys/devices/system/node读取，不依赖libnuma；读不到时认为只有一个节点，包含所有CPU
+    // 栈分配器和协程池按"当前线程所属节点"分开全局池，工作线程启动时通过SetThreadNode()设置
+    // 内存本身依靠Linux的首次访问策略落在访问它的CPU所在的节点上，绑定了CPU的线程取到的栈/协程都来自本节点的池
+class NumaTopology {
+public:
+    // 缓存池最多区分的节点数，编号更大的节点取模后共用
+    static const int kMaxNodes = 8;
+
+    // 最大的节点编号加1，节点编号可能不连续，中间的编号没有CPU
+    static int NodeCount();
+
+    // 有CPU的节点编号，从小到大
+    static const std::vector<int>& Nodes();
+
+    // CPU所在的节点，未知的CPU返回0
+    static int NodeOfCpu(int cpu);
+
+    // 节点上的CPU
+    static const std::vector<int>& CpusOfNode(int node);
+
+    // 当前线程所属的节点，默认为0
+    static int ThreadNode();
+    static void SetThreadNode(int node);
+
+    // 把当前线程绑定到cpus，成功返回true
+    static bool BindCurrentThread(const std::vector<int>& cpus);
+
+    // 分配size字节的匿名内存，node >= 0时优先放在该节点上（mbind），失败返回nullptr
+        // 按页分配，只适合较大、生命周期较长的对象（例如工作线程的任务队列）
+    static void* AllocOnNode(size_t size, int node);
+    static void FreeOnNode(void* p, size_t size);
+};
+
+#endif
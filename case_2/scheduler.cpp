@@ -1,4 +1,17 @@
+#include <algorithm>
+#include <functional>
+#include <unistd.h>
+#include <sched.h>
+#include <signal.h>
+#include <cerrno>
+#include <cstring>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
 #include "scheduler.h"
+#include "fiber_pool.h"
+#include "log.h"
+#include "numa_topology.h"
 
 // 全局变量（线程局部变量）
 // 调度器：由同一个调度器下的所有线程共有
@@ -9,6 +22,169 @@ static thread_local Fiber* t_scheduler_fiber = nullptr; // 指向当前线程的
 // 主线程之外的线程将在创建工作线程后修改
 static thread_local int s_thread_id = 0;  // 保存当前线程的id
 
+thread_local Scheduler::Worker* Scheduler::t_worker = nullptr;
+
+// 全局注入队列的容量
+static const size_t kInjectQueueCapacity = 8192;
+
+// 每调度这么多次，先检查一次全局注入队列，避免本地任务一直占着线程让外部任务饿死
+static const uint32_t kInjectCheckInterval = 61;
+
+// 连续执行这么多个高优先级任务以后，让普通任务先走一次
+static const uint32_t kHighBurst = 8;
+// 有低优先级任务等待时，每取这么多次任务先看一次低优先级队列
+static const uint32_t kLowAgingInterval = 32;
+
+// 连续从runnext槽位取这么多次任务以后，让本地队列里的任务先走一次
+static const uint32_t kRunNextBurst = 16;
+
+// forcePreempt使用的信号，一般程序不会用到，默认动作是忽略
+static const int kPreemptSignal = SIGURG;
+
+// 看门狗的超时报告最多每隔这么久输出一条，其余的只计数
+static const uint64_t kOverrunLogIntervalNs = 1000000000ull;
+
+
+// 任务节点缓存
+    // 每个线程缓存一批空闲节点，超过kTaskCacheHigh个时把kTaskCacheBatch个整批交给全局链表，
+    // 本线程没有空闲节点时从全局链表整批取回，工作线程之间流转的任务节点基本不再经过malloc
+static const size_t kTaskCacheBatch = 128;
+static const size_t kTaskCacheHigh = 2 * kTaskCacheBatch;
+// 全局链表最多保留的批数，超过的直接释放
+static const size_t kTaskGlobalBatches = 64;
+
+struct TaskNode {
+    TaskNode* next;
+};
+
+struct TaskBatch {
+    TaskNode* head;
+    size_t count;
+};
+
+struct TaskGlobalPool {
+    std::mutex mutex;
+    std::vector<TaskBatch> batches;
+};
+
+// 不随静态析构释放，线程退出时可能还会访问
+static TaskGlobalPool& task_global_pool() {
+    static TaskGlobalPool* pool = new TaskGlobalPool();
+    return *pool;
+}
+
+static void free_task_list(TaskNode* head) {
+    while (head) {
+        TaskNode* next = head->next;
+        ::operator delete(head);
+        head = next;
+    }
+}
+
+// 把一批节点交给全局链表，满了就释放
+static void push_task_batch(TaskNode* head, size_t count) {
+    TaskGlobalPool& pool = task_global_pool();
+    {
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        if (pool.batches.size() < kTaskGlobalBatches) {
+            pool.batches.push_back({head, count});
+            return;
+        }
+    }
+    free_task_list(head);
+}
+
+struct TaskCache {
+    TaskNode* head = nullptr;
+    size_t count = 0;
+
+    ~TaskCache();
+};
+
+// 线程缓存析构以后，本线程再分配/释放任务节点就直接走malloc
+static thread_local bool t_task_cache_destroyed = false;
+static thread_local TaskCache t_task_cache;
+
+TaskCache::~TaskCache() {
+    t_task_cache_destroyed = true;
+    if (head) {
+        push_task_batch(head, count);
+    }
+    head = nullptr;
+    count = 0;
+}
+
+void* Scheduler::SchedulerTask::operator new(size_t size) {
+    assert(size == sizeof(SchedulerTask));
+    if (t_task_cache_destroyed) {
+        return ::operator new(size);
+    }
+
+    TaskCache& cache = t_task_cache;
+    if (cache.head == nullptr) {
+        TaskGlobalPool& pool = task_global_pool();
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        if (!pool.batches.empty()) {
+            cache.head = pool.batches.back().head;
+            cache.count = pool.batches.back().count;
+            pool.batches.pop_back();
+        }
+    }
+
+    if (cache.head == nullptr) {
+        return ::operator new(std::max(size, sizeof(TaskNode)));
+    }
+
+    TaskNode* node = cache.head;
+    cache.head = node->next;
+    cache.count--;
+    return node;
+}
+
+void Scheduler::SchedulerTask::operator delete(void* p) {
+    if (p == nullptr) {
+        return;
+    }
+    if (t_task_cache_destroyed) {
+        ::operator delete(p);
+        return;
+    }
+
+    TaskCache& cache = t_task_cache;
+    TaskNode* node = static_cast<TaskNode*>(p);
+    node->next = cache.head;
+    cache.head = node;
+    cache.count++;
+
+    // 缓存太多时把前kTaskCacheBatch个交给全局链表
+    if (cache.count >= kTaskCacheHigh) {
+        TaskNode* batch = cache.head;
+        TaskNode* tail = batch;
+        for (size_t i = 1; i < kTaskCacheBatch; i++) {
+            tail = tail->next;
+        }
+        cache.head = tail->next;
+        cache.count -= kTaskCacheBatch;
+        tail->next = nullptr;
+        push_task_batch(batch, kTaskCacheBatch);
+    }
+}
+
+static void futex_wait(std::atomic<uint32_t>* addr, uint32_t val) {
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(addr), FUTEX_WAIT_PRIVATE, val, nullptr, nullptr, 0);
+}
+
+// 最多等待timeout_ns纳秒
+static void futex_wait_for(std::atomic<uint32_t>* addr, uint32_t val, uint64_t timeout_ns) {
+    timespec ts;
+    ts.tv_sec = timeout_ns / 1000000000ull;
+    ts.tv_nsec = timeout_ns % 1000000000ull;
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(addr), FUTEX_WAIT_PRIVATE, val, &ts, nullptr, 0);
+}
+
+static void futex_wake(std::atomic<uint32_t>* addr, int count) {
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(addr), FUTEX_WAKE_PRIVATE, count, nullptr, nullptr, 0);
+}
 
 // 获取调度器指针
 Scheduler* Scheduler::GetThis() {
@@ -32,13 +208,77 @@ void Scheduler::SetThreadId(int thread_id) {
 }
 
 
+void* Scheduler::Worker::operator new(size_t size, int node) {
+    void* p = NumaTopology::AllocOnNode(size, node);
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void Scheduler::Worker::operator delete(void* p, size_t size) {
+    NumaTopology::FreeOnNode(p, size);
+}
+
+// 构造函数抛出异常时调用，没有传入大小，按sizeof(Worker)重新算出分配的大小
+void Scheduler::Worker::operator delete(void* p, int) {
+    NumaTopology::FreeOnNode(p, sizeof(Worker));
+}
+
+void Scheduler::PlaceWorker(const Options& options, size_t index, std::vector<int>& cpus, int& node) {
+    cpus.clear();
+    node = 0;
+
+    if (options.cpus.empty()) {
+        // 节点编号可能不连续，只在有CPU的节点之间轮流
+        if (options.numaAware) {
+            const std::vector<int>& nodes = NumaTopology::Nodes();
+            node = nodes[index % nodes.size()];
+            cpus = NumaTopology::CpusOfNode(node);
+        }
+        return;
+    }
+
+    if (options.pinEach) {
+        int cpu = options.cpus[index % options.cpus.size()];
+        cpus.push_back(cpu);
+        node = options.numaAware ? NumaTopology::NodeOfCpu(cpu) : 0;
+        return;
+    }
+
+    if (!options.numaAware) {
+        cpus = options.cpus;
+        return;
+    }
+
+    // 集合中出现的节点轮流分配，绑定到集合中属于该节点的CPU
+    std::vector<int> nodes;
+    for (int cpu : options.cpus) {
+        int n = NumaTopology::NodeOfCpu(cpu);
+        if (std::find(nodes.begin(), nodes.end(), n) == nodes.end()) {
+            nodes.push_back(n);
+        }
+    }
+    node = nodes[index % nodes.size()];
+    for (int cpu : options.cpus) {
+        if (NumaTopology::NodeOfCpu(cpu) == node) {
+            cpus.push_back(cpu);
+        }
+    }
+}
+
 Scheduler::Scheduler(size_t threads, bool use_caller, const std::string &name):
-m_useCaller(use_caller), m_name(name){
+Scheduler(Options(threads, use_caller, name)) {
+}
+
+Scheduler::Scheduler(const Options& options):
+m_name(options.name), m_injectQueue(kInjectQueueCapacity), m_useCaller(options.useCaller), m_numaAware(options.numaAware) {
+    size_t threads = options.threads;
+    size_t max_threads = std::max(options.maxThreads, threads);
+    bool use_caller = options.useCaller;
     assert(threads > 0);
     assert(Scheduler::GetThis() == nullptr);
 
-    tickler = 0;
-
     // 设置调度器指针
     SetThis();
 
@@ -48,6 +288,7 @@ m_useCaller(use_caller), m_name(name){
     // 主协程参与执行任务
     if (use_caller) {
         threads--;
+        max_threads--;
 
         // 创建当前协程为主协程
         Fiber::GetThis();
@@ -61,42 +302,131 @@ m_useCaller(use_caller), m_name(name){
 
         // 加入线程池的线程id数组
         m_threadIds.push_back(m_rootThread);
-        
+
+        // 主线程的任务队列，主线程发布的任务进入这里，其他线程可以窃取
+            // 主线程不绑定CPU，按它当前所在的节点放置
+        int node = m_numaAware ? NumaTopology::NodeOfCpu(sched_getcpu()) : -1;
+        if (m_numaAware) {
+            NumaTopology::SetThreadNode(node);
+        }
+        m_workers.emplace_back(new (node) Worker());
+        m_workers.back()->node = node < 0 ? 0 : node;
+        m_workers.back()->threadId = m_rootThread;
+        m_workers.back()->rand = 1;
+        t_worker = m_workers.back().get();
     }
 
     // 还需要创建的额外线程
     m_threadCount = threads;
+    m_maxThreadCount = max_threads;
+    m_spawnWaitMs = std::max<uint64_t>(options.spawnWaitMs, 1);
+    m_idleRetireMs = options.idleRetireMs;
+
+    m_timeSliceNs = options.timeSliceMs * 1000000ull;
+    m_forcePreempt = m_timeSliceNs && options.forcePreempt;
+    if (m_forcePreempt) {
+        // 处理函数进程内只安装一次
+            // SA_NODEFER：处理函数切出协程以后不会返回，线程的信号屏蔽字不能留着本信号
+        static std::once_flag s_install;
+        std::call_once(s_install, []() {
+            struct sigaction sa;
+            memset(&sa, 0, sizeof(sa));
+            sa.sa_handler = &Scheduler::OnPreemptSignal;
+            sigemptyset(&sa.sa_mask);
+            sa.sa_flags = SA_RESTART | SA_NODEFER;
+            if (sigaction(kPreemptSignal, &sa, nullptr) != 0) {
+                std::cerr << "sigaction() failed: " << strerror(errno) << std::endl;
+            }
+        });
+    }
+
+    // 工作线程的任务队列，线程id在start()中填入；动态线程池的槽位一并分配
+    for (size_t i = 0; i < m_maxThreadCount; i++) {
+        std::vector<int> cpus;
+        int node;
+        PlaceWorker(options, i, cpus, node);
+
+        m_workers.emplace_back(new (m_numaAware ? node : -1) Worker());
+        m_workers.back()->rand = static_cast<uint32_t>(m_workers.size());
+        m_workers.back()->node = node;
+        m_workers.back()->cpus = cpus;
+    }
 }
 
-Scheduler::~Scheduler() {}
+Scheduler::~Scheduler() {
+    stopMetricsDump();
+    stopPoolControl();
+    stopWatchdog();
+
+    // 释放没有执行的任务
+    SchedulerTask* task = nullptr;
+    for (auto& worker : m_workers) {
+        while (worker->deque.pop(task)) {
+            delete task;
+        }
+        for (SchedulerTask* t : worker->inbox) {
+            delete t;
+        }
+        delete worker->runNext.exchange(nullptr);
+    }
+    while (m_injectQueue.pop(task)) {
+        delete task;
+    }
+    for (HighEntry& entry : m_highHeap) {
+        delete entry.task;
+    }
+    for (SchedulerTask* t : m_lowQueue) {
+        delete t;
+    }
+
+    if (GetThis() == this) {
+        t_scheduler = nullptr;
+        t_worker = nullptr;
+    }
+}
 
 // 初始化调度线程池
     // 如果caller线程只进行调度，caller启动工作线程后，发布任务，然后使用tickle()或stop()启动所有工作线程执行任务
 
 void Scheduler::start() {
-    std::cout << "Scheduler starts" << std::endl;
+    FIBER_LOG_TRACE("Scheduler starts");
     std::lock_guard<std::mutex> lock(m_mutex);
 
-    if (m_stopping) {
+    if (m_stopping.load(std::memory_order_acquire)) {
         std::cerr << "Scheduler is stopped" << std::endl;
         return;
     }
 
     assert(m_threads.empty());
-    m_threads.resize(m_threadCount);
+    m_threads.resize(m_maxThreadCount);
 
+    // 持有m_mutex期间新线程在run()中等待，直到线程id都填入任务队列
+    size_t offset = m_useCaller ? 1 : 0;
+    m_workerSlots.store(offset + m_threadCount, std::memory_order_release);
     for (size_t i = 0; i < m_threadCount; i++) {
-        m_threads[i].reset(new Thread(std::bind(&Scheduler::run, this), m_name + "_" + std::to_string(i)));
+        m_threads[i].reset(new Thread(std::bind(&Scheduler::run, this), m_name + "_" + std::to_string(i),
+                                      m_workers[i + offset]->cpus));
 
         m_threadIds.push_back(m_threads[i]->getId());
+        m_workers[i + offset]->threadId = m_threads[i]->getId();
     }
-    std::cout << "Scheduler start() ends" << std::endl;
+    m_liveThreadCount.store(m_threadCount, std::memory_order_relaxed);
+
+    if (m_maxThreadCount > m_threadCount) {
+        m_poolStop = false;
+        m_poolThread = std::thread(&Scheduler::poolControl, this);
+    }
+    if (m_timeSliceNs) {
+        m_watchdogStop = false;
+        m_watchdogThread = std::thread(&Scheduler::watchdog, this);
+    }
+    FIBER_LOG_TRACE("Scheduler start() ends");
 }
 
 
 
 void Scheduler::run() {
-    std::cout << "Scheduler::run() starts in thread: " << GetThreadId() << std::endl;
+    FIBER_LOG_TRACE("Scheduler::run() starts in thread: %d", GetThreadId());
 
     SetThis();
 
@@ -104,104 +434,703 @@ void Scheduler::run() {
         assert(t_scheduler_fiber == nullptr);
         // 创建主协程并将其设置到调度协程指针
         t_scheduler_fiber = Fiber::GetThis().get();
-    }
 
-    std::shared_ptr<Fiber> idle_fiber = std::make_shared<Fiber>(std::bind(&Scheduler::idle, this));
-    std::shared_ptr<Fiber> cb_fiber;
-
-    SchedulerTask task;
-
-    while(true) {
-        task.reset();
-        bool tickle_me = false;
-        // mute范围
+        // 找到本线程的任务队列
         {
             std::lock_guard<std::mutex> lock(m_mutex);
-            auto it = m_tasks.begin();
+            t_worker = findWorker(GetThreadId());
+        }
+        assert(t_worker != nullptr);
 
-            // 遍历所有的调度任务
-            while (it != m_tasks.end()) {
-                // 指定了调度线程，但是不是在当前线程上调度，然后就跳过这个任务，继续下一个
-                if (it->thread != -1 && it->thread != GetThreadId()) {
-                    it++;
-                    continue;
-                }
+        // 线程已经绑定到所在节点的CPU，之后分配的栈和协程从本节点的池中取，任务数组换成本节点的内存
+        if (m_numaAware) {
+            NumaTopology::SetThreadNode(t_worker->node);
+            t_worker->deque.relocate();
+        }
+    }
+    Worker* self = t_worker;
+    assert(self != nullptr);
 
-                // 发现可执行任务
-                assert(it->fiber || it->cb);
-                if (it->fiber) {
-                    assert(it->fiber->getState() == Fiber::READY);
-                }
+    if (m_forcePreempt) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        self->pthread = pthread_self();
+        self->signalable = true;
+    }
 
-                // 取出任务
-                task = *it;
-                m_tasks.erase(it);
-                m_activateThreadCount++;
-                break;
-            }
+    Fiber::ptr idle_fiber(new Fiber(std::bind(&Scheduler::idle, this)));
+    Fiber::ptr cb_fiber;
+
+    self->startNs.store(metrics_now_ns(), std::memory_order_relaxed);
+    self->stopNs.store(0, std::memory_order_relaxed);
 
-            tickle_me = tickle_me || (it != m_tasks.end());
+    while(true) {
+        // stop(Abort)：剩下的任务由stop()在所有线程退出后释放
+        if (m_aborting.load(std::memory_order_acquire)) {
+            break;
         }
 
-        if (tickle_me) {
-            tickle();
+        SchedulerTask* task = nextTask(self);
+
+        if (task) {
+            m_activateThreadCount++;
+
+            metrics_bump(self->switches);
+            recordStart(self, task);
+
+            // 还有剩余任务 -> 唤醒其他线程
+            if (!self->deque.empty() || !m_injectQueue.empty()) {
+                tickle();
+            }
         }
 
         //3. 执行任务
         // 任务为协程任务
-        if (task.fiber) {
-            task.fiber->resume();
+        if (task && task->fiber) {
+            if (m_timeSliceNs) {
+                beginSlice(self, task->fiber.get());
+            }
+            task->fiber->resume();
+            if (m_timeSliceNs) {
+                endSlice(self);
+            }
             m_activateThreadCount--;
-            task.reset();
-        } else if (task.cb) {  // 任务为函数任务
+            delete task;
+        } else if (task && task->cb) {  // 任务为函数任务
             if (cb_fiber) {
-                cb_fiber->reset(task.cb);
+                cb_fiber->reset(std::move(task->cb));
             } else {
-                cb_fiber.reset(new Fiber(task.cb));
+                cb_fiber = FiberPool::Acquire(std::move(task->cb));
+            }
+            delete task;
+            if (m_timeSliceNs) {
+                beginSlice(self, cb_fiber.get());
             }
             cb_fiber->resume();
+            if (m_timeSliceNs) {
+                endSlice(self);
+            }
             m_activateThreadCount--;
-            task.reset();
+
+            // 只有这里持有唯一的引用、并且协程已经结束时才复用
+                // 函数任务中途挂起（例如等待fd事件）时协程由等待它的一方持有，唤醒方可能已经在其他线程上resume了它，
+                // 不能再读它的状态：它可能刚写完TERM、还没有保存上下文；放手以后最后一个引用释放时回到对象池
+            if (cb_fiber->getRefCount() != 1 || cb_fiber->getState() != Fiber::TERM) {
+                cb_fiber.reset();
+            }
         } else {  // 4. 未取出任务->任务为空->切换到idle协程
             // 调度器已经关闭
-            if (m_stopping == true) break;
+            if (stopping()) break;
 
             // 运行idle协程
+            uint64_t idle_start = metrics_now_ns();
+            self->idleSinceNs.store(idle_start, std::memory_order_relaxed);
+            metrics_bump(self->switches);
+
             m_idleThreadCount++;
             idle_fiber->resume();
             m_idleThreadCount--;
+
+            self->idleSinceNs.store(0, std::memory_order_relaxed);
+            metrics_bump(self->idleNs, metrics_now_ns() - idle_start);
+
+            // 动态线程池中空闲太久，已经退出
+            if (self->retired) {
+                break;
+            }
         }
     }
 
-    std::cout << "Scheduler::run() ends in thread: " << GetThreadId() << std::endl;
+    self->stopNs.store(metrics_now_ns(), std::memory_order_relaxed);
+
+    // 之后看门狗不再向本线程发信号，线程可以退出
+    if (m_forcePreempt) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        self->signalable = false;
+    }
+
+    FIBER_LOG_TRACE("Scheduler::run() ends in thread: %d", GetThreadId());
 }
 
-void Scheduler::stop() {
-    std::cout << "Scheduler::stop() starts in thread: " << GetThreadId() << std::endl;
+void Scheduler::recordStart(Worker* self, SchedulerTask* task) {
+    metrics_bump(self->tasks);
+    if (task->postNs) {
+        uint64_t now = metrics_now_ns();
+        self->postToStart[task->priority].record(now > task->postNs ? now - task->postNs : 0);
+        if (task->deadlineNs && now > task->deadlineNs) {
+            metrics_bump(self->deadlineMisses);
+        }
+    }
+}
+
+Scheduler::SchedulerTask* Scheduler::nextTask(Worker* self) {
+    SchedulerTask* task = nullptr;
+
+    // 0. 高/低优先级任务，类别队列中的任务都没有指定线程
+    if (m_lowCount.load(std::memory_order_relaxed) > 0 && ++self->classTick % kLowAgingInterval == 0) {
+        if ((task = popLow())) {
+            return task;
+        }
+    }
+    if (m_highCount.load(std::memory_order_relaxed) > 0) {
+        if (self->highBurst < kHighBurst) {
+            if ((task = popHigh())) {
+                self->highBurst++;
+                return task;
+            }
+        }
+    }
+    // 走到普通任务的路径，连续计数清零
+    self->highBurst = 0;
+
+    // runnext槽位，连续取了kRunNextBurst次以后跳过一次
+    if (self->runNext.load(std::memory_order_relaxed)) {
+        if (self->runNextStreak < kRunNextBurst) {
+            if ((task = self->runNext.exchange(nullptr, std::memory_order_acquire))) {
+                self->runNextStreak++;
+                return task;
+            }
+        }
+    }
+    self->runNextStreak = 0;
+
+    // 1. 指定在本线程执行的任务
+    if (self->inboxSize.load(std::memory_order_acquire) > 0) {
+        std::lock_guard<std::mutex> lock(self->inboxMutex);
+        if (!self->inbox.empty()) {
+            task = self->inbox.front();
+            self->inbox.pop_front();
+            self->inboxSize.store(self->inbox.size(), std::memory_order_release);
+            return task;
+        }
+    }
+
+    // 2. 定期优先检查全局注入队列
+    bool got = false;
+    if (++self->tick % kInjectCheckInterval == 0) {
+        got = m_injectQueue.pop(task);
+    }
+
+    // 3. 本地队列，后进先出
+    if (!got) {
+        got = self->deque.pop(task);
+    }
+
+    // 4. 全局注入队列
+    if (!got) {
+        got = m_injectQueue.pop(task);
+    }
+
+    // 5. 从随机选择的其他线程开始依次窃取
+    size_t n = m_workerSlots.load(std::memory_order_acquire);
+    if (!got && n > 1) {
+        // xorshift32
+        uint32_t x = self->rand;
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        self->rand = x;
+
+        // numaAware时第一轮只窃取同一节点的线程，第二轮才跨节点
+        size_t start = x % n;
+        for (int round = 0; round < (m_numaAware ? 2 : 1) && !got; round++) {
+            for (size_t i = 0; i < n && !got; i++) {
+                Worker* victim = m_workers[(start + i) % n].get();
+                if (victim == self) {
+                    continue;
+                }
+                if (m_numaAware && (victim->node == self->node) != (round == 0)) {
+                    continue;
+                }
+                got = victim->deque.steal(task);
+            }
+        }
+        // 最后才窃取其他线程的runnext槽位：它的所属线程通常马上就会切过去
+        for (size_t i = 0; i < n && !got; i++) {
+            Worker* victim = m_workers[(start + i) % n].get();
+            if (victim != self && victim->runNext.load(std::memory_order_relaxed)) {
+                task = victim->runNext.exchange(nullptr, std::memory_order_acquire);
+                got = task != nullptr;
+            }
+        }
+        if (got) {
+            metrics_bump(self->steals);
+        }
+    }
+
+    // 6. 普通任务都没有了：跳过的runnext，刚刚让过路的高优先级任务，最后是低优先级任务
+    if (!got && (task = self->runNext.exchange(nullptr, std::memory_order_acquire))) {
+        got = true;
+    }
+    if (!got) {
+        if ((task = popHigh())) {
+            self->highBurst = 1;
+            return task;
+        }
+        return popLow();
+    }
+
+    // 从全局队列或者窃取得到的指定线程任务，转交给目标线程
+        // 指定的线程不存在时丢弃，原来的实现中这样的任务永远不会被执行
+    if (task->thread != -1 && task->thread != GetThreadId()) {
+        Worker* target = findWorker(task->thread);
+        if (target && pushInbox(target, task)) {
+            return nextTask(self);
+        }
+        // 指定的线程是动态线程池中已经退出的线程：它退出前没有共享栈协程，任务可以在任意线程上执行
+        if (isRetiredThread(task->thread)) {
+            task->thread = -1;
+            return task;
+        }
+        std::cerr << "Scheduler::nextTask() drops task for unknown thread: " << task->thread << std::endl;
+        delete task;
+        return nextTask(self);
+    }
+
+    return task;
+}
+
+Scheduler::Worker* Scheduler::findWorker(int thread_id) {
+    for (auto& worker : m_workers) {
+        if (worker->threadId.load(std::memory_order_relaxed) == thread_id) {
+            return worker.get();
+        }
+    }
+    return nullptr;
+}
+
+bool Scheduler::pushInbox(Worker* worker, SchedulerTask* task) {
+    std::lock_guard<std::mutex> lock(worker->inboxMutex);
+    // 和tryRetire()在同一把锁下检查，线程退出以后不会再收到任务
+    if (worker->threadId.load(std::memory_order_relaxed) != task->thread) {
+        return false;
+    }
+    worker->inbox.push_back(task);
+    worker->inboxSize.store(worker->inbox.size(), std::memory_order_release);
+    return true;
+}
 
-    if (stopping()) {
+void Scheduler::enqueueNext(SchedulerTask* task) {
+    // 指定了其他线程，或者不在本调度器的工作线程上
+    if (t_scheduler != this || t_worker == nullptr || (task->thread != -1 && task->thread != GetThreadId())) {
+        notify(enqueue(task));
         return;
     }
 
-    // 只能由调度器所在的线程发起stop
-    assert(GetThreadId() == m_rootThread);
+    // 放进槽位时不唤醒其他线程；挤出来的任务按普通任务投递
+    SchedulerTask* old = t_worker->runNext.exchange(task, std::memory_order_release);
+    if (old) {
+        notify(enqueue(old));
+    }
+}
 
-    // 所有线程开始工作
-    for (size_t i = 0; i < m_threadCount; i++) {
-        tickle();
+Scheduler::Worker* Scheduler::enqueueClass(SchedulerTask* task) {
+    if (task->thread != -1 || task->priority == PRIORITY_NORMAL) {
+        return enqueue(task);
     }
 
-    if (m_rootFiber) {
+    if (task->priority == PRIORITY_HIGH) {
+        // 没有截止时间的按投递时间排，相当于"立即到期"
+        uint64_t deadline = task->deadlineNs ? task->deadlineNs : NowNs();
+        std::lock_guard<std::mutex> lock(m_highMutex);
+        m_highHeap.push_back({deadline, m_highSeq++, task});
+        std::push_heap(m_highHeap.begin(), m_highHeap.end(), std::greater<HighEntry>());
+        m_highCount.store(m_highHeap.size(), std::memory_order_release);
+    } else {
+        std::lock_guard<std::mutex> lock(m_lowMutex);
+        m_lowQueue.push_back(task);
+        m_lowCount.store(m_lowQueue.size(), std::memory_order_release);
+    }
+    return nullptr;
+}
+
+Scheduler::SchedulerTask* Scheduler::popHigh() {
+    if (m_highCount.load(std::memory_order_acquire) == 0) {
+        return nullptr;
+    }
+
+    std::lock_guard<std::mutex> lock(m_highMutex);
+    if (m_highHeap.empty()) {
+        return nullptr;
+    }
+    std::pop_heap(m_highHeap.begin(), m_highHeap.end(), std::greater<HighEntry>());
+    SchedulerTask* task = m_highHeap.back().task;
+    m_highHeap.pop_back();
+    m_highCount.store(m_highHeap.size(), std::memory_order_release);
+    return task;
+}
+
+Scheduler::SchedulerTask* Scheduler::popLow() {
+    if (m_lowCount.load(std::memory_order_acquire) == 0) {
+        return nullptr;
+    }
+
+    std::lock_guard<std::mutex> lock(m_lowMutex);
+    if (m_lowQueue.empty()) {
+        return nullptr;
+    }
+    SchedulerTask* task = m_lowQueue.front();
+    m_lowQueue.pop_front();
+    m_lowCount.store(m_lowQueue.size(), std::memory_order_release);
+    return task;
+}
+
+Scheduler::Worker* Scheduler::enqueue(SchedulerTask* task) {
+    if (task->thread != -1) {
+        // 目标线程还没有启动时线程id未知，先放进全局队列，由取到它的线程转交
+        Worker* target = findWorker(task->thread);
+        if (target && pushInbox(target, task)) {
+            return target;
+        }
+    }
+
+    if (t_scheduler == this && t_worker) {
+        t_worker->deque.push(task);
+        return nullptr;
+    }
+
+    // 全局队列满了，等工作线程取走一些
+    while (!m_injectQueue.push(task)) {
+        std::this_thread::yield();
+    }
+    return nullptr;
+}
+
+bool Scheduler::hasPendingWork() {
+    return t_worker != nullptr && hasWork(t_worker);
+}
+
+bool Scheduler::hasWork(Worker* self) {
+    if (self->inboxSize.load(std::memory_order_acquire) > 0 || !m_injectQueue.empty()) {
+        return true;
+    }
+    if (m_highCount.load(std::memory_order_acquire) > 0 || m_lowCount.load(std::memory_order_acquire) > 0) {
+        return true;
+    }
+    if (self->runNext.load(std::memory_order_acquire)) {
+        return true;
+    }
+    size_t n = m_workerSlots.load(std::memory_order_acquire);
+    for (size_t i = 0; i < n; i++) {
+        if (!m_workers[i]->deque.empty()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void Scheduler::park() {
+    Worker* self = t_worker;
+    assert(self != nullptr);
+
+    {
+        std::lock_guard<std::mutex> lock(m_parkMutex);
+        self->parked.store(1, std::memory_order_relaxed);
+        m_parked.push_back(self);
+    }
+
+    // 登记停车以后再检查一次，和tickle()中的检查构成Dekker式的同步，避免丢失唤醒
+        // 发布任务的线程要么看到本线程在停车（唤醒它），要么本线程在这里看到新任务
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (hasWork(self) || stopping()) {
+        if (!unpark(self)) {
+            // 已经被其他线程唤醒，等它置0完成
+            while (self->parked.load(std::memory_order_acquire) == 1) {
+                futex_wait(&self->parked, 1);
+            }
+        }
+        return;
+    }
+
+    uint64_t timeout = parkTimeoutNs(self);
+    if (timeout == 0) {
+        while (self->parked.load(std::memory_order_acquire) == 1) {
+            futex_wait(&self->parked, 1);
+        }
+        return;
+    }
+
+    // 动态线程池中多出来的线程：超时以后自己出列，尝试退出
+    uint64_t deadline = NowNs() + timeout;
+    while (self->parked.load(std::memory_order_acquire) == 1) {
+        uint64_t now = NowNs();
+        if (now < deadline) {
+            futex_wait_for(&self->parked, 1, deadline - now);
+            continue;
+        }
+        if (unpark(self)) {
+            tryRetire(self);
+            return;
+        }
+        // 已经被其他线程唤醒，等它置0完成
+        while (self->parked.load(std::memory_order_acquire) == 1) {
+            futex_wait(&self->parked, 1);
+        }
+    }
+}
+
+uint64_t Scheduler::parkTimeoutNs(Worker* self) const {
+    if (m_maxThreadCount <= m_threadCount || m_idleRetireMs == 0 || self->threadId.load(std::memory_order_relaxed) == m_rootThread) {
+        return 0;
+    }
+    if (m_liveThreadCount.load(std::memory_order_relaxed) <= m_threadCount) {
+        return 0;
+    }
+    return m_idleRetireMs * 1000000ull;
+}
+
+bool Scheduler::tryRetire(Worker* self) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_stopping.load(std::memory_order_relaxed) || m_liveThreadCount.load(std::memory_order_relaxed) <= m_threadCount) {
+        return false;
+    }
+    // 共享栈在线程退出时释放，上面还有协程时不能退出
+    if (Fiber::SharedStackFibers() > 0) {
+        return false;
+    }
+
+    int thread_id = GetThreadId();
+    {
+        std::lock_guard<std::mutex> inbox_lock(self->inboxMutex);
+        if (!self->inbox.empty() || !self->deque.empty() || self->runNext.load(std::memory_order_acquire)) {
+            return false;
+        }
+        // 之后findWorker()找不到本线程，pushInbox()也会拒绝
+        self->threadId.store(-1, std::memory_order_relaxed);
+    }
+    self->retired = true;
+
+    m_threadIds.erase(std::remove(m_threadIds.begin(), m_threadIds.end(), thread_id), m_threadIds.end());
+    m_retiredIds.push_back(thread_id);
+    m_liveThreadCount.fetch_sub(1, std::memory_order_relaxed);
+    m_retires.fetch_add(1, std::memory_order_relaxed);
+    FIBER_LOG_TRACE("Scheduler retires idle thread: %d", thread_id);
+    return true;
+}
+
+bool Scheduler::spawnWorker() {
+    size_t offset = m_useCaller ? 1 : 0;
+    for (size_t i = 0; i < m_threads.size(); i++) {
+        Worker* worker = m_workers[i + offset].get();
+        if (m_threads[i] && !worker->retired) {
+            continue;
+        }
+
+        // 退出的线程已经离开run()，不会再碰任务队列
+        if (m_threads[i]) {
+            m_threads[i]->join();
+        }
+        worker->retired = false;
+
+        // 先放开遍历范围，新线程发布的任务要能被窃取
+        if (m_workerSlots.load(std::memory_order_relaxed) < i + offset + 1) {
+            m_workerSlots.store(i + offset + 1, std::memory_order_release);
+        }
+        // 持有m_mutex期间新线程在run()中等待，直到线程id填入任务队列
+        m_threads[i].reset(new Thread(std::bind(&Scheduler::run, this), m_name + "_" + std::to_string(i),
+                                      worker->cpus));
+        m_threadIds.push_back(m_threads[i]->getId());
+        worker->threadId = m_threads[i]->getId();
+
+        m_liveThreadCount.fetch_add(1, std::memory_order_relaxed);
+        m_spawns.fetch_add(1, std::memory_order_relaxed);
+        FIBER_LOG_TRACE("Scheduler spawns thread: %d", m_threads[i]->getId());
+        return true;
+    }
+    return false;
+}
+
+bool Scheduler::hasQueuedTasks() {
+    if (!m_injectQueue.empty()) {
+        return true;
+    }
+    if (m_highCount.load(std::memory_order_acquire) > 0 || m_lowCount.load(std::memory_order_acquire) > 0) {
+        return true;
+    }
+    size_t n = m_workerSlots.load(std::memory_order_acquire);
+    for (size_t i = 0; i < n; i++) {
+        Worker* worker = m_workers[i].get();
+        if (!worker->deque.empty() || worker->inboxSize.load(std::memory_order_acquire) > 0
+            || worker->runNext.load(std::memory_order_acquire)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool Scheduler::isRetiredThread(int thread_id) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return std::find(m_retiredIds.begin(), m_retiredIds.end(), thread_id) != m_retiredIds.end();
+}
+
+void Scheduler::poolControl() {
+    // 每个间隔采样一次，连续spawnWaitMs都是"有任务排队、没有空闲线程"时增加一个线程
+    uint64_t interval_ms = std::max<uint64_t>(m_spawnWaitMs / 4, 1);
+    uint64_t starved_since = 0;
+
+    std::unique_lock<std::mutex> lock(m_poolMutex);
+    while (!m_poolCond.wait_for(lock, std::chrono::milliseconds(interval_ms), [this]() {return m_poolStop;})) {
+        lock.unlock();
+
+        uint64_t now = NowNs();
+        bool starved = m_idleThreadCount.load(std::memory_order_relaxed) == 0 && hasQueuedTasks();
+        if (!starved) {
+            starved_since = 0;
+        } else if (starved_since == 0) {
+            starved_since = now;
+        } else if (now - starved_since >= m_spawnWaitMs * 1000000ull
+                   && m_liveThreadCount.load(std::memory_order_relaxed) < m_maxThreadCount) {
+            std::lock_guard<std::mutex> guard(m_mutex);
+            if (!m_stopping.load(std::memory_order_relaxed) && spawnWorker()) {
+                // 新线程开始取任务以后重新计时
+                starved_since = 0;
+            }
+        }
+
+        lock.lock();
+    }
+}
+
+void Scheduler::stopPoolControl() {
+    {
+        std::lock_guard<std::mutex> lock(m_poolMutex);
+        m_poolStop = true;
+    }
+    m_poolCond.notify_all();
+    if (m_poolThread.joinable()) {
+        m_poolThread.join();
+    }
+}
+
+bool Scheduler::unpark(Worker* worker) {
+    {
+        std::lock_guard<std::mutex> lock(m_parkMutex);
+        auto it = std::find(m_parked.begin(), m_parked.end(), worker);
+        if (it == m_parked.end()) {
+            return false;
+        }
+        m_parked.erase(it);
+    }
+
+    worker->parked.store(0, std::memory_order_release);
+    futex_wake(&worker->parked, 1);
+    return true;
+}
+
+void Scheduler::notify(Worker* target) {
+    if (target == nullptr) {
         tickle();
+        return;
+    }
+
+    if (!unpark(target)) {
+        // 目标线程可能阻塞在其他地方，和它进入等待前的检查配对
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        wakeThread(target->threadId.load(std::memory_order_relaxed));
+    }
+}
+
+bool Scheduler::unparkOne() {
+    Worker* worker = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(m_parkMutex);
+        if (m_parked.empty()) {
+            return false;
+        }
+        worker = m_parked.back();
+        m_parked.pop_back();
+    }
+
+    worker->parked.store(0, std::memory_order_release);
+    futex_wake(&worker->parked, 1);
+    return true;
+}
+
+size_t Scheduler::unparkSome(size_t count) {
+    std::vector<Worker*> workers;
+    {
+        std::lock_guard<std::mutex> lock(m_parkMutex);
+        while (workers.size() < count && !m_parked.empty()) {
+            workers.push_back(m_parked.back());
+            m_parked.pop_back();
+        }
+    }
+
+    for (Worker* worker : workers) {
+        worker->parked.store(0, std::memory_order_release);
+        futex_wake(&worker->parked, 1);
+    }
+    return workers.size();
+}
+
+void Scheduler::unparkAll() {
+    std::vector<Worker*> workers;
+    {
+        std::lock_guard<std::mutex> lock(m_parkMutex);
+        workers.swap(m_parked);
+    }
+
+    for (Worker* worker : workers) {
+        worker->parked.store(0, std::memory_order_release);
+        futex_wake(&worker->parked, 1);
     }
+}
+
+void Scheduler::stop() {
+    stop(Drain());
+}
+
+Scheduler::StopReport Scheduler::stop(const Drain& drain) {
+    return stopImpl(false, drain.timeoutMs);
+}
+
+Scheduler::StopReport Scheduler::stop(const Abort&) {
+    return stopImpl(true, 0);
+}
+
+Scheduler::StopReport Scheduler::stopImpl(bool abort, uint64_t timeout_ms) {
+    FIBER_LOG_TRACE("Scheduler::stop() starts in thread: %d", GetThreadId());
+
+    StopReport report;
+    if (m_stopping.load(std::memory_order_acquire)) {
+        return report;
+    }
+
+    // 只能由调度器所在的线程发起stop
+    assert(GetThreadId() == m_rootThread);
+    uint64_t start = NowNs();
 
     // 不再添加任务->当任务为0时工作线程不在进行idle而是退出
-    m_stopping = true;
+        // 先置位再唤醒：停车的线程登记以后会再检查一次m_stopping
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (abort) {
+            m_aborting.store(true, std::memory_order_seq_cst);
+        }
+        m_stopping.store(true, std::memory_order_seq_cst);
+    }
+    // 之后线程数不再变化
+    stopPoolControl();
+
+    // Drain限时：到时间还没有停下来就转为Abort
+    std::thread deadline;
+    if (!abort && timeout_ms) {
+        m_stopDone = false;
+        deadline = std::thread([this, timeout_ms]() {
+            std::unique_lock<std::mutex> lock(m_stopMutex);
+            if (!m_stopCond.wait_for(lock, std::chrono::milliseconds(timeout_ms), [this]() {return m_stopDone;})) {
+                lock.unlock();
+                abortNow();
+            }
+        });
+    }
+
+    // 唤醒所有线程，让它们处理完剩余任务（Abort时直接）退出
+    wakeAll();
     // 调度器所在的线程开始处理任务
         // 在use caller情况下，调度器协程结束时，应该返回caller协程
     if (m_rootFiber) {
         m_rootFiber->resume();
-        std::cout << "m_rootFiber ends in thread: " << GetThreadId() << std::endl;
+        FIBER_LOG_TRACE("m_rootFiber ends in thread: %d", GetThreadId());
     }
 
     std::vector<std::shared_ptr<Thread>> thrs;
@@ -211,59 +1140,439 @@ void Scheduler::stop() {
     }
 
     for (auto &i : thrs) {
-        i->join();
+        // 动态线程池中没有用过的槽位
+        if (i) {
+            i->join();
+        }
+    }
+    m_liveThreadCount.store(0, std::memory_order_relaxed);
+    // Drain期间看门狗照常工作，线程都退出以后再停
+    stopWatchdog();
+
+    if (deadline.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(m_stopMutex);
+            m_stopDone = true;
+        }
+        m_stopCond.notify_all();
+        deadline.join();
+    }
+
+    stopMetricsDump();
+
+    report.aborted = m_aborting.load(std::memory_order_acquire);
+    dropQueued(report);
+    report.elapsedMs = (NowNs() - start) / 1000000;
+    FIBER_LOG_TRACE("Scheduler::stop() ends in thread: %d, dropped %zu callbacks and %zu fibers",
+                    GetThreadId(), report.droppedCallbacks, report.droppedFibers);
+    return report;
+}
+
+void Scheduler::abortNow() {
+    m_aborting.store(true, std::memory_order_seq_cst);
+    wakeAll();
+}
+
+void Scheduler::wakeAll() {
+    unparkAll();
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    size_t n = m_workerSlots.load(std::memory_order_acquire);
+    for (size_t i = 0; i < n; i++) {
+        int thread_id = m_workers[i]->threadId.load(std::memory_order_relaxed);
+        if (thread_id != -1) {
+            wakeThread(thread_id);
+        }
+    }
+}
+
+void Scheduler::dropQueued(StopReport& report) {
+    auto drop = [&report](SchedulerTask* task) {
+        if (task->fiber) {
+            report.droppedFibers++;
+        } else {
+            report.droppedCallbacks++;
+        }
+        delete task;
+    };
+
+    // 所有工作线程都已经退出，这里是唯一访问队列的线程
+    SchedulerTask* task = nullptr;
+    for (auto& worker : m_workers) {
+        while (worker->deque.pop(task)) {
+            drop(task);
+        }
+        std::lock_guard<std::mutex> lock(worker->inboxMutex);
+        for (SchedulerTask* t : worker->inbox) {
+            drop(t);
+        }
+        worker->inbox.clear();
+        worker->inboxSize.store(0, std::memory_order_relaxed);
+        if ((task = worker->runNext.exchange(nullptr))) {
+            drop(task);
+        }
+    }
+    while (m_injectQueue.pop(task)) {
+        drop(task);
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_highMutex);
+        for (HighEntry& entry : m_highHeap) {
+            drop(entry.task);
+        }
+        m_highHeap.clear();
+        m_highCount.store(0, std::memory_order_relaxed);
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_lowMutex);
+        for (SchedulerTask* t : m_lowQueue) {
+            drop(t);
+        }
+        m_lowQueue.clear();
+        m_lowCount.store(0, std::memory_order_relaxed);
     }
-    std::cout << "Scheduler::stop() ends in thread: " << GetThreadId() << std::endl;
 }
 
 void Scheduler::tickle(){
-    tickler++;
+    // 和park()中的检查配对：先发布任务，再看有没有停车的线程
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (m_idleThreadCount.load(std::memory_order_relaxed) == 0) {
+        return;
+    }
+    unparkOne();
 }
 
 void Scheduler::idle() {
     while (true) {
-        std::cout << "resume idle(), sleeping in thread: " << GetThreadId() << std::endl;
+        FIBER_LOG_TRACE("resume idle(), sleeping in thread: %d", GetThreadId());
 
-        while (tickler == 0 && m_stopping == false) {
-            std::this_thread::sleep_for(std::chrono::milliseconds(3000));
-        }
+        park();
 
-        tickler--;
-        std::shared_ptr<Fiber> curr = Fiber::GetThis();
+        Fiber::ptr curr = Fiber::GetThis();
         auto raw_ptr = curr.get();
         curr.reset();
         raw_ptr->yield();
     }
 }
 
+Scheduler::SchedulerTask* Scheduler::makeTask(Fiber::ptr fc, int thread_id) {
+    // 共享栈协程只能在创建它的线程上运行
+    if (thread_id == -1 && fc->isSharedStack()) {
+        thread_id = fc->getOwnerThread();
+    }
+    SchedulerTask* task = new SchedulerTask(std::move(fc), thread_id);
+    task->postNs = metrics_now_ns();
+    return task;
+}
+
+Scheduler::SchedulerTask* Scheduler::makeTask(UniqueFunction fc, int thread_id) {
+    SchedulerTask* task = new SchedulerTask(std::move(fc), thread_id);
+    task->postNs = metrics_now_ns();
+    return task;
+}
+
 // 发布线程任务
-void Scheduler::scheduleLock(std::shared_ptr<Fiber> fc, int thread_id) {
-    {
-        std::lock_guard<std::mutex> lock(m_mutex);
-        SchedulerTask task;
+void Scheduler::scheduleLock(Fiber::ptr fc, int thread_id) {
+    notify(enqueue(makeTask(std::move(fc), thread_id)));
+}
+
+// 发布函数任务
+void Scheduler::scheduleLock(UniqueFunction fc, int thread_id) {
+    notify(enqueue(makeTask(std::move(fc), thread_id)));
+}
 
-        task.fiber = fc;
-        task.cb = nullptr;
-        task.thread = thread_id;
+void Scheduler::scheduleLock(Fiber::ptr fc, Priority priority, uint64_t deadline_ns, int thread_id) {
+    SchedulerTask* task = makeTask(std::move(fc), thread_id);
+    task->priority = priority;
+    task->deadlineNs = deadline_ns;
+    notify(enqueueClass(task));
+}
 
-        m_tasks.push_back(task);
+void Scheduler::scheduleLock(UniqueFunction fc, Priority priority, uint64_t deadline_ns, int thread_id) {
+    SchedulerTask* task = makeTask(std::move(fc), thread_id);
+    task->priority = priority;
+    task->deadlineNs = deadline_ns;
+    notify(enqueueClass(task));
+}
+
+void Scheduler::scheduleNext(Fiber::ptr fc, int thread_id) {
+    enqueueNext(makeTask(std::move(fc), thread_id));
+}
+
+void Scheduler::scheduleNext(UniqueFunction fc, int thread_id) {
+    enqueueNext(makeTask(std::move(fc), thread_id));
+}
+
+void Scheduler::YieldToNext() {
+    Fiber::ptr curr = Fiber::GetThis();
+    Scheduler* scheduler = t_scheduler;
+    Worker* self = t_worker;
+
+    // 只有私有栈的任务协程之间可以直接切换
+    if (scheduler && self && curr.get() != t_scheduler_fiber && curr->isRunInScheduler() && !curr->isSharedStack()
+        && self->runNextStreak < kRunNextBurst) {
+        SchedulerTask* task = self->runNext.load(std::memory_order_relaxed);
+        if (task && task->fiber && task->fiber != curr && !task->fiber->isSharedStack() && task->fiber->isRunInScheduler()
+            && self->runNext.compare_exchange_strong(task, nullptr, std::memory_order_acquire)) {
+            self->runNextStreak++;
+            metrics_bump(self->transfers);
+            scheduler->recordStart(self, task);
+            Fiber::ptr next = std::move(task->fiber);
+            delete task;
+            // 直接切换也算新的一次调度，时间片重新计算
+            if (scheduler->m_timeSliceNs) {
+                scheduler->beginSlice(self, next.get());
+            }
+            curr->transferTo(std::move(next));
+            return;
+        }
     }
-    tickle();
+    curr->yield();
 }
 
-// 发布函数任务
-void Scheduler::scheduleLock(std::function<void()> fc, int thread_id) {
+void Scheduler::YieldToTail() {
+    Scheduler* scheduler = t_scheduler;
+    Worker* self = t_worker;
+    Fiber::ptr curr = Fiber::GetThis();
+    assert(scheduler && self && curr.get() != t_scheduler_fiber && curr->isRunInScheduler());
+
+    self->preempt.store(false, std::memory_order_relaxed);
+    metrics_bump(self->preemptions);
+
+    // 共享栈协程由makeTask()固定在创建它的线程上，进那个线程的inbox
+    Fiber* raw_ptr = curr.get();
+    scheduler->notify(scheduler->enqueueTail(scheduler->makeTask(std::move(curr), -1)));
+    raw_ptr->yield();
+}
+
+Scheduler::Worker* Scheduler::enqueueTail(SchedulerTask* task) {
+    if (task->thread != -1 || t_scheduler != this || t_worker == nullptr) {
+        return enqueue(task);
+    }
+    // 不能像enqueue()那样等全局队列腾出位置：信号处理函数中调用时，取走任务的可能就是本线程
+    if (!m_injectQueue.push(task)) {
+        t_worker->deque.push(task);
+    }
+    return nullptr;
+}
+
+void Scheduler::beginSlice(Worker* self, Fiber* fiber) {
+    self->preempt.store(false, std::memory_order_relaxed);
+    self->sliceFiber.store(fiber->getId(), std::memory_order_relaxed);
+    self->sliceStartNs.store(NowNs(), std::memory_order_release);
+}
+
+void Scheduler::endSlice(Worker* self) {
+    self->sliceStartNs.store(0, std::memory_order_relaxed);
+}
+
+void Scheduler::watchdog() {
+    uint64_t interval_ms = std::max<uint64_t>(m_timeSliceNs / 4000000ull, 1);
+
+    std::unique_lock<std::mutex> lock(m_watchdogMutex);
+    while (!m_watchdogCond.wait_for(lock, std::chrono::milliseconds(interval_ms), [this]() {return m_watchdogStop;})) {
+        lock.unlock();
+
+        uint64_t now = NowNs();
+        size_t n = m_workerSlots.load(std::memory_order_acquire);
+        for (size_t i = 0; i < n; i++) {
+            Worker* worker = m_workers[i].get();
+            uint64_t since = worker->sliceStartNs.load(std::memory_order_acquire);
+            if (since == 0 || now < since + m_timeSliceNs) {
+                continue;
+            }
+
+            // 同一次调度只要求一次；任务在置位之前刚好结束时，下一个任务会在第一个安全点多让出一次
+            if (worker->flaggedNs != since) {
+                worker->flaggedNs = since;
+                worker->preempt.store(true, std::memory_order_relaxed);
+                worker->overruns.fetch_add(1, std::memory_order_relaxed);
+            } else if (worker->reportedNs != since && now >= since + 2 * m_timeSliceNs) {
+                // 又过了一个时间片还没有让出：没有安全点，或者不在PreemptibleScope中
+                worker->reportedNs = since;
+                if (m_overrunLogNs == 0 || now >= m_overrunLogNs + kOverrunLogIntervalNs) {
+                    FIBER_LOG_WARN("Scheduler %s: fiber %llu on thread %d has run %llu ms without yielding "
+                                   "(time slice %llu ms, %llu similar reports suppressed)", m_name.c_str(),
+                                   (unsigned long long)worker->sliceFiber.load(std::memory_order_relaxed),
+                                   worker->threadId.load(std::memory_order_relaxed),
+                                   (unsigned long long)((now - since) / 1000000),
+                                   (unsigned long long)(m_timeSliceNs / 1000000),
+                                   (unsigned long long)m_overrunLogSuppressed);
+                    m_overrunLogNs = now;
+                    m_overrunLogSuppressed = 0;
+                } else {
+                    m_overrunLogSuppressed++;
+                }
+            }
+
+            // 协程可能过一会儿才进入PreemptibleScope，没有让出之前每次检查都再发一次
+            if (m_forcePreempt && worker->preempt.load(std::memory_order_relaxed)) {
+                std::lock_guard<std::mutex> guard(m_mutex);
+                if (worker->signalable && worker->sliceStartNs.load(std::memory_order_relaxed) == since) {
+                    pthread_kill(worker->pthread, kPreemptSignal);
+                }
+            }
+        }
+
+        lock.lock();
+    }
+}
+
+void Scheduler::stopWatchdog() {
     {
-        std::lock_guard<std::mutex> lock(m_mutex);
-        SchedulerTask task;
+        std::lock_guard<std::mutex> lock(m_watchdogMutex);
+        m_watchdogStop = true;
+    }
+    m_watchdogCond.notify_all();
+    if (m_watchdogThread.joinable()) {
+        m_watchdogThread.join();
+    }
+}
+
+void Scheduler::OnPreemptSignal(int) {
+    // 只有看门狗要求让出、并且处在PreemptibleScope中的任务协程才切出，其余情况（包括其他来源的同一信号）直接返回
+    Worker* self = t_worker;
+    if (self == nullptr || !self->preempt.load(std::memory_order_relaxed) || !Fiber::InPreemptibleScope()) {
+        return;
+    }
+
+    // 协程之后可能在另一个线程上恢复，从处理函数返回时恢复的是那个线程的errno
+    int saved_errno = errno;
+    metrics_bump(self->forcedPreemptions);
+    YieldToTail();
+    errno = saved_errno;
+}
+
+uint64_t Scheduler::NowNs() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+void Scheduler::enqueueBatch(const std::vector<SchedulerTask*>& tasks) {
+    // 指定了线程的任务逐个唤醒目标线程，其余的任务合计唤醒一次
+    std::vector<Worker*> targets;
+    size_t count = 0;
+    for (SchedulerTask* task : tasks) {
+        Worker* target = enqueue(task);
+        if (target == nullptr) {
+            count++;
+        } else if (std::find(targets.begin(), targets.end(), target) == targets.end()) {
+            targets.push_back(target);
+        }
+    }
+
+    for (Worker* target : targets) {
+        notify(target);
+    }
+
+    if (count == 0) {
+        return;
+    }
 
-        task.fiber = nullptr;
-        task.cb = fc;
-        task.thread = s_thread_id;
+    // 和park()中的检查配对
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (m_idleThreadCount.load(std::memory_order_relaxed) == 0) {
+        return;
+    }
 
-        m_tasks.push_back(task);
+    // 停车的线程不够时交给tickle()，子类可能还有其他方式唤醒空闲线程
+    if (unparkSome(count) < count) {
+        tickle();
     }
-    tickle();
 }
 
+SchedulerMetrics Scheduler::getMetrics() {
+    SchedulerMetrics metrics;
+    metrics.name = m_name;
+
+    uint64_t now = metrics_now_ns();
+    LatencyHistogram latency;
+    LatencyHistogram class_latency[kPriorityClasses];
+    size_t slots = m_workerSlots.load(std::memory_order_acquire);
+    for (size_t i = 0; i < slots; i++) {
+        Worker* worker = m_workers[i].get();
+        WorkerMetrics w;
+        w.threadId = worker->threadId.load(std::memory_order_relaxed);
+        w.tasks = worker->tasks.load(std::memory_order_relaxed);
+        w.switches = worker->switches.load(std::memory_order_relaxed);
+        w.transfers = worker->transfers.load(std::memory_order_relaxed);
+        w.steals = worker->steals.load(std::memory_order_relaxed);
+        w.queueDepth = worker->deque.size() + worker->inboxSize.load(std::memory_order_relaxed);
 
+        // 正在空闲的这一段也算进空闲时间
+        w.idleNs = worker->idleNs.load(std::memory_order_relaxed);
+        uint64_t idle_since = worker->idleSinceNs.load(std::memory_order_relaxed);
+        if (idle_since && now > idle_since) {
+            w.idleNs += now - idle_since;
+        }
+
+        uint64_t start = worker->startNs.load(std::memory_order_relaxed);
+        uint64_t stop = worker->stopNs.load(std::memory_order_relaxed);
+        uint64_t end = stop ? stop : now;
+        if (start && end > start + w.idleNs) {
+            w.busyNs = end - start - w.idleNs;
+        }
+
+        metrics.tasks += w.tasks;
+        metrics.switches += w.switches;
+        metrics.transfers += w.transfers;
+        metrics.steals += w.steals;
+        metrics.idleNs += w.idleNs;
+        metrics.busyNs += w.busyNs;
+        metrics.queueDepth += w.queueDepth;
+        metrics.workers.push_back(w);
+
+        for (int c = 0; c < kPriorityClasses; c++) {
+            class_latency[c].merge(worker->postToStart[c]);
+            latency.merge(worker->postToStart[c]);
+        }
+        metrics.deadlineMisses += worker->deadlineMisses.load(std::memory_order_relaxed);
+        metrics.overruns += worker->overruns.load(std::memory_order_relaxed);
+        metrics.preemptions += worker->preemptions.load(std::memory_order_relaxed);
+        metrics.forcedPreemptions += worker->forcedPreemptions.load(std::memory_order_relaxed);
+    }
+
+    metrics.injectQueueDepth = m_injectQueue.size();
+    metrics.activeThreads = m_activateThreadCount.load(std::memory_order_relaxed);
+    metrics.idleThreads = m_idleThreadCount.load(std::memory_order_relaxed);
+    metrics.totalFibers = Fiber::TotalFibers();
+    metrics.postToStart = LatencySummary::From(latency);
+    for (int c = 0; c < kPriorityClasses; c++) {
+        metrics.classWait[c] = LatencySummary::From(class_latency[c]);
+    }
+    metrics.liveThreads = m_liveThreadCount.load(std::memory_order_relaxed);
+    metrics.threadsSpawned = m_spawns.load(std::memory_order_relaxed);
+    metrics.threadsRetired = m_retires.load(std::memory_order_relaxed);
+    metrics.classQueueDepth[PRIORITY_HIGH] = m_highCount.load(std::memory_order_relaxed);
+    metrics.classQueueDepth[PRIORITY_NORMAL] = metrics.queueDepth + metrics.injectQueueDepth;
+    metrics.classQueueDepth[PRIORITY_LOW] = m_lowCount.load(std::memory_order_relaxed);
+    return metrics;
+}
+
+void Scheduler::setMetricsDump(uint64_t interval_ms, std::function<void(const SchedulerMetrics&)> cb) {
+    stopMetricsDump();
+    if (!cb || interval_ms == 0) {
+        return;
+    }
+
+    m_dumpStop = false;
+    m_dumpThread = std::thread([this, interval_ms, cb]() {
+        std::unique_lock<std::mutex> lock(m_dumpMutex);
+        while (!m_dumpCond.wait_for(lock, std::chrono::milliseconds(interval_ms), [this]() {return m_dumpStop;})) {
+            lock.unlock();
+            cb(getMetrics());
+            lock.lock();
+        }
+    });
+}
+
+void Scheduler::stopMetricsDump() {
+    {
+        std::lock_guard<std::mutex> lock(m_dumpMutex);
+        m_dumpStop = true;
+    }
+    m_dumpCond.notify_all();
+    if (m_dumpThread.joinable()) {
+        m_dumpThread.join();
+    }
+}
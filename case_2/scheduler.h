@@ -2,10 +2,19 @@
 #define _SCHEDULER_H_
 
 #include <vector>
+#include <deque>
+#include <initializer_list>
 #include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <pthread.h>
 
 #include "coroutine.h"
 #include "fiber_thread.h"
+#include "work_steal_deque.h"
+#include "mpmc_queue.h"
+#include "metrics.h"
+#include "future.h"
 
 class Fiber;
 
@@ -13,8 +22,60 @@ class Thread;
 
 class Scheduler {
 public:
+    // 调度器选项
+    struct Options {
+        size_t threads = 1;
+        bool useCaller = true;
+        std::string name = "Scheduler";
+
+        // 工作线程可以使用的CPU，为空时不绑定；use_caller的主线程不绑定
+        std::vector<int> cpus;
+        // 为true时第i个工作线程只绑定cpus[i % cpus.size()]，否则绑定整个集合（numaAware时为集合中同一节点的部分）
+        bool pinEach = false;
+
+        // 按NUMA节点放置工作线程
+            // cpus为空时工作线程轮流分配到各个节点，绑定到节点的所有CPU；否则按绑定的CPU确定节点
+            // 工作线程的任务队列从所在节点分配，协程栈和协程池只和同节点的线程交换，窃取时最后才跨节点
+        bool numaAware = false;
+
+        // 动态线程池：maxThreads大于threads时启用，threads是常驻的工作线程数，maxThreads是上限（都包括use_caller的主线程）
+            // 有任务排队而所有工作线程都在忙（没有线程在idle中），持续spawnWaitMs毫秒以后增加一个工作线程
+                // 例如任务阻塞在没有hook的系统调用里；CPU密集的负载下同样会加到上限，上限按能接受的超额线程数设置
+            // 超出threads的工作线程停车超过idleRetireMs毫秒后退出，还有指定给它的任务、共享栈协程时不退出
+            // 工作线程的任务队列按maxThreads预先分配，增减线程时不停止调度器
+        size_t maxThreads = 0;
+        uint64_t spawnWaitMs = 10;
+        uint64_t idleRetireMs = 5000;
+
+        // 协作式抢占：timeSliceMs不为0时启动一个看门狗线程，每timeSliceMs/4毫秒检查各工作线程当前任务开始运行的时间
+            // 任务运行超过时间片时置位所在线程的抢占标志（计入metrics的overruns），任务在安全点Fiber::MaybeYield()中让出并排到队尾
+            // 要求让出以后又过了一个时间片还没有让出的任务，用FIBER_LOG_WARN报告线程id、协程id和已经运行的时间，每秒最多一条
+        // forcePreempt为true时看门狗同时向超时的线程发送SIGURG，协程处在Fiber::PreemptibleScope中时由信号处理函数直接让出
+        uint64_t timeSliceMs = 0;
+        bool forcePreempt = false;
+
+        Options() {}
+        Options(size_t threads_, bool use_caller, const std::string& name_):
+        threads(threads_), useCaller(use_caller), name(name_) {}
+    };
+
+    // 任务的优先级类别
+        // 高优先级任务放在调度器全局的一个按截止时间排序的队列中（EDF），工作线程取任务时最先看这里
+        // 普通任务走原来的路径（本地deque、全局注入队列、窃取）
+        // 低优先级任务放在全局的先进先出队列中，其他任务都取完了才执行
+        // 防饥饿：连续执行kHighBurst个高优先级任务后让普通任务先走一次；每kLowAgingInterval次取任务先看一次低优先级队列
+        // 从来没有投递过高/低优先级任务时，取任务只多读两个计数
+    enum Priority {
+        PRIORITY_HIGH = 0,
+        PRIORITY_NORMAL = 1,
+        PRIORITY_LOW = 2
+    };
+    static const int kPriorityClasses = SchedulerMetrics::kClasses;
+
     Scheduler(size_t threads = 1, bool use_caller = true, const std::string& name = "Scheduler");
 
+    explicit Scheduler(const Options& options);
+
     virtual ~Scheduler();
 
     // 获取调度器的名称
@@ -30,8 +91,72 @@ public:
     static Fiber* GetSchedulerFiber();
 
     // 添加调度任务
-    void scheduleLock(std::shared_ptr<Fiber> fc, int thread_id = -1);
-    void scheduleLock(std::function<void()> fc, int thread_id = -1);
+    // 函数任务被移动进队列，捕获不超过FIBER_TASK_INLINE_SIZE字节时不分配内存
+    void scheduleLock(Fiber::ptr fc, int thread_id = -1);
+    void scheduleLock(UniqueFunction fc, int thread_id = -1);
+
+    // 按优先级类别添加调度任务
+        // deadline_ns为NowNs()时钟上的绝对时间，0表示没有截止时间
+        // 高优先级任务按截止时间先后执行，没有截止时间的按投递时间算；其他类别的截止时间只用于统计超时
+        // 指定了线程的任务直接进入目标线程的inbox，不区分优先级
+    void scheduleLock(Fiber::ptr fc, Priority priority, uint64_t deadline_ns = 0, int thread_id = -1);
+    void scheduleLock(UniqueFunction fc, Priority priority, uint64_t deadline_ns = 0, int thread_id = -1);
+
+    // 截止时间使用的单调时钟，单位纳秒
+    static uint64_t NowNs();
+
+    // 放入当前工作线程的runnext槽位：当前任务切出后下一个执行，不排在本地队列里其他任务的后面
+        // 用于唤醒等待者：唤醒方通常马上就会挂起，被唤醒的协程接着在同一个线程上运行，缓存还是热的
+        // 槽位里原有的任务挤到本地队列；不在本调度器的工作线程上调用时同scheduleLock
+    void scheduleNext(Fiber::ptr fc, int thread_id = -1);
+    void scheduleNext(UniqueFunction fc, int thread_id = -1);
+
+    // 当前协程已经安排好由谁恢复（例如挂到了等待队列上），切出当前协程
+        // runnext槽位里是可以直接切换的协程时用Fiber::transferTo()直接切过去，省掉回到调度协程的一次切换
+        // 否则同Fiber::yield()；连续直接切换kRunNextBurst次以后回一次调度协程，避免两个协程互相切换让其他任务饿死
+    static void YieldToNext();
+
+    // 看门狗要求当前任务让出（见Options::timeSliceMs），不在工作线程上时返回false
+    static bool PreemptRequested() {
+        Worker* self = t_worker;
+        return self != nullptr && self->preempt.load(std::memory_order_relaxed);
+    }
+
+    // 当前协程重新排到队尾并切出：指定了线程的进inbox，其余的进全局注入队列
+        // 本线程上已经排着的任务（包括指定在本线程的任务）都先于它执行；由Fiber::MaybeYield()在安全点调用
+    static void YieldToTail();
+
+    // 添加函数任务并返回它的结果，f的返回值或抛出的异常通过Future取出
+        // 在调度器协程中get()只挂起当前协程；任务没有运行就被丢弃时get()抛出broken_promise
+    template<class F>
+    Future<typename std::invoke_result<typename std::decay<F>::type&>::type> submit(F&& f, int thread_id = -1) {
+        typedef typename std::invoke_result<typename std::decay<F>::type&>::type R;
+        Promise<R> promise;
+        Future<R> future = promise.getFuture();
+        scheduleLock([promise = std::move(promise), f = std::forward<F>(f)]() mutable {
+            promise.setFrom(f);
+        }, thread_id);
+        return future;
+    }
+
+    // 批量添加调度任务，元素为Fiber::ptr或可调用对象
+        // 所有任务入队以后只唤醒一次：最多唤醒min(任务数, 停车线程数)个线程
+    template<class InputIterator>
+    void scheduleBatch(InputIterator first, InputIterator last, int thread_id = -1) {
+        std::vector<SchedulerTask*> tasks;
+        for (; first != last; ++first) {
+            tasks.push_back(makeTask(*first, thread_id));
+        }
+        enqueueBatch(tasks);
+    }
+
+    void scheduleBatch(std::initializer_list<std::function<void()>> cbs, int thread_id = -1) {
+        scheduleBatch(cbs.begin(), cbs.end(), thread_id);
+    }
+
+    void scheduleBatch(std::initializer_list<Fiber::ptr> fibers, int thread_id = -1) {
+        scheduleBatch(fibers.begin(), fibers.end(), thread_id);
+    }
 
     // 获取当前的线程号
     static int GetThreadId();
@@ -41,12 +166,42 @@ public:
     // 启动调度器
     virtual void start();
 
-    //停止调度器
+    // stop()的方式
+        // Drain：执行完排队的任务再停止；timeoutMs不为0时，超时以后剩下的任务按Abort处理
+        // Abort：不再开始新的任务，正在执行的任务切出或者结束以后工作线程立即退出
+        // 两种方式都立即唤醒所有停车的线程和阻塞在epoll_wait上的线程
+        // 没有开始的任务在所有线程退出以后释放：函数任务从来没有运行过；协程任务是挂起到一半的协程，释放时它栈上的对象不会析构
+            // submit()的任务被丢弃时，等待者收到broken_promise
+    struct Drain {
+        uint64_t timeoutMs;
+        explicit Drain(uint64_t timeout_ms = 0): timeoutMs(timeout_ms) {}
+    };
+    struct Abort {};
+
+    // stop(Drain)/stop(Abort)的结果
+    struct StopReport {
+        bool aborted = false;           // 以Abort结束，包括Drain超时
+        size_t droppedCallbacks = 0;    // 丢弃的函数任务数
+        size_t droppedFibers = 0;       // 丢弃的协程任务数
+        uint64_t elapsedMs = 0;         // stop()用的时间
+    };
+
+    //停止调度器，等同于stop(Drain())
     virtual void stop();
 
-    // 有新任务-》通知调度协程开始执行
+    StopReport stop(const Drain& drain);
+    StopReport stop(const Abort& abort);
+
+    // 有新任务-》唤醒一个停车的工作线程，没有停车的线程时什么也不做
     virtual void tickle();
 
+    // 汇总所有工作线程的计数，只读取各线程自己维护的计数器，不阻塞调度
+    SchedulerMetrics getMetrics();
+
+    // 每interval_ms毫秒在一个单独的线程上用当前快照调用一次cb，cb为空时停止
+        // 再次调用会替换之前的设置；stop()时停止，和stop()在同一个线程上调用
+    void setMetricsDump(uint64_t interval_ms, std::function<void(const SchedulerMetrics&)> cb);
+
 protected:
     // 调度协程的入口函数
 
@@ -54,49 +209,245 @@ protected:
     // 无调度任务时执行idle协程
     virtual void idle();
     // 返回是否可以停止
-    virtual bool stopping() {return m_stopping;}
+    virtual bool stopping() {return m_stopping.load(std::memory_order_acquire);}
+
+    // stop(Abort)或者Drain超时以后为true，工作线程不再开始新的任务
+    bool aborting() const {return m_aborting.load(std::memory_order_acquire);}
 
     // 返回是否有空闲线程，当调度协程进入idle时空闲线程数加1，从idle协程中返回时空闲线程数减1
     bool hasIdleThreads() {return m_idleThreadCount > 0;}
 
+    // 停车：当前工作线程阻塞在自己的futex上，直到被唤醒、调度器停止或者发现有任务可做
+    void park();
+
+    // 唤醒一个停车的工作线程，没有停车的线程时返回false
+    bool unparkOne();
+
+    // 最多唤醒count个停车的工作线程，返回实际唤醒的数量
+    size_t unparkSome(size_t count);
+
+    // 唤醒所有停车的工作线程
+    void unparkAll();
+
+    // 当前线程是否能取到任务
+    bool hasPendingWork();
+
+    // 指定线程上有新任务，但它既没有停车也没有在执行任务（例如阻塞在epoll_wait中）时调用
+    virtual void wakeThread(int) {}
+
 private:
     // 调度任务，协程/函数二选一，可以指定在哪个线程上调度
 
+    // 任务节点从线程缓存中分配（见scheduler.cpp），入队出队只传递指针
     struct SchedulerTask
     {
-        std::shared_ptr<Fiber> fiber;
-        std::function<void()> cb;
+        Fiber::ptr fiber;
+        UniqueFunction cb;
 
         int thread;
 
+        // 投递的时间，用于统计投递到开始执行的延迟，FIBER_METRICS为0时是0
+        uint64_t postNs = 0;
+
+        // 优先级类别和截止时间（NowNs()时钟，0表示没有）
+        int priority = PRIORITY_NORMAL;
+        uint64_t deadlineNs = 0;
+
         SchedulerTask() {
             fiber = nullptr;
             cb = nullptr;
             thread = -1;
         }
 
-        SchedulerTask(std::shared_ptr<Fiber> f, int thr) {
-            fiber = f;
+        SchedulerTask(Fiber::ptr f, int thr): fiber(std::move(f)) {
             thread = thr;
         }
 
-        SchedulerTask(std::function<void()> f, int thr) {
-            cb = f;
+        SchedulerTask(UniqueFunction f, int thr): cb(std::move(f)) {
             thread = thr;
         }
 
+        static void* operator new(size_t size);
+        static void operator delete(void* p);
+
         void reset() {
             fiber = nullptr;
             cb = nullptr;
             thread = -1;
+            postNs = 0;
+            priority = PRIORITY_NORMAL;
+            deadlineNs = 0;
         }
     };
-    
+
+    // 工作线程的任务队列
+        // deque：本线程发布的任务，本线程后进先出地取，其他线程先进先出地窃取
+        // inbox：指定在本线程执行的任务，直接投递到这里，不会被其他线程取走
+    struct Worker {
+        std::atomic<int> threadId{-1};
+        WorkStealDeque<SchedulerTask*> deque;
+
+        std::mutex inboxMutex;
+        std::deque<SchedulerTask*> inbox;
+        std::atomic<size_t> inboxSize{0};
+
+        // 选择窃取对象的随机数状态
+        uint32_t rand = 0;
+        // 调度次数，用于定期检查全局队列
+        uint32_t tick = 0;
+
+        // futex字：1表示停车中，唤醒者置0后futex_wake
+        std::atomic<uint32_t> parked{0};
+
+        // 运行计数，只有所属线程写入，getMetrics()从其他线程读取
+        std::atomic<uint64_t> tasks{0};
+        std::atomic<uint64_t> switches{0};
+        std::atomic<uint64_t> transfers{0};
+        std::atomic<uint64_t> steals{0};
+        std::atomic<uint64_t> idleNs{0};
+        // 开始/结束调度的时间，当前这段空闲开始的时间（不在空闲中时为0）
+        std::atomic<uint64_t> startNs{0};
+        std::atomic<uint64_t> stopNs{0};
+        std::atomic<uint64_t> idleSinceNs{0};
+        std::atomic<uint64_t> deadlineMisses{0};
+        // 按优先级类别分开记录，汇总时合并
+        LatencyHistogram postToStart[kPriorityClasses];
+
+        // 防饥饿：连续执行的高优先级任务数，以及取高/低优先级任务的次数
+        uint32_t highBurst = 0;
+        uint32_t classTick = 0;
+
+        // runnext槽位，只有所属线程放入；所属线程和窃取者都用exchange取走
+        std::atomic<SchedulerTask*> runNext{nullptr};
+        // 连续从runnext槽位取任务（包括直接切换）的次数
+        uint32_t runNextStreak = 0;
+
+        // 动态线程池中已经退出的工作线程，m_mutex保护；threadId同时置为-1，槽位留给之后新增的线程
+        bool retired = false;
+
+        // 协作式抢占：当前任务开始运行的时间（没有在运行任务时为0）和它的协程id，看门狗读取
+        std::atomic<uint64_t> sliceStartNs{0};
+        std::atomic<uint64_t> sliceFiber{0};
+        // 看门狗置位，开始下一个任务或者让出时清除
+        std::atomic<bool> preempt{false};
+        // 看门狗已经要求让出、已经报告过的那次调度的开始时间，只有看门狗读写
+        uint64_t flaggedNs = 0;
+        uint64_t reportedNs = 0;
+        // 超时次数由看门狗写入，让出次数由所属线程写入
+        std::atomic<uint64_t> overruns{0};
+        std::atomic<uint64_t> preemptions{0};
+        std::atomic<uint64_t> forcedPreemptions{0};
+        // forcePreempt：线程的pthread句柄，signalable从线程进入run()到离开为true，m_mutex保护
+        pthread_t pthread = pthread_t();
+        bool signalable = false;
+
+        // 所在的NUMA节点和工作线程绑定的CPU
+        int node = 0;
+        std::vector<int> cpus;
+
+        // 按页分配，numaAware时内存放在node上
+        static void* operator new(size_t size, int node);
+        static void operator delete(void* p, size_t size);
+        static void operator delete(void* p, int node);
+    };
+
+    // 创建任务，共享栈协程固定在创建它的线程上
+    SchedulerTask* makeTask(Fiber::ptr fc, int thread_id);
+    SchedulerTask* makeTask(UniqueFunction fc, int thread_id);
+
+    // 投递任务：指定线程的进inbox，工作线程发布的进自己的deque，外部线程发布的进全局注入队列
+        // 返回需要唤醒的指定线程，没有指定线程返回nullptr
+    Worker* enqueue(SchedulerTask* task);
+
+    // 投递一批任务，全部入队后再统一唤醒
+    void enqueueBatch(const std::vector<SchedulerTask*>& tasks);
+
+    // 投递带优先级的任务：高/低优先级进全局的类别队列，其余同enqueue()
+    Worker* enqueueClass(SchedulerTask* task);
+
+    // 从高/低优先级队列取任务，没有时返回nullptr
+    SchedulerTask* popHigh();
+    SchedulerTask* popLow();
+
+    // 放入runnext槽位并唤醒需要的线程，条件不满足时同enqueue()
+    void enqueueNext(SchedulerTask* task);
+
+    // 任务开始执行时的计数
+    void recordStart(Worker* self, SchedulerTask* task);
+
+    // 排到队尾，指定了线程的同enqueue()，其余的进全局注入队列，满了才进本地deque
+    Worker* enqueueTail(SchedulerTask* task);
+
+    // 协程开始/停止在工作线程上运行，看门狗据此计算运行时间
+    void beginSlice(Worker* self, Fiber* fiber);
+    void endSlice(Worker* self);
+
+    // 看门狗线程：检查运行超过时间片的任务
+    void watchdog();
+    void stopWatchdog();
+
+    // forcePreempt的信号处理函数
+    static void OnPreemptSignal(int);
+
+    // 唤醒指定的工作线程，它没有停车时返回false
+    bool unpark(Worker* worker);
+
+    // 任务投递后唤醒：指定了线程的唤醒目标线程，否则唤醒任意一个停车的线程
+    void notify(Worker* target);
+
+    // 当前线程是否能取到任务
+    bool hasWork(Worker* self);
+
+    // 取下一个任务：runnext -> inbox -> 本地deque -> 全局注入队列 -> 随机窃取
+    SchedulerTask* nextTask(Worker* self);
+
+    // 按线程id查找工作线程，找不到返回nullptr
+    Worker* findWorker(int thread_id);
+
+    // 投递到指定工作线程的inbox，目标线程已经退出时返回false
+    bool pushInbox(Worker* worker, SchedulerTask* task);
+
+    // 停止定期输出计数的线程
+    void stopMetricsDump();
+
+    // stop(Drain)和stop(Abort)的实现，abort为false时timeout_ms为0表示不限时间
+    StopReport stopImpl(bool abort, uint64_t timeout_ms);
+
+    // 转为Abort并唤醒所有线程
+    void abortNow();
+
+    // 唤醒所有停车的线程和阻塞在其他地方（epoll_wait）的线程
+    void wakeAll();
+
+    // 所有线程退出以后释放还在队列中的任务，计入report
+    void dropQueued(StopReport& report);
+
+    // 动态线程池的控制线程：定期检查排队情况，需要时增加工作线程
+    void poolControl();
+    void stopPoolControl();
+
+    // 在空闲的槽位上启动一个工作线程，调用者持有m_mutex，没有空闲槽位时返回false
+    bool spawnWorker();
+
+    // 停车超时后调用：满足条件时让当前工作线程退出，返回true
+    bool tryRetire(Worker* self);
+
+    // 停车的超时时间，0表示不超时
+    uint64_t parkTimeoutNs(Worker* self) const;
+
+    // 是否有任务在排队（不区分线程）
+    bool hasQueuedTasks();
+
+    // 已经退出的工作线程的id
+    bool isRetiredThread(int thread_id);
+
+    // 计算第index个工作线程（不含use_caller主线程）绑定的CPU和所在的节点
+    static void PlaceWorker(const Options& options, size_t index, std::vector<int>& cpus, int& node);
 
 private:
     // 协程调度器名称
     std::string m_name;
-    // 互斥锁
+    // 互斥锁：保护线程池的启动和停止，任务的投递和调度不经过这把锁
     std::mutex m_mutex;
 
     // 线程池
@@ -105,12 +456,68 @@ private:
     //线程池的线程ID数组
     std::vector<int> m_threadIds;
 
-    // 任务队列
-    std::vector<SchedulerTask> m_tasks;
+    // 每个工作线程（包括use_caller时的主线程）的任务队列
+        // 动态线程池按上限预先分配，之后不再增删，其他线程可以不加锁地遍历
+    std::vector<std::unique_ptr<Worker>> m_workers;
+    // 用过的槽位数，遍历到这里为止，只增不减
+    std::atomic<size_t> m_workerSlots = {0};
+
+    // 全局注入队列：不在线程池中的线程发布的任务
+    BoundedMpmcQueue<SchedulerTask*> m_injectQueue;
 
-    // 工作线程的数量，不包含use_caller主线程
+    // 当前线程对应的工作线程
+    static thread_local Worker* t_worker;
+
+    // 高优先级队列：按(截止时间, 投递序号)排序的小顶堆
+    struct HighEntry {
+        uint64_t deadline;
+        uint64_t seq;
+        SchedulerTask* task;
+
+        bool operator>(const HighEntry& other) const {
+            return deadline != other.deadline ? deadline > other.deadline : seq > other.seq;
+        }
+    };
+    std::mutex m_highMutex;
+    std::vector<HighEntry> m_highHeap;
+    uint64_t m_highSeq = 0;
+    std::atomic<size_t> m_highCount = {0};
+
+    // 低优先级队列
+    std::mutex m_lowMutex;
+    std::deque<SchedulerTask*> m_lowQueue;
+    std::atomic<size_t> m_lowCount = {0};
+
+    // 工作线程的数量，不包含use_caller主线程；动态线程池中是常驻的数量
     size_t m_threadCount = 0;
 
+    // 动态线程池：工作线程数的上限（不包含use_caller主线程）、当前运行的工作线程数
+    size_t m_maxThreadCount = 0;
+    std::atomic<size_t> m_liveThreadCount = {0};
+    uint64_t m_spawnWaitMs = 0;
+    uint64_t m_idleRetireMs = 0;
+    std::atomic<uint64_t> m_spawns = {0};
+    std::atomic<uint64_t> m_retires = {0};
+    // 已经退出的工作线程的id，m_mutex保护
+    std::vector<int> m_retiredIds;
+
+    // 动态线程池的控制线程
+    std::thread m_poolThread;
+    std::mutex m_poolMutex;
+    std::condition_variable m_poolCond;
+    bool m_poolStop = false;
+
+    // 协作式抢占：时间片（0表示不启用）、是否发送信号，看门狗线程
+    uint64_t m_timeSliceNs = 0;
+    bool m_forcePreempt = false;
+    std::thread m_watchdogThread;
+    std::mutex m_watchdogMutex;
+    std::condition_variable m_watchdogCond;
+    bool m_watchdogStop = false;
+    // 上一条超时报告的时间和之后没有输出的报告数，只有看门狗读写
+    uint64_t m_overrunLogNs = 0;
+    uint64_t m_overrunLogSuppressed = 0;
+
     // 活跃的线程数
     std::atomic<size_t> m_activateThreadCount = {0};
 
@@ -120,15 +527,33 @@ private:
     // 是否使用caller线程执行任务
     bool m_useCaller;  // 当为true时，调度器所在线程的调度协程必须在类内持有，不然创建完就会被释放
 
-    std::shared_ptr<Fiber> m_rootFiber;
+    // 是否按NUMA节点放置工作线程
+    bool m_numaAware = false;
+
+    Fiber::ptr m_rootFiber;
     // 调度器所在的线程的id
 
     int m_rootThread;
 
-    // 是否正在停止
-    bool m_stopping = false;
-    // 用于唤醒idle协程中的线程
-    std::atomic<int> tickler;
+    // 是否正在停止，stop()中先置位再唤醒线程，和park()中的检查配对
+    std::atomic<bool> m_stopping = {false};
+    // 不再开始新的任务
+    std::atomic<bool> m_aborting = {false};
+
+    // Drain超时的计时线程等待stop()结束
+    std::mutex m_stopMutex;
+    std::condition_variable m_stopCond;
+    bool m_stopDone = false;
+
+    // 停车中的工作线程
+    std::mutex m_parkMutex;
+    std::vector<Worker*> m_parked;
+
+    // 定期输出计数的线程
+    std::thread m_dumpThread;
+    std::mutex m_dumpMutex;
+    std::condition_variable m_dumpCond;
+    bool m_dumpStop = false;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,386 @@
+#include <cstdlib>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <algorithm>
+#include <iostream>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "stack_allocator.h"
+#include "numa_topology.h"
+
+// 两种分配方式的栈分开缓存
+static const int kModeCount = 2;
+
+// 线程缓存的默认低/高水位和全局池上限
+static std::atomic<size_t> s_low_watermark{4};
+static std::atomic<size_t> s_high_watermark{16};
+static std::atomic<size_t> s_global_limit{256};
+
+static std::atomic<int> s_mode{StackAllocator::HEAP};
+static std::atomic<bool> s_release_on_cache{true};
+
+static size_t page_size() {
+    static const size_t size = sysconf(_SC_PAGESIZE);
+    return size;
+}
+
+static size_t class_size(int cls) {
+    return StackAllocator::kMinClassSize << cls;
+}
+
+// 真正分配栈
+    // MMAP：[保护页][size字节的栈]，MAP_NORESERVE不预留交换空间，物理页在缺页时才提交
+static void* map_stack(size_t size, StackAllocator::Mode mode) {
+    if (mode == StackAllocator::HEAP) {
+        return malloc(size);
+    }
+
+    size_t page = page_size();
+    size = (size + page - 1) / page * page;
+    void* base = mmap(nullptr, size + page, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK, -1, 0);
+    if (base == MAP_FAILED) {
+        std::cerr << "StackAllocator mmap() failed\n";
+        return nullptr;
+    }
+
+    // 栈从高地址向低地址增长，保护页放在最低处
+    if (mprotect(base, page, PROT_NONE)) {
+        std::cerr << "StackAllocator mprotect() failed\n";
+        munmap(base, size + page);
+        return nullptr;
+    }
+    return static_cast<char*>(base) + page;
+}
+
+// 真正释放栈
+static void unmap_stack(void* stack, size_t size, StackAllocator::Mode mode) {
+    if (mode == StackAllocator::HEAP) {
+        free(stack);
+        return;
+    }
+
+    size_t page = page_size();
+    size = (size + page - 1) / page * page;
+    munmap(static_cast<char*>(stack) - page, size + page);
+}
+
+// 栈进入缓存前释放物理页，只保留栈顶一页
+static void release_pages(void* stack, size_t size, StackAllocator::Mode mode) {
+    if (mode != StackAllocator::MMAP || !s_release_on_cache.load(std::memory_order_relaxed)) {
+        return;
+    }
+
+    size_t page = page_size();
+    if (size > page) {
+        madvise(stack, size - page, MADV_DONTNEED);
+    }
+}
+
+struct ThreadCache;
+
+// 全局池：线程缓存溢出的栈放在这里，由所有线程共享
+    // 按NUMA节点分开，线程只和自己节点的池交换栈，栈的物理页留在访问它的节点上
+struct GlobalPool {
+    std::mutex mutex;
+    std::vector<void*> lists[NumaTopology::kMaxNodes][kModeCount][StackAllocator::kClassCount];
+
+    // 已经退出的线程留下的计数
+    uint64_t retiredLocalHits = 0;
+    uint64_t retiredGlobalHits = 0;
+    uint64_t retiredMisses = 0;
+    uint64_t retiredFrees = 0;
+
+    // 所有存活的线程缓存，用于汇总计数
+    std::mutex cachesMutex;
+    std::vector<ThreadCache*> caches;
+};
+
+// 不随静态析构释放，线程退出时可能还会访问
+static GlobalPool& global_pool() {
+    static GlobalPool* pool = new GlobalPool();
+    return *pool;
+}
+
+struct ThreadCache {
+    std::vector<void*> lists[kModeCount][StackAllocator::kClassCount];
+
+    // 只有所属线程写入，GetStats()从其他线程读取
+    std::atomic<uint64_t> localHits{0};
+    std::atomic<uint64_t> globalHits{0};
+    std::atomic<uint64_t> misses{0};
+    std::atomic<uint64_t> frees{0};
+
+    ThreadCache();
+    ~ThreadCache();
+};
+
+// 线程缓存析构以后，本线程再分配/归还栈就直接走全局池
+static thread_local bool t_cache_destroyed = false;
+static thread_local ThreadCache t_cache;
+
+static void bump(std::atomic<uint64_t>& counter) {
+    counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+// 当前线程使用的全局池下标
+static int pool_node() {
+    return NumaTopology::ThreadNode() % NumaTopology::kMaxNodes;
+}
+
+// 把栈放回当前线程节点的全局池，满了返回false
+static bool push_global(GlobalPool& pool, int mode, int cls, void* stack) {
+    std::vector<void*>& global = pool.lists[pool_node()][mode][cls];
+    if (global.size() >= s_global_limit.load(std::memory_order_relaxed)) {
+        return false;
+    }
+    global.push_back(stack);
+    return true;
+}
+
+ThreadCache::ThreadCache() {
+    GlobalPool& pool = global_pool();
+    std::lock_guard<std::mutex> lock(pool.cachesMutex);
+    pool.caches.push_back(this);
+}
+
+ThreadCache::~ThreadCache() {
+    t_cache_destroyed = true;
+
+    GlobalPool& pool = global_pool();
+    {
+        std::lock_guard<std::mutex> lock(pool.cachesMutex);
+        pool.caches.erase(std::find(pool.caches.begin(), pool.caches.end(), this));
+    }
+
+    // 线程退出，缓存的栈全部归还到全局池，放不下的在锁外释放
+    std::vector<void*> overflow[kModeCount][StackAllocator::kClassCount];
+    {
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        pool.retiredLocalHits += localHits.load(std::memory_order_relaxed);
+        pool.retiredGlobalHits += globalHits.load(std::memory_order_relaxed);
+        pool.retiredMisses += misses.load(std::memory_order_relaxed);
+        pool.retiredFrees += frees.load(std::memory_order_relaxed);
+
+        for (int m = 0; m < kModeCount; m++) {
+            for (int i = 0; i < StackAllocator::kClassCount; i++) {
+                for (void* stack : lists[m][i]) {
+                    if (!push_global(pool, m, i, stack)) {
+                        overflow[m][i].push_back(stack);
+                        pool.retiredFrees++;
+                    }
+                }
+                lists[m][i].clear();
+            }
+        }
+    }
+
+    for (int m = 0; m < kModeCount; m++) {
+        for (int i = 0; i < StackAllocator::kClassCount; i++) {
+            for (void* stack : overflow[m][i]) {
+                unmap_stack(stack, class_size(i), static_cast<StackAllocator::Mode>(m));
+            }
+        }
+    }
+}
+
+int StackAllocator::SizeClass(size_t size) {
+    for (int i = 0; i < kClassCount; i++) {
+        if (size <= class_size(i)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void* StackAllocator::Alloc(size_t& size, Mode mode) {
+    int cls = SizeClass(size);
+
+    // 超出尺寸等级的栈不缓存
+    if (cls < 0) {
+        if (!t_cache_destroyed) {
+            bump(t_cache.misses);
+        }
+        return map_stack(size, mode);
+    }
+    size = class_size(cls);
+
+    GlobalPool& pool = global_pool();
+    if (t_cache_destroyed) {
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        std::vector<void*>& global = pool.lists[pool_node()][mode][cls];
+        if (!global.empty()) {
+            void* stack = global.back();
+            global.pop_back();
+            pool.retiredGlobalHits++;
+            return stack;
+        }
+        pool.retiredMisses++;
+        return map_stack(size, mode);
+    }
+
+    // 1. 线程缓存
+    std::vector<void*>& list = t_cache.lists[mode][cls];
+    if (!list.empty()) {
+        void* stack = list.back();
+        list.pop_back();
+        bump(t_cache.localHits);
+        return stack;
+    }
+
+    // 2. 从全局池批量取回低水位个
+    {
+        size_t batch = std::max<size_t>(s_low_watermark.load(std::memory_order_relaxed), 1);
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        std::vector<void*>& global = pool.lists[pool_node()][mode][cls];
+        size_t n = std::min(batch, global.size());
+        list.insert(list.end(), global.end() - n, global.end());
+        global.resize(global.size() - n);
+    }
+    if (!list.empty()) {
+        void* stack = list.back();
+        list.pop_back();
+        bump(t_cache.globalHits);
+        return stack;
+    }
+
+    // 3. 真正分配
+    bump(t_cache.misses);
+    return map_stack(size, mode);
+}
+
+void StackAllocator::Dealloc(void* stack, size_t size, Mode mode) {
+    if (stack == nullptr) {
+        return;
+    }
+
+    int cls = SizeClass(size);
+    if (cls < 0) {
+        if (!t_cache_destroyed) {
+            bump(t_cache.frees);
+        }
+        unmap_stack(stack, size, mode);
+        return;
+    }
+
+    release_pages(stack, size, mode);
+
+    GlobalPool& pool = global_pool();
+    if (t_cache_destroyed) {
+        bool cached;
+        {
+            std::lock_guard<std::mutex> lock(pool.mutex);
+            cached = push_global(pool, mode, cls, stack);
+            if (!cached) {
+                pool.retiredFrees++;
+            }
+        }
+        if (!cached) {
+            unmap_stack(stack, size, mode);
+        }
+        return;
+    }
+
+    std::vector<void*>& list = t_cache.lists[mode][cls];
+    list.push_back(stack);
+
+    // 超过高水位，归还到全局池直到剩下低水位个
+    size_t high = s_high_watermark.load(std::memory_order_relaxed);
+    if (list.size() <= high) {
+        return;
+    }
+    size_t low = std::min(s_low_watermark.load(std::memory_order_relaxed), high);
+
+    std::vector<void*> overflow;
+    {
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        while (list.size() > low) {
+            if (!push_global(pool, mode, cls, list.back())) {
+                overflow.push_back(list.back());
+            }
+            list.pop_back();
+        }
+    }
+
+    // 全局池也满了，在锁外释放
+    for (void* p : overflow) {
+        bump(t_cache.frees);
+        unmap_stack(p, size, mode);
+    }
+}
+
+void StackAllocator::SetMode(Mode mode) {
+    s_mode.store(mode, std::memory_order_relaxed);
+}
+
+StackAllocator::Mode StackAllocator::GetMode() {
+    return static_cast<Mode>(s_mode.load(std::memory_order_relaxed));
+}
+
+void StackAllocator::SetReleaseOnCache(bool release) {
+    s_release_on_cache.store(release, std::memory_order_relaxed);
+}
+
+void StackAllocator::SetWatermarks(size_t low, size_t high) {
+    s_low_watermark.store(low, std::memory_order_relaxed);
+    s_high_watermark.store(std::max(low, high), std::memory_order_relaxed);
+}
+
+void StackAllocator::SetGlobalLimit(size_t limit) {
+    s_global_limit.store(limit, std::memory_order_relaxed);
+}
+
+StackAllocator::Stats StackAllocator::GetStats() {
+    Stats stats;
+    GlobalPool& pool = global_pool();
+    {
+        std::lock_guard<std::mutex> lock(pool.cachesMutex);
+        for (ThreadCache* cache : pool.caches) {
+            stats.localHits += cache->localHits.load(std::memory_order_relaxed);
+            stats.globalHits += cache->globalHits.load(std::memory_order_relaxed);
+            stats.misses += cache->misses.load(std::memory_order_relaxed);
+            stats.frees += cache->frees.load(std::memory_order_relaxed);
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(pool.mutex);
+    stats.localHits += pool.retiredLocalHits;
+    stats.globalHits += pool.retiredGlobalHits;
+    stats.misses += pool.retiredMisses;
+    stats.frees += pool.retiredFrees;
+    for (int n = 0; n < NumaTopology::kMaxNodes; n++) {
+        for (int m = 0; m < kModeCount; m++) {
+            for (int i = 0; i < kClassCount; i++) {
+                stats.cached += pool.lists[n][m][i].size();
+            }
+        }
+    }
+    return stats;
+}
+
+void StackAllocator::Trim() {
+    std::vector<void*> stacks[kModeCount][kClassCount];
+    GlobalPool& pool = global_pool();
+    {
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        for (int n = 0; n < NumaTopology::kMaxNodes; n++) {
+            for (int m = 0; m < kModeCount; m++) {
+                for (int i = 0; i < kClassCount; i++) {
+                    pool.retiredFrees += pool.lists[n][m][i].size();
+                    stacks[m][i].insert(stacks[m][i].end(), pool.lists[n][m][i].begin(), pool.lists[n][m][i].end());
+                    pool.lists[n][m][i].clear();
+                }
+            }
+        }
+    }
+
+    for (int m = 0; m < kModeCount; m++) {
+        for (int i = 0; i < kClassCount; i++) {
+            for (void* stack : stacks[m][i]) {
+                unmap_stack(stack, class_size(i), static_cast<Mode>(m));
+            }
+        }
+    }
+}
@@ -0,0 +1,66 @@
+#ifndef _STACK_ALLOCATOR_H_
+#define _STACK_ALLOCATOR_H_
+
+#include <cstddef>
+#include <cstdint>
+
+// 协程栈分配器
+    // 栈按尺寸等级（16KB ~ 8MB，2的幂）分组缓存，避免每个协程都malloc/free一次大块内存
+    // 每个线程有自己的缓存，不加锁；线程缓存超过高水位时，把多出的栈归还到全局池，只保留低水位个
+    // 线程缓存为空时，先从全局池批量取回低水位个，再不够才真正分配
+    // 全局池按NUMA节点分开（见NumaTopology），线程只和自己节点的池交换栈
+    // MMAP模式下每个栈是一段独立映射，最低地址处有一个PROT_NONE的保护页，栈溢出直接触发SIGSEGV而不是破坏堆
+        // 每个栈占用两个VMA，大量协程时需要相应调大vm.max_map_count
+class StackAllocator {
+public:
+    enum Mode {
+        HEAP,   // malloc分配，没有保护页
+        MMAP    // mmap分配，带保护页，物理页在第一次访问时才提交
+    };
+
+    // 尺寸等级的范围
+    static const size_t kMinClassSize = 16 * 1024;
+    static const size_t kMaxClassSize = 8 * 1024 * 1024;
+    static const int kClassCount = 10;
+
+    struct Stats {
+        uint64_t localHits = 0;   // 线程缓存命中
+        uint64_t globalHits = 0;  // 线程缓存未命中，从全局池取到
+        uint64_t misses = 0;      // 真正分配了新栈
+        uint64_t frees = 0;       // 真正释放了栈
+        uint64_t cached = 0;      // 全局池中当前缓存的栈数
+    };
+
+public:
+    // 分配协程栈，size向上取整到尺寸等级，实际可用大小写回size，失败返回nullptr
+    static void* Alloc(size_t& size, Mode mode);
+
+    // 归还协程栈，size和mode必须和分配时一致
+    static void Dealloc(void* stack, size_t size, Mode mode);
+
+    // 新建协程默认使用的分配方式，默认为HEAP
+    static void SetMode(Mode mode);
+    static Mode GetMode();
+
+    // MMAP模式下栈归还到缓存时是否madvise(MADV_DONTNEED)释放物理页，默认开启
+        // 只保留栈顶一页，重新使用时其余页按需缺页提交
+    static void SetReleaseOnCache(bool release);
+
+    // 设置线程缓存的低/高水位（每个尺寸等级的栈数）
+    static void SetWatermarks(size_t low, size_t high);
+
+    // 设置全局池每个尺寸等级最多保留的栈数，超出的直接释放
+    static void SetGlobalLimit(size_t limit);
+
+    // 汇总所有线程的计数
+    static Stats GetStats();
+
+    // 释放全局池中缓存的栈
+    static void Trim();
+
+private:
+    // 返回尺寸等级，超出范围返回-1
+    static int SizeClass(size_t size);
+};
+
+#endif
@@ -0,0 +1,232 @@
+#include <cassert>
+
+#include "timer.h"
+
+// 不在堆中的定时器的下标
+static const size_t kNotInHeap = (size_t)-1;
+
+Timer::Timer(uint64_t timeout_ns, std::function<void()> cb, bool recurring, std::shared_ptr<TimerAnchor> anchor):
+m_recurring(recurring), m_timeout(timeout_ns), m_cb(cb), m_anchor(std::move(anchor)), m_heapIndex(kNotInHeap) {
+    m_next = TimerManager::NowNs() + m_timeout;
+}
+
+bool Timer::cancel() {
+    std::lock_guard<std::mutex> lock(m_anchor->mutex);
+    TimerManager* manager = m_anchor->manager;
+    if (manager == nullptr || m_heapIndex == kNotInHeap) {
+        return false;
+    }
+
+    m_cb = nullptr;
+    if (manager->remove(this)) {
+        manager->onTimerFrontChanged(manager->frontDeadline());
+    }
+    return true;
+}
+
+bool Timer::refresh() {
+    std::lock_guard<std::mutex> lock(m_anchor->mutex);
+    TimerManager* manager = m_anchor->manager;
+    if (manager == nullptr || m_heapIndex == kNotInHeap) {
+        return false;
+    }
+
+    bool was_front = manager->remove(this);
+    m_next = TimerManager::NowNs() + m_timeout;
+    bool is_front = manager->push(shared_from_this());
+    if (was_front || is_front) {
+        manager->onTimerFrontChanged(manager->frontDeadline());
+    }
+    return true;
+}
+
+bool Timer::reset(uint64_t ms, bool from_now) {
+    uint64_t timeout = ms * 1000000;
+
+    std::lock_guard<std::mutex> lock(m_anchor->mutex);
+    TimerManager* manager = m_anchor->manager;
+    if (manager == nullptr || m_heapIndex == kNotInHeap) {
+        return false;
+    }
+    if (timeout == m_timeout && !from_now) {
+        return true;
+    }
+
+    bool was_front = manager->remove(this);
+    uint64_t start = from_now ? TimerManager::NowNs() : m_next - m_timeout;
+    m_timeout = timeout;
+    m_next = start + m_timeout;
+    bool is_front = manager->push(shared_from_this());
+    if (was_front || is_front) {
+        manager->onTimerFrontChanged(manager->frontDeadline());
+    }
+    return true;
+}
+
+TimerManager::TimerManager(): m_anchor(std::make_shared<TimerAnchor>()) {
+    m_anchor->manager = this;
+}
+
+TimerManager::~TimerManager() {
+    detachTimers();
+}
+
+void TimerManager::detachTimers() {
+    // 定时器可能比管理器活得久，断开它们和管理器、堆的联系
+    std::vector<Timer::ptr> heap;
+    {
+        std::lock_guard<std::mutex> lock(m_anchor->mutex);
+        m_anchor->manager = nullptr;
+        for (auto& timer : m_heap) {
+            timer->m_heapIndex = kNotInHeap;
+        }
+        heap.swap(m_heap);
+    }
+    // 回调在锁外析构，它们捕获的对象析构时可能还会操作定时器
+}
+
+uint64_t TimerManager::NowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+Timer::ptr TimerManager::addTimer(uint64_t ms, std::function<void()> cb, bool recurring) {
+    return addTimer(std::chrono::milliseconds(ms), std::move(cb), recurring);
+}
+
+Timer::ptr TimerManager::addTimer(std::chrono::nanoseconds timeout, std::function<void()> cb, bool recurring) {
+    uint64_t ns = timeout.count() > 0 ? (uint64_t)timeout.count() : 0;
+    Timer::ptr timer(new Timer(ns, std::move(cb), recurring, m_anchor));
+
+    std::lock_guard<std::mutex> lock(m_anchor->mutex);
+    if (push(timer)) {
+        onTimerFrontChanged(timer->m_next);
+    }
+    return timer;
+}
+
+// 条件不存在时什么也不做
+static void OnTimer(std::weak_ptr<void> weak_cond, std::function<void()> cb) {
+    std::shared_ptr<void> tmp = weak_cond.lock();
+    if (tmp) {
+        cb();
+    }
+}
+
+Timer::ptr TimerManager::addConditionTimer(uint64_t ms, std::function<void()> cb, std::weak_ptr<void> cond, bool recurring) {
+    return addTimer(ms, std::bind(&OnTimer, cond, cb), recurring);
+}
+
+uint64_t TimerManager::getNextTimer() {
+    std::lock_guard<std::mutex> lock(m_anchor->mutex);
+    if (m_heap.empty()) {
+        return ~0ull;
+    }
+
+    uint64_t now = NowNs();
+    uint64_t next = m_heap.front()->m_next;
+    if (next <= now) {
+        return 0;
+    }
+    // 向上取整，避免提前醒来空转
+    return (next - now + 999999) / 1000000;
+}
+
+void TimerManager::listExpiredCb(std::vector<std::function<void()>>& cbs) {
+    uint64_t now = NowNs();
+
+    std::lock_guard<std::mutex> lock(m_anchor->mutex);
+    if (m_heap.empty() || m_heap.front()->m_next > now) {
+        return;
+    }
+
+    while (!m_heap.empty() && m_heap.front()->m_next <= now) {
+        Timer::ptr timer = m_heap.front();
+        remove(timer.get());
+
+        if (timer->m_recurring) {
+            cbs.push_back(timer->m_cb);
+            // 超时为0的循环定时器至少推迟1纳秒，否则这里会一直循环
+            timer->m_next = now + (timer->m_timeout ? timer->m_timeout : 1);
+            push(timer);
+        } else {
+            cbs.push_back(std::move(timer->m_cb));
+            timer->m_cb = nullptr;
+        }
+    }
+
+    onTimerFrontChanged(frontDeadline());
+}
+
+bool TimerManager::hasTimer() {
+    std::lock_guard<std::mutex> lock(m_anchor->mutex);
+    return !m_heap.empty();
+}
+
+uint64_t TimerManager::frontDeadline() const {
+    return m_heap.empty() ? 0 : m_heap.front()->m_next;
+}
+
+bool TimerManager::push(const Timer::ptr& timer) {
+    assert(timer->m_heapIndex == kNotInHeap);
+    timer->m_heapIndex = m_heap.size();
+    m_heap.push_back(timer);
+    siftUp(timer->m_heapIndex);
+    return timer->m_heapIndex == 0;
+}
+
+bool TimerManager::remove(Timer* timer) {
+    size_t index = timer->m_heapIndex;
+    assert(index < m_heap.size() && m_heap[index].get() == timer);
+
+    size_t last = m_heap.size() - 1;
+    if (index != last) {
+        swapNodes(index, last);
+    }
+    m_heap.back()->m_heapIndex = kNotInHeap;
+    m_heap.pop_back();
+
+    // 换到index上的节点可能需要上浮或下沉
+    if (index < m_heap.size()) {
+        siftUp(index);
+        siftDown(index);
+    }
+    return index == 0;
+}
+
+void TimerManager::siftUp(size_t index) {
+    while (index > 0) {
+        size_t parent = (index - 1) / 2;
+        if (m_heap[parent]->m_next <= m_heap[index]->m_next) {
+            break;
+        }
+        swapNodes(parent, index);
+        index = parent;
+    }
+}
+
+void TimerManager::siftDown(size_t index) {
+    size_t n = m_heap.size();
+    while (true) {
+        size_t smallest = index;
+        size_t left = index * 2 + 1;
+        size_t right = left + 1;
+        if (left < n && m_heap[left]->m_next < m_heap[smallest]->m_next) {
+            smallest = left;
+        }
+        if (right < n && m_heap[right]->m_next < m_heap[smallest]->m_next) {
+            smallest = right;
+        }
+        if (smallest == index) {
+            break;
+        }
+        swapNodes(index, smallest);
+        index = smallest;
+    }
+}
+
+void TimerManager::swapNodes(size_t a, size_t b) {
+    std::swap(m_heap[a], m_heap[b]);
+    m_heap[a]->m_heapIndex = a;
+    m_heap[b]->m_heapIndex = b;
+}
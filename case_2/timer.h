@@ -0,0 +1,108 @@
+#ifndef _TIMER_H_
+#define _TIMER_H_
+
+#include <memory>
+#include <vector>
+#include <mutex>
+#include <chrono>
+#include <functional>
+#include <cstdint>
+
+class TimerManager;
+
+// 管理器和它创建的定时器共享的状态，由shared_ptr持有，比管理器活得久
+    // 定时器的操作先锁mutex，再看manager是否还在；管理器析构时在锁内把manager置空
+struct TimerAnchor {
+    std::mutex mutex;
+    TimerManager* manager = nullptr;
+};
+
+// 定时器，由TimerManager创建
+class Timer : public std::enable_shared_from_this<Timer> {
+    friend class TimerManager;
+public:
+    typedef std::shared_ptr<Timer> ptr;
+
+    // 取消定时器，已经触发（非循环）、已经取消或者管理器已经析构时返回false
+    bool cancel();
+
+    // 从现在开始重新计时
+    bool refresh();
+
+    // 修改超时时间，from_now为false时从原来的起点开始计时
+    bool reset(uint64_t ms, bool from_now);
+
+private:
+    Timer(uint64_t timeout_ns, std::function<void()> cb, bool recurring, std::shared_ptr<TimerAnchor> anchor);
+
+private:
+    // 是否循环
+    bool m_recurring = false;
+    // 超时时长，纳秒
+    uint64_t m_timeout = 0;
+    // 到期的绝对时间（steady_clock），纳秒
+    uint64_t m_next = 0;
+    std::function<void()> m_cb;
+    std::shared_ptr<TimerAnchor> m_anchor;
+    // 在堆中的下标，不在堆中时为kNotInHeap
+    size_t m_heapIndex;
+};
+
+// 定时器管理器
+    // 定时器保存在按到期时间排序的最小堆中，每个定时器记录自己在堆中的下标
+    // 添加、取消、重置都是O(log n)，取最早的到期时间是O(1)
+    // 子类通过onTimerFrontChanged()得知最早的到期时间变化，据此设置等待的超时
+class TimerManager {
+    friend class Timer;
+public:
+    TimerManager();
+    virtual ~TimerManager();
+
+    // 添加定时器，ms毫秒后执行cb，recurring为true时每隔ms毫秒执行一次
+    Timer::ptr addTimer(uint64_t ms, std::function<void()> cb, bool recurring = false);
+    // 纳秒精度的版本
+    Timer::ptr addTimer(std::chrono::nanoseconds timeout, std::function<void()> cb, bool recurring = false);
+
+    // 添加条件定时器，到期时cond还存在才执行cb
+    Timer::ptr addConditionTimer(uint64_t ms, std::function<void()> cb, std::weak_ptr<void> cond, bool recurring = false);
+
+    // 距离最早的定时器到期还有多少毫秒，没有定时器时返回~0ull
+    uint64_t getNextTimer();
+
+    // 取出所有已经到期的定时器的回调，循环定时器重新加入
+    void listExpiredCb(std::vector<std::function<void()>>& cbs);
+
+    // 是否还有定时器
+    bool hasTimer();
+
+    // 当前时间（steady_clock），纳秒
+    static uint64_t NowNs();
+
+protected:
+    // 最早的到期时间发生变化时调用，next_ns为新的最早到期时间，0表示没有定时器了
+        // 调用时持有定时器的锁，实现中不能再操作定时器
+    virtual void onTimerFrontChanged(uint64_t next_ns) = 0;
+
+    // 断开所有定时器和管理器的联系，丢弃还没有到期的定时器，之后定时器的操作都返回false
+        // 子类在析构函数中释放onTimerFrontChanged()用到的资源之前调用；~TimerManager()会再调用一次
+    void detachTimers();
+
+private:
+    // 以下函数调用者持有m_anchor->mutex
+    // 加入堆，返回是否成为了堆顶
+    bool push(const Timer::ptr& timer);
+    // 从堆中删除，返回删除的是否是堆顶
+    bool remove(Timer* timer);
+    void siftUp(size_t index);
+    void siftDown(size_t index);
+    void swapNodes(size_t a, size_t b);
+    uint64_t frontDeadline() const;
+
+private:
+    // 锁和管理器指针，定时器通过它访问管理器
+    std::shared_ptr<TimerAnchor> m_anchor;
+    // 按到期时间排序的最小堆
+    std::vector<Timer::ptr> m_heap;
+};
+
+#endif
@@ -0,0 +1,172 @@
+#ifndef _UNIQUE_FUNCTION_H_
+#define _UNIQUE_FUNCTION_H_
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <functional>
+
+// 小于等于这个大小的可调用对象直接存放在UniqueFunction内部，不分配内存
+#ifndef FIBER_TASK_INLINE_SIZE
+#define FIBER_TASK_INLINE_SIZE 64
+#endif
+
+// 只能移动的void()可调用对象，用来代替任务路径上的std::function
+    // std::function要求可拷贝，捕获超过16字节就会分配内存，任务在队列中转手时还要拷贝
+    // 这里捕获不超过FIBER_TASK_INLINE_SIZE字节并且移动不抛异常的对象直接放在内部缓冲区，
+    // 其他的放在堆上；移动只搬运对象（内部缓冲区）或者指针（堆上），不拷贝
+class UniqueFunction {
+public:
+    static const size_t kInlineSize = FIBER_TASK_INLINE_SIZE;
+
+    UniqueFunction() {}
+    UniqueFunction(std::nullptr_t) {}
+
+    // 接受任意可以无参调用的对象
+    template<typename F,
+             typename D = typename std::decay<F>::type,
+             typename = typename std::enable_if<!std::is_same<D, UniqueFunction>::value
+                                                && std::is_invocable<D&>::value>::type>
+    UniqueFunction(F&& f) {
+        if (isEmpty(f)) {
+            return;
+        }
+        if constexpr (sizeof(D) <= kInlineSize && alignof(D) <= alignof(std::max_align_t)
+            && std::is_nothrow_move_constructible<D>::value) {
+            new (&m_storage) D(std::forward<F>(f));
+            m_ops = &InlineOps<D>::ops;
+        } else {
+            *reinterpret_cast<D**>(&m_storage) = new D(std::forward<F>(f));
+            m_ops = &HeapOps<D>::ops;
+        }
+    }
+
+    UniqueFunction(UniqueFunction&& other) noexcept {
+        moveFrom(other);
+    }
+
+    UniqueFunction& operator=(UniqueFunction&& other) noexcept {
+        if (this != &other) {
+            reset();
+            moveFrom(other);
+        }
+        return *this;
+    }
+
+    UniqueFunction& operator=(std::nullptr_t) {
+        reset();
+        return *this;
+    }
+
+    UniqueFunction(const UniqueFunction&) = delete;
+    UniqueFunction& operator=(const UniqueFunction&) = delete;
+
+    ~UniqueFunction() {
+        reset();
+    }
+
+    void operator()() {
+        m_ops->invoke(&m_storage);
+    }
+
+    explicit operator bool() const {return m_ops != nullptr;}
+
+    bool operator==(std::nullptr_t) const {return m_ops == nullptr;}
+    bool operator!=(std::nullptr_t) const {return m_ops != nullptr;}
+
+    // 可调用对象是否存放在内部缓冲区
+    bool isInline() const {return m_ops != nullptr && m_ops->inlined;}
+
+private:
+    typedef typename std::aligned_storage<kInlineSize, alignof(std::max_align_t)>::type Storage;
+
+    struct Ops {
+        void (*invoke)(Storage* storage);
+        // 把src中的对象移动到dst，并销毁src中的对象
+        void (*move)(Storage* dst, Storage* src);
+        void (*destroy)(Storage* storage);
+        bool inlined;
+    };
+
+    template<typename D>
+    struct InlineOps {
+        static void invoke(Storage* s) {
+            (*reinterpret_cast<D*>(s))();
+        }
+        static void move(Storage* dst, Storage* src) {
+            D* f = reinterpret_cast<D*>(src);
+            new (dst) D(std::move(*f));
+            f->~D();
+        }
+        static void destroy(Storage* s) {
+            reinterpret_cast<D*>(s)->~D();
+        }
+        static const Ops ops;
+    };
+
+    template<typename D>
+    struct HeapOps {
+        static void invoke(Storage* s) {
+            (**reinterpret_cast<D**>(s))();
+        }
+        static void move(Storage* dst, Storage* src) {
+            *reinterpret_cast<D**>(dst) = *reinterpret_cast<D**>(src);
+        }
+        static void destroy(Storage* s) {
+            delete *reinterpret_cast<D**>(s);
+        }
+        static const Ops ops;
+    };
+
+    // 空的std::function、空的函数指针构造出空的UniqueFunction
+        // 只检查指针和带explicit operator bool的类（std::function），lambda和函数本身不会为空
+    template<typename F>
+    static bool isEmpty(const F& f) {
+        if constexpr (std::is_pointer<F>::value || std::is_member_pointer<F>::value) {
+            return f == nullptr;
+        } else if constexpr (std::is_class<F>::value && std::is_constructible<bool, const F&>::value
+                             && !std::is_convertible<const F&, bool>::value) {
+            return !static_cast<bool>(f);
+        } else {
+            return false;
+        }
+    }
+
+    void moveFrom(UniqueFunction& other) {
+        m_ops = other.m_ops;
+        if (m_ops) {
+            m_ops->move(&m_storage, &other.m_storage);
+            other.m_ops = nullptr;
+        }
+    }
+
+    void reset() {
+        if (m_ops) {
+            m_ops->destroy(&m_storage);
+            m_ops = nullptr;
+        }
+    }
+
+private:
+    Storage m_storage;
+    const Ops* m_ops = nullptr;
+};
+
+template<typename D>
+const UniqueFunction::Ops UniqueFunction::InlineOps<D>::ops = {
+    &UniqueFunction::InlineOps<D>::invoke,
+    &UniqueFunction::InlineOps<D>::move,
+    &UniqueFunction::InlineOps<D>::destroy,
+    true
+};
+
+template<typename D>
+const UniqueFunction::Ops UniqueFunction::HeapOps<D>::ops = {
+    &UniqueFunction::HeapOps<D>::invoke,
+    &UniqueFunction::HeapOps<D>::move,
+    &UniqueFunction::HeapOps<D>::destroy,
+    false
+};
+
+#endif
@@ -0,0 +1,138 @@
+#ifndef _WORK_STEAL_DEQUE_H_
+#define _WORK_STEAL_DEQUE_H_
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+// Chase-Lev工作窃取双端队列
+    // 参考 Lê et al. "Correct and Efficient Work-Stealing for Weak Memory Models"
+    // 只有所属线程可以push/pop（在bottom端，后进先出），其他线程只能steal（在top端，先进先出）
+    // T必须是可以放进std::atomic的类型，这里用来存放任务指针
+    // 容量不够时扩容为两倍，旧数组可能还有窃取者在读，等队列析构时再释放
+template<typename T>
+class WorkStealDeque {
+public:
+    explicit WorkStealDeque(int64_t capacity = 256) {
+        m_array.store(new Array(capacity), std::memory_order_relaxed);
+    }
+
+    ~WorkStealDeque() {
+        for (Array* a : m_garbage) {
+            delete a;
+        }
+        delete m_array.load(std::memory_order_relaxed);
+    }
+
+    WorkStealDeque(const WorkStealDeque&) = delete;
+    WorkStealDeque& operator=(const WorkStealDeque&) = delete;
+
+    // 所属线程：压入bottom端
+    void push(T item) {
+        int64_t b = m_bottom.load(std::memory_order_relaxed);
+        int64_t t = m_top.load(std::memory_order_acquire);
+        Array* a = m_array.load(std::memory_order_relaxed);
+
+        if (b - t > a->capacity - 1) {
+            Array* bigger = a->grow(b, t);
+            m_garbage.push_back(a);
+            a = bigger;
+            m_array.store(a, std::memory_order_release);
+        }
+
+        a->put(b, item);
+        std::atomic_thread_fence(std::memory_order_release);
+        m_bottom.store(b + 1, std::memory_order_relaxed);
+    }
+
+    // 所属线程：从bottom端弹出，队列为空返回false
+    bool pop(T& item) {
+        int64_t b = m_bottom.load(std::memory_order_relaxed) - 1;
+        Array* a = m_array.load(std::memory_order_relaxed);
+        m_bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = m_top.load(std::memory_order_relaxed);
+
+        if (t > b) {
+            // 队列为空
+            m_bottom.store(b + 1, std::memory_order_relaxed);
+            return false;
+        }
+
+        item = a->get(b);
+        if (t == b) {
+            // 只剩最后一个元素，和窃取者竞争
+            bool won = m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+            m_bottom.store(b + 1, std::memory_order_relaxed);
+            return won;
+        }
+        return true;
+    }
+
+    // 其他线程：从top端窃取，队列为空或者竞争失败返回false
+    bool steal(T& item) {
+        int64_t t = m_top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t b = m_bottom.load(std::memory_order_acquire);
+
+        if (t >= b) {
+            return false;
+        }
+
+        Array* a = m_array.load(std::memory_order_acquire);
+        item = a->get(t);
+        return m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+    }
+
+    // 近似大小，任何线程都可以调用
+    size_t size() const {
+        int64_t b = m_bottom.load(std::memory_order_relaxed);
+        int64_t t = m_top.load(std::memory_order_relaxed);
+        return b > t ? static_cast<size_t>(b - t) : 0;
+    }
+
+    bool empty() const {return size() == 0;}
+
+    // 所属线程：换一个新的空数组，新数组的物理页在本线程第一次写入时分配
+        // 用于线程绑定到另一个NUMA节点之后，让数组跟着线程走；队列不为空时什么也不做
+        // 窃取者只在top < bottom时才读取数组，空队列换数组不会被看到
+    void relocate() {
+        if (!empty()) {
+            return;
+        }
+        Array* a = m_array.load(std::memory_order_relaxed);
+        m_garbage.push_back(a);
+        m_array.store(new Array(a->capacity), std::memory_order_release);
+    }
+
+private:
+    // 环形数组，容量为2的幂
+    struct Array {
+        int64_t capacity;
+        int64_t mask;
+        std::atomic<T>* buffer;
+
+        explicit Array(int64_t c) : capacity(c), mask(c - 1), buffer(new std::atomic<T>[c]) {}
+        ~Array() {delete[] buffer;}
+
+        T get(int64_t i) const {return buffer[i & mask].load(std::memory_order_relaxed);}
+        void put(int64_t i, T item) {buffer[i & mask].store(item, std::memory_order_relaxed);}
+
+        Array* grow(int64_t b, int64_t t) const {
+            Array* a = new Array(capacity * 2);
+            for (int64_t i = t; i != b; i++) {
+                a->put(i, get(i));
+            }
+            return a;
+        }
+    };
+
+    // top和bottom分别被窃取者和所属线程频繁修改，放在不同的缓存行上
+    alignas(64) std::atomic<int64_t> m_top{0};
+    alignas(64) std::atomic<int64_t> m_bottom{0};
+    alignas(64) std::atomic<Array*> m_array{nullptr};
+    // 扩容后淘汰的数组，只有所属线程访问
+    std::vector<Array*> m_garbage;
+};
+
+#endif